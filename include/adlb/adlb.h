@@ -19,6 +19,7 @@ extern "C" {
 #define ADLB_DONE_BY_EXHAUSTION (-999999998)
 #define ADLB_NO_CURRENT_WORK    (-999999997)
 #define ADLB_PUT_REJECTED       (-999999996)
+#define ADLB_WORK_TOO_BIG       (-999999995)
 #define ADLB_LOWEST_PRIO        (-999999999)
 
 /* for Info_get;  MUST match adlbf.h  */
@@ -34,6 +35,55 @@ extern "C" {
 #define ADLB_INFO_NUM_RESERVES            10
 #define ADLB_INFO_NUM_RESERVES_PUT_ON_RQ  11
 #define ADLB_INFO_MAX_WQ_COUNT            12
+#define ADLB_INFO_PAYLOAD_FRAG            13
+#define ADLB_INFO_HANDLER_TIME            14
+#define ADLB_INFO_HANDLER_COUNT           15
+/* per-handler: add the handler number shown in the server's final stats */
+#define ADLB_INFO_HANDLER_TIME_BASE      100
+#define ADLB_INFO_HANDLER_COUNT_BASE     200
+/* Info_set tunables; may also be read back with Info_get */
+#define ADLB_INFO_PROGRESS_MODE           16
+#define ADLB_INFO_PROGRESS_SPIN_PASSES    17
+#define ADLB_INFO_PROGRESS_MAX_SLEEP      18
+#define ADLB_INFO_IDLE_SLEEP_TIME         19
+
+/* values for ADLB_INFO_PROGRESS_MODE */
+#define ADLB_PROGRESS_SPIN                 0
+#define ADLB_PROGRESS_BACKOFF              1
+
+/* server housekeeping timers: add one of these to ADLB_INFO_TIMER_INTERVAL_BASE
+   (secs; Info_get and Info_set) or ADLB_INFO_TIMER_RUNS_BASE (Info_get) */
+#define ADLB_INFO_TIMER_INTERVAL_BASE    300
+#define ADLB_INFO_TIMER_RUNS_BASE        400
+#define ADLB_TIMER_DBG_CHECK               0
+#define ADLB_TIMER_PERIODIC_STATS          1
+#define ADLB_TIMER_EXHAUST_CHK             2
+#define ADLB_TIMER_QMSTAT                  3
+#define ADLB_TIMER_DBG_TIMING              4
+#define ADLB_TIMER_LOGATDS                 5
+#define ADLB_NUM_TIMERS                    6
+
+/* server msg batching: max msgs handled per loop pass, and the priority
+   (lower is handled first) of each class at ADLB_INFO_MSG_CLASS_PRIO_BASE
+   + class; classes are reserves/gets, balancing and puts, stats/logging */
+#define ADLB_INFO_BATCH_MAX               20
+#define ADLB_INFO_MSG_CLASS_PRIO_BASE    500
+#define ADLB_MSG_CLASS_REQUEST             0
+#define ADLB_MSG_CLASS_BALANCE             1
+#define ADLB_MSG_CLASS_STATS               2
+#define ADLB_NUM_MSG_CLASSES               3
+
+/* puts of at most ADLB_INFO_PUT_EAGER_MAX bytes (set on app ranks) go to the
+   server in one msg with one reply instead of a header/payload handshake */
+#define ADLB_INFO_PUT_EAGER_MAX           21
+#define ADLB_INFO_NUM_EAGER_PUTS          22
+
+/* with ADLB_INFO_PREFETCH_DEPTH > 0 (set on app ranks) an app keeps up to that
+   many units reserved ahead of its Reserve calls; those of at most
+   ADLB_INFO_PREFETCH_FETCH_MAX bytes are fetched along with the reservation */
+#define ADLB_INFO_PREFETCH_DEPTH          23
+#define ADLB_INFO_PREFETCH_FETCH_MAX      24
+#define ADLB_INFO_NUM_PREFETCH_STOLEN     25
 
 #define ADLB_RESERVE_REQUEST_ANY    -1
 #define ADLB_RESERVE_EOL            -1
@@ -51,12 +101,27 @@ int ADLB_Debug_server(double timeout);
 int ADLBP_Put(void *,int,int,int,int,int);
 int ADLB_Put(void *,int,int,int,int,int);
 
+int ADLBP_Put_many(int, void **, int *, int *, int *, int *, int *);
+int ADLB_Put_many(int, void **, int *, int *, int *, int *, int *);
+
+int ADLBP_Iput(void *,int,int,int,int,int,int *);
+int ADLB_Iput(void *,int,int,int,int,int,int *);
+
+int ADLBP_Test(int, int *);
+int ADLB_Test(int, int *);
+
+int ADLBP_Wait(int);
+int ADLB_Wait(int);
+
 int ADLBP_Reserve(int *, int *, int *, int *, int *, int *);
 int ADLB_Reserve(int *, int *, int *, int *, int *, int *);
 
 int ADLBP_Ireserve(int *, int *, int *, int *, int *, int *);
 int ADLB_Ireserve(int *, int *, int *, int *, int *, int *);
 
+int ADLBP_Get_work(int *, int *, int *, void *, int, int *, int *, int *);
+int ADLB_Get_work(int *, int *, int *, void *, int, int *, int *, int *);
+
 int ADLBP_Get_reserved(void *, int *);
 int ADLB_Get_reserved(void *, int *);
 
@@ -75,6 +140,9 @@ int ADLB_Set_no_more_work(void);
 int ADLBP_Info_get(int, double *);
 int ADLB_Info_get(int, double *);
 
+int ADLBP_Info_set(int, double);
+int ADLB_Info_set(int, double);
+
 int ADLBP_Info_num_work_units(int , int *, int *, int *);
 int ADLB_Info_num_work_units(int , int *, int *, int *);
 
@@ -14,6 +14,8 @@
       integer,  parameter ::                                              &
      &    ADLB_PUT_REJECTED = -999999996
       integer,  parameter ::                                              &
+     &    ADLB_WORK_TOO_BIG = -999999995
+      integer,  parameter ::                                              &
      &    ADLB_LOWEST_PRIO = -999999999
       integer,  parameter ::                                              &
      &    ADLB_INFO_MALLOC_HWM = 1
@@ -40,6 +42,68 @@
       integer,  parameter ::                                              &
      &    ADLB_INFO_MAX_WQ_COUNT = 12
       integer,  parameter ::                                              &
+     &    ADLB_INFO_PAYLOAD_FRAG = 13
+      integer,  parameter ::                                              &
+     &    ADLB_INFO_HANDLER_TIME = 14
+      integer,  parameter ::                                              &
+     &    ADLB_INFO_HANDLER_COUNT = 15
+      integer,  parameter ::                                              &
+     &    ADLB_INFO_HANDLER_TIME_BASE = 100
+      integer,  parameter ::                                              &
+     &    ADLB_INFO_HANDLER_COUNT_BASE = 200
+      integer,  parameter ::                                              &
+     &    ADLB_INFO_PROGRESS_MODE = 16
+      integer,  parameter ::                                              &
+     &    ADLB_INFO_PROGRESS_SPIN_PASSES = 17
+      integer,  parameter ::                                              &
+     &    ADLB_INFO_PROGRESS_MAX_SLEEP = 18
+      integer,  parameter ::                                              &
+     &    ADLB_INFO_IDLE_SLEEP_TIME = 19
+      integer,  parameter ::                                              &
+     &    ADLB_PROGRESS_SPIN = 0
+      integer,  parameter ::                                              &
+     &    ADLB_PROGRESS_BACKOFF = 1
+      integer,  parameter ::                                              &
+     &    ADLB_INFO_TIMER_INTERVAL_BASE = 300
+      integer,  parameter ::                                              &
+     &    ADLB_INFO_TIMER_RUNS_BASE = 400
+      integer,  parameter ::                                              &
+     &    ADLB_TIMER_DBG_CHECK = 0
+      integer,  parameter ::                                              &
+     &    ADLB_TIMER_PERIODIC_STATS = 1
+      integer,  parameter ::                                              &
+     &    ADLB_TIMER_EXHAUST_CHK = 2
+      integer,  parameter ::                                              &
+     &    ADLB_TIMER_QMSTAT = 3
+      integer,  parameter ::                                              &
+     &    ADLB_TIMER_DBG_TIMING = 4
+      integer,  parameter ::                                              &
+     &    ADLB_TIMER_LOGATDS = 5
+      integer,  parameter ::                                              &
+     &    ADLB_NUM_TIMERS = 6
+      integer,  parameter ::                                              &
+     &    ADLB_INFO_BATCH_MAX = 20
+      integer,  parameter ::                                              &
+     &    ADLB_INFO_MSG_CLASS_PRIO_BASE = 500
+      integer,  parameter ::                                              &
+     &    ADLB_MSG_CLASS_REQUEST = 0
+      integer,  parameter ::                                              &
+     &    ADLB_MSG_CLASS_BALANCE = 1
+      integer,  parameter ::                                              &
+     &    ADLB_MSG_CLASS_STATS = 2
+      integer,  parameter ::                                              &
+     &    ADLB_NUM_MSG_CLASSES = 3
+      integer,  parameter ::                                              &
+     &    ADLB_INFO_PUT_EAGER_MAX = 21
+      integer,  parameter ::                                              &
+     &    ADLB_INFO_NUM_EAGER_PUTS = 22
+      integer,  parameter ::                                              &
+     &    ADLB_INFO_PREFETCH_DEPTH = 23
+      integer,  parameter ::                                              &
+     &    ADLB_INFO_PREFETCH_FETCH_MAX = 24
+      integer,  parameter ::                                              &
+     &    ADLB_INFO_NUM_PREFETCH_STOLEN = 25
+      integer,  parameter ::                                              &
      &    ADLB_RESERVE_REQUEST_ANY = -1
       integer,  parameter ::                                              &
      &    ADLB_RESERVE_EOL = -1
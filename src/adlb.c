@@ -8,6 +8,8 @@
 #include <stdarg.h>
 #include <string.h>
 #include <stdlib.h>
+#include <time.h>
+#include <sys/mman.h>
 
 #include <adlb/adlb.h>
 
@@ -81,16 +83,26 @@ void GetUnexpectedRequestTagsInDBGTagsBuf(int[]);
 #define  FA_GET_COMMON                    1038
 #define  TA_GET_COMMON_RESP               1039
 #define  SS_DBG_TIMING_MSG                1040
+#define  FA_PUT_EAGER                     1041
+#define  TA_IPUT_RESP                     1042
+#define  FA_PUT_MANY                      1043
+#define  FA_GET_WORK                      1044
+#define  FA_UNRESERVE                     1045
+#define  FA_IPUT_MSG                      1046  /* own tag so a Put's payload never matches */
 
 #define  SUCCESS                             1
 #define  ERROR                              -1
 #define  NO_CURR_WORK                       -2
+#define  GOT_WORK                            2  /* reserve resp carrying the work */
+#define  RESERVE_PREFETCH                    2  /* reserve flag: no hang, soft pin */
 
 #define  IBUF_NUMINTS                       12
 #define  IBUF_NUMDBLS                       12
-#define  RFRBUF_NUMINTS                   (12+REQ_TYPE_VECT_SZ)
+#define  RFR_HDR_NUMINTS                     2  /* rqseqno, for_rank; req_types follow */
+#define  RFR_RESP_NUMINTS                   12  /* on failure, req_types follow the 3rd */
 
 #define  THRESHOLD_TO_START_PUSH          (0.95 * max_malloc)
+#define  THRESHOLD_TO_REJECT_PUT          (0.99 * max_malloc)  /* rest for msg bufs */
 
 #define  MAX_PUT_ATTEMPTS                  100
 #define  MAX_PUSH_ATTEMPTS                1000
@@ -106,6 +118,7 @@ static int num_world_nodes, num_servers, next_wqseqno, next_rqseqno, next_cqseqn
            master_server_rank, my_world_rank, holding_end_loop_1, my_server_rank,
            using_debug_server, debug_server_rank, *user_types, dbgprintf_flag;
 static int nputmsgs = 0, nqmstatmsgs = 0, num_qmstats_exceeded_interval = 0;
+static int num_eager_puts = 0, num_prefetched_stolen = 0;
 static int npushed_from_here = 0, npushed_to_here = 0, nrfrs_sent = 0, nrfrs_recvd = 0;
 static int num_rq_nodes_timed = 0, num_tq_nodes_fixed = 0;
 static int *rfr_to_rank;  /* vector, one per app rank */
@@ -119,34 +132,45 @@ static int common_len = 0, common_refcnt = 0,
            common_server_rank = -1, common_server_commseqno = -1;
 static double init_fixed_dmalloced = 0.0, total_bytes_dmalloced = 0.0;
 static double curr_bytes_dmalloced = 0.0, hwm_bytes_dmalloced = 0.0;
+static double curr_bytes_bkmalloced = 0.0, hwm_bytes_bkmalloced = 0.0;
 static double num_reserves = 0.0, num_reserves_put_on_rq = 0.0;
 static double sum_of_qmstat_trip_times = 0.0, max_qmstat_trip_time = 0.0;
 static double num_rejected_puts = 0.0, total_time_on_rq = 0.0;
 static double max_malloc, job_start_time;
 static MPI_Comm adlb_all_comm, adlb_server_comm, adlb_debug_comm;
+/* dups of world with the same ranks: app<->server traffic stays on
+   adlb_all_comm, server-to-server balancing and termination traffic goes on
+   adlb_bal_comm and stats/logging on adlb_tel_comm, so each is matched
+   in its own queue and a backlog on one never has to be searched to find
+   a msg on another */
+static MPI_Comm adlb_bal_comm, adlb_tel_comm;
 static MPI_Request dummy_req;
 
 static int random_in_range(int,int);
-static int get_type_idx(int);
 static int find_cand_rank_with_worktype(int,int);
 static void update_local_state();
 static void pack_qmstat(void);
 static void unpack_qmstat(void);
 static void check_remote_work_for_queued_apps();
+static void send_rfr(int,rq_struct_t *);
+static int *recv_ints(MPI_Status *,int,int *);
 static int get_server_idx(int);
 static int get_server_rank(int);
 static int dump_qmstat_info();
 static void print_final_stats(void);
 static void print_proc_self_status(void);
 static void print_curr_mem_and_queue_status(void);
+static double pmalloc_frag(void);
+static double bytes_in_use(void);
+static void build_type_idx_table(void);
 static void print_circular_buffers(void);
 static void log_at_debug_server(void);
 void adlb_exit_handler(void);
 static void cblog(int flag, int for_rank, char *fmt, ...);
 static void adlb_server_abort(int,int);
+static void wq_delete_taken(xq_node_t *);
 int adlbp_Reserve(int *, int *, int *, int *, int *, int *, int);
 int adlbp_Get_reserved_timed(void *, int *, double *);
-void *pmalloc(int nbytes, const char *funcname, int linenum);
 
 struct qmstat_entry
 {
@@ -159,14 +183,80 @@ void *qmstat_send_buf, *qmstat_recv_buf;
 int qmstat_buflen;
 
 static int lhs_rank, rhs_rank;
+static req_mask_t *req_mask;    /* types of the reserve/rfr being handled */
 
 static char *inside_batch_put;
 static char *first_time_on_rq;
-static double qmstat_interval = 0.1;
-static double logatds_interval = 1.0;
 static double total_looptop_time = 0.0;;
 static int next_server_rank_for_put;
-static double dbg_time_interval = 1.0;
+/* eager puts: hdr ints then payload in one msg; app packs, server unpacks */
+static int put_eager_max = 4096;
+static char *put_eager_buf = NULL;   /* app's, for packing a Put */
+static int put_eager_buflen = 0;
+#define PUT_EAGER_MAX_LIMIT 65536 /* largest put_eager_max, so staging is bounded */
+#define PUT_STAGE_BYTES    (2 * PUT_EAGER_MAX_LIMIT)  /* also caps a Put_many group */
+#define PUT_MANY_MAX_UNITS 256
+static char *put_stage_buf = NULL;  /* server's, bmalloc'd once at PUT_STAGE_BYTES */
+#define GET_WORK_FUSED_MAX 65536  /* Get_work takes larger units via Get_reserved */
+static int *get_work_msg = NULL;  /* app's buf for a Get_work resp */
+static int get_work_msg_nints = 0;
+
+/* an app's outstanding Iputs; a handle is an index into iput_reqs.  One of
+   at most put_eager_max bytes is sent in the eager form; a larger one sends
+   its hdr, and its payload only once the server has acked (and so has room).
+   At most one is in flight to a given server so that server's TA_IPUT_RESP
+   replies always belong to it. */
+#define IPUT_FREE      0
+#define IPUT_WAITING   1    /* to be (re)sent once its server is free */
+#define IPUT_SENT      2    /* eager msg or hdr sent */
+#define IPUT_DONE      3    /* rc is ready for Test/Wait */
+#define IPUT_MSG_SENT  4    /* hdr acked and payload sent */
+typedef struct iput_req
+{
+    int state, rc, eager, to_server_rank, home_server_rank, target_rank, msglen,
+        put_attempt_cntr, sleep_cntr, other_servers_may_have_space;
+    int *reply;            /* own block, so a pending recv survives table growth */
+    char *buf;             /* hdr ints then a copy of the work */
+    double retry_time;     /* backing off after every server rejected it */
+    MPI_Request reqs[2];   /* send, reply */
+} iput_req_t;
+static iput_req_t *iput_reqs = NULL;
+static int num_iput_reqs = 0;
+static int *iput_server_busy = NULL;  /* per server: Iput in flight to it, or -1 */
+static void iput_progress(void);
+static void iput_wait_all(void);
+
+/* an app's prefetched units, when ADLB_INFO_PREFETCH_DEPTH > 0.  Refills are
+   non-hanging reserves sent to the app's server as Reserve returns, so they
+   are answered while the app works; replies match the posted recvs in order.
+   A unit held only by reservation is soft pinned at the server, which may
+   take it back for a waiting app no server has other work for.  A handle for a prefetched unit names its
+   slot; the unit's data is here by the time Reserve returns it. */
+#define PREFETCH_DEPTH_MAX  64
+#define PREFETCH_HANDLE     -2    /* in work_handle[1], in place of a server rank */
+#define PF_FREE      0
+#define PF_ASKED     1    /* refill sent; reply not yet in */
+#define PF_RESERVED  2    /* soft pinned at the server */
+#define PF_FETCHED   3    /* data is here */
+#define PF_GIVEN     4    /* returned by Reserve; data here until Get_reserved */
+typedef struct prefetch_slot
+{
+    int state, work_type, work_prio, work_len, answer_rank, target_rank;
+    int work_handle[ADLB_HANDLE_SIZE];
+    int *msg;              /* reserve resp; a GOT_WORK one has the data after it */
+    char *work_buf;        /* data once fetched */
+    double queued_time;
+    MPI_Request req;
+} prefetch_slot_t;
+static prefetch_slot_t *prefetch_slots = NULL;
+static int prefetch_depth = 0, prefetch_fetch_max = 0, prefetch_msg_nints;
+static int prefetch_dry = 0;    /* last refill found no work at the server */
+static int prefetch_rc = 0;     /* NO_MORE_WORK or EXHAUSTION once seen */
+static int prefetch_take(int *, int, int *, int *, int *, int *, int *);
+static void prefetch_refill(int *, int);
+static void prefetch_return_all(void);
+static int prefetch_get(void *, int *, double *);
+static int get_reserved_data(void *, int *, double *, int);
 static int dbg_unexpected_by_tag[50];
 static int *dbg_wq_by_type;
 static int *dbg_wq_targ_by_type;
@@ -179,7 +269,114 @@ static int *bufidx, num_bufs_in_circle;
 static char ***cbuffers, log_buf[111];
 
 static int doing_periodic_stats = 0;  /* default is OFF */
-static double periodic_timeout = 1.0;
+
+/* server housekeeping tasks, indexed by ADLB_TIMER_*; the loop reads the clock
+   once per pass and only calls server_timers_run_due when the earliest is due */
+#define SERVER_TIMER_OFF 1.0e300
+typedef struct server_timer
+{
+    char *name;
+    double interval;        /* secs between runs; settable via Info_set */
+    void (*run)(double now);
+    double next_due;        /* SERVER_TIMER_OFF while disarmed */
+    double run_cnt, run_time;
+} server_timer_t;
+static void timer_dbg_check(double);
+static void timer_periodic_stats(double);
+static void timer_exhaust_chk(double);
+static void timer_qmstat(double);
+static void timer_dbg_timing(double);
+static void timer_logatds(double);
+static server_timer_t server_timers[ADLB_NUM_TIMERS] =
+{
+    { "dbg_check",      DBG_CHECK_TIME, timer_dbg_check },
+    { "periodic_stats", 1.0,            timer_periodic_stats },
+    { "exhaust_chk",    5.0,            timer_exhaust_chk },
+    { "qmstat",         0.1,            timer_qmstat },
+    { "dbg_timing",     1.0,            timer_dbg_timing },
+    { "logatds",        1.0,            timer_logatds },
+};
+static double server_timers_next_due = SERVER_TIMER_OFF;
+static void server_timer_arm(int, double);
+static void server_timer_disarm(int);
+static void server_timer_defer(int, double);
+static void server_timers_run_due(double);
+
+/* what the server loop does when a pass finds no msg; settable via Info_set */
+static int progress_mode = ADLB_PROGRESS_SPIN;
+static int progress_spin_passes = 1000;     /* idle passes before first sleep */
+static double progress_max_sleep = 0.001;   /* cap on one backoff sleep (secs) */
+static int num_idle_sleeps = 0;
+static double total_idle_sleep_time = 0.0;
+
+/* server loop dispatch: one handler per msg tag, indexed by tag - SERVER_TAG_BASE */
+#define SERVER_TAG_BASE 1000
+#define NUM_SERVER_TAGS   50
+typedef void (*server_handler_t)(int, int, MPI_Status *);
+static server_handler_t server_handlers[NUM_SERVER_TAGS];
+static char *server_handler_names[NUM_SERVER_TAGS];
+static double server_handler_time[NUM_SERVER_TAGS];
+static double server_handler_cnt[NUM_SERVER_TAGS];
+static void register_server_handlers(void);
+static void isend_ints(int *, int, int, int);
+static int server_probe(int *, MPI_Status *);
+static int server_recv(void *, int, MPI_Datatype, MPI_Status *);
+
+/* msg found by server_probe, to be received by the handler's server_recv */
+#if MPI_VERSION >= 3
+static MPI_Message server_msg = MPI_MESSAGE_NULL;
+#else
+static int server_msg_source, server_msg_tag;
+static MPI_Comm server_msg_comm;
+#endif
+
+/* comms the server probes for unexpected msgs, in the order it starts with */
+#define NUM_PROBE_COMMS 3
+static MPI_Comm *probe_comms[NUM_PROBE_COMMS] =
+    { &adlb_all_comm, &adlb_bal_comm, &adlb_tel_comm };
+
+/* persistent receives kept posted for the fixed-size headers an app sends
+   and then waits on; a msg that lands in one is handled from its slot */
+#define NUM_PREPOSTED_TAGS 4
+static int preposted_tags[NUM_PREPOSTED_TAGS] =
+    { FA_PUT_HDR, FA_PUT_COMMON_HDR, FA_GET_RESERVED, FA_GET_COMMON };
+static int num_preposted = 0;
+static MPI_Request *preposted_reqs;
+static int *preposted_bufs;      /* IBUF_NUMINTS per slot */
+static int server_msg_slot = -1; /* slot holding the msg being handled */
+
+/* each pass gathers up to server_batch_max msgs and handles them in order
+   of their class's priority (lower first), arrival order within a class */
+#define SERVER_BATCH_CAP 64
+typedef struct server_batch_entry
+{
+    MPI_Status status;
+#if MPI_VERSION >= 3
+    MPI_Message msg;
+#endif
+    int slot;        /* preposted slot, or -1 */
+    int prio;
+} server_batch_entry_t;
+static server_batch_entry_t server_batch[SERVER_BATCH_CAP];
+static int server_batch_max = 16;
+static int msg_class_prio[ADLB_NUM_MSG_CLASSES] = { 0, 1, 2 };
+static int server_handler_class[NUM_SERVER_TAGS];
+static int server_gather_batch(MPI_Request *);
+static int put_recvs_test(void);
+static void server_discard_batch(int, int);
+static void preposted_init(void);
+static void preposted_free(void);
+static void server_idle_sleep(double);
+
+/* server loop state shared between ADLBP_Server and the handlers */
+static int server_done, num_local_apps_done, push_query_is_out, push_attempt_cntr,
+           exhausted_flag, qmstat_msg_is_out, dbg_msg_is_out, iprobe_successful_cnt,
+           dbg_tags_handled[50];
+static int periodic_buf_num_ints, *periodic_buf, *periodic_rq_vector,
+           **periodic_wq_2darray, *periodic_put_cnt, *periodic_resolved_reserve_cnt;
+static double prev_qmstat_msg_time, prev_dbg_msg_start, dbg_prev_qmstat_timelen;
+static struct qmstat_entry temp_qm;
+static char *buf1000;
 
 int server_comm_rank, server_comm_size, server_comm_rhs;
 
@@ -235,6 +432,7 @@ int ADLBP_Init(int nservers, int use_debug_server, int aprintf_flag, int ntypes,
     user_types = amalloc(num_types * sizeof(int));
     for (i=0; i < num_types; i++)
         user_types[i] = type_vect[i];
+    build_type_idx_table();
     num_servers = nservers;
     using_debug_server = use_debug_server;
     if (using_debug_server)
@@ -281,11 +479,18 @@ int ADLBP_Init(int nservers, int use_debug_server, int aprintf_flag, int ntypes,
         rc = MPI_Comm_size(adlb_server_comm,&server_comm_size);
         rc = MPI_Comm_rank(adlb_server_comm,&server_comm_rank);
         server_comm_rhs = (server_comm_rank == server_comm_size-1) ? 0 : server_comm_rank + 1;
+        xq_pools_init();              /* entries for all the queues below */
+        req_mask_init(num_types);
+        req_mask = amalloc(req_mask_words() * sizeof(req_mask_t));
         wq = (xq_t *) xq_create();    /* wq is defined in adlb-specific of xq.h */
+        wq_index_init(num_types,num_world_nodes);  /* heaps of available work */
         rq = (xq_t *) xq_create();    /* rq is defined in adlb-specific of xq.h */
-        iq = (xq_t *) xq_create();    /* iq is defined in adlb-specific of xq.h */
+        rq_index_init(num_types,num_world_nodes);  /* waiting ranks by type and rank */
+        iq_init();                    /* outstanding isends */
         tq = (xq_t *) xq_create();    /* tq is defined in adlb-specific of xq.h */
+        tq_index_init(num_types,num_world_nodes);  /* targeted records by rank and type */
         cq = (xq_t *) xq_create();    /* cq is defined in adlb-specific of xq.h */
+        cq_index_init();              /* common blocks by cqseqno */
         num_apps_this_server = 0;
         strcpy(print_buf,"SERVER for ranks: ");
         for (i=0; i < num_app_ranks; i++)
@@ -307,6 +512,9 @@ int ADLBP_Init(int nservers, int use_debug_server, int aprintf_flag, int ntypes,
             qmstat_tbl[i].qlen_unpin_untarg = 0;
             qmstat_tbl[i].nbytes_used = 0.0;
         }
+        /* my own entry is kept current by wq as work comes and goes */
+        i = get_server_idx(my_world_rank);
+        wq_summary_register(qmstat_tbl[i].type_hi_prio,&qmstat_tbl[i].qlen_unpin_untarg);
         qmstat_buflen = sizeof(int)*num_types +    /* qmstat type_hi_prio */
                         sizeof(int)           +    /* qmstat qlen_unpin_untarg */
                         sizeof(double);            /* qmstat nbytes_used */
@@ -316,6 +524,8 @@ int ADLBP_Init(int nservers, int use_debug_server, int aprintf_flag, int ntypes,
         qmstat_recv_buf = amalloc(qmstat_buflen);
     }
     rc = MPI_Comm_dup(MPI_COMM_WORLD,&adlb_all_comm);
+    rc = MPI_Comm_dup(MPI_COMM_WORLD,&adlb_bal_comm);
+    rc = MPI_Comm_dup(MPI_COMM_WORLD,&adlb_tel_comm);
     next_wqseqno = 1;
     next_rqseqno = 1;
     next_cqseqno = 1;
@@ -381,44 +591,19 @@ int ADLBP_Init(int nservers, int use_debug_server, int aprintf_flag, int ntypes,
 
 int ADLBP_Server(double hi_malloc, double periodic_log_interval)
 {
-    int i, j, k, rc, done, reserve_buf[REQ_TYPE_VECT_SZ+1], info_buf[IBUF_NUMINTS], work_type,
-        answer_rank, work_prio, wqseqno, work_len, flag, from_rank, from_tag, hang_flag,
-        num_local_apps_done, type_idx, server_rank, orig_rqseqno,
-        server_idx, target_rank, cand_rank, msg_available, rqseqno, push_attempt_cntr,
-        ack_buf[IBUF_NUMINTS], batch_flag, for_rank,
-        req_types[REQ_TYPE_VECT_SZ], push_query_is_out, to_rank, prev_target,
-        *temp_buf, rfr_buf[RFRBUF_NUMINTS], nbytes_printed, nbytes_left_to_print, skip,
-        periodic_buf_num_ints, *periodic_buf, *periodic_rq_vector, **periodic_wq_2darray,
-        *periodic_put_cnt, *periodic_resolved_reserve_cnt, exhausted_flag,
-        qmstat_msg_is_out, iprobe_successful_cnt;
+    int i, j, b, from_rank, from_tag, tag_idx, server_rank, cand_rank,
+        nbatch, iq_slot, idle_passes;
     /****************
     int ptidx, max_ptidx, prio_tags[8];
     ****************/
-    int dbg_msg_is_out, dbg_tags_handled[50];
-    double dbls_info_buf[IBUF_NUMDBLS], *dbls_temp_buf, smallest_dbl, temp_dbl;
-    xq_node_t *wq_node, *rq_node, *iq_node, *iq_curr_node, *iq_next_node,
-              *tq_node, *tq_prev, *cq_node;
+    double *dbls_temp_buf, smallest_dbl;
+    xq_node_t *wq_node;
     // xq_node_t *qmstat_isend_node_ptr;
     wq_struct_t *ws;
-    rq_struct_t *rs;
-    iq_struct_t *is;
-    tq_struct_t *ts;
-    cq_struct_t *cs;
-    void *work_buf;
     MPI_Status status;
-    MPI_Request request, qmstat_req;
-    MPI_Request *temp_req;
-    char *temp_char_buf, *buf1000, temp_str[64];
-    double prev_periodic_msg_time, prev_qmstat_msg_time;
-    double prev_dbg_msg_timelen, prev_dbg_msg_start, dbg_prev_qmstat_timelen;
-    double prev_exhaust_chk_time, exhaust_chk_interval, start_looptop_time;
-    double prev_logatds_time;
-    struct qmstat_entry temp_qm;
-
-    int dbg_flag;
-    int dbg_2_cnt, dbg_10_cnt, dbg_10002_cnt;
-    double dbg_30_time, dbg_oldest_2_time, dbg_oldest_10_time, dbg_oldest_10002_time;
-    char dbg_temp_buf[512], dbg_print_buf[4096];
+    MPI_Request qmstat_req;
+    double handler_start_time, handler_end_time, idle_sleep, next_deadline, now;
+    double start_looptop_time;
 
 #ifdef FOO_BGP
     tmaxmem = malloc(sizeof(void*) * 9000);
@@ -439,7 +624,7 @@ int ADLBP_Server(double hi_malloc, double periodic_log_interval)
     if (periodic_log_interval > 0.0)
     {
         doing_periodic_stats = 1;
-        periodic_timeout = periodic_log_interval;
+        server_timers[ADLB_TIMER_PERIODIC_STATS].interval = periodic_log_interval;
     }
     aprintf(1,"lhs %d  rhs %d  max_malloc %0.f  periodic_log_interval %f\n",
             lhs_rank,rhs_rank,max_malloc,periodic_log_interval);
@@ -481,13 +666,10 @@ int ADLBP_Server(double hi_malloc, double periodic_log_interval)
     num_reserves_not_in_stat_vec = 0;
     num_rfr_failed_since_logatds = 0;
     num_ss_msgs_handled_since_logatds = 0;
-    prev_logatds_time = MPI_Wtime();
-    prev_periodic_msg_time = MPI_Wtime();
-    prev_qmstat_msg_time = MPI_Wtime();
-    prev_dbg_msg_start = MPI_Wtime();
-    prev_exhaust_chk_time = MPI_Wtime();
+    now = MPI_Wtime();
+    prev_qmstat_msg_time = now;
+    prev_dbg_msg_start = now;
     start_looptop_time = 0.0;  /* setup below */
-    exhaust_chk_interval = 5.0;
     exhausted_flag = 0;
     push_attempt_cntr = 0;
     push_query_is_out = 0;
@@ -500,13 +682,36 @@ int ADLBP_Server(double hi_malloc, double periodic_log_interval)
         dbg_msg_is_out = 0;
         for (i=0; i < 50; i++)
             dbg_tags_handled[i] = 0;
-        dbg_30_time = MPI_Wtime();
+    }
+    /* arm the housekeeping tasks this server does */
+    for (i=0; i < ADLB_NUM_TIMERS; i++)
+        server_timers[i].next_due = SERVER_TIMER_OFF;
+    if (use_dbg_prints)
+        server_timer_arm(ADLB_TIMER_DBG_CHECK,now+server_timers[ADLB_TIMER_DBG_CHECK].interval);
+    if (using_debug_server)
+        server_timer_arm(ADLB_TIMER_LOGATDS,now+server_timers[ADLB_TIMER_LOGATDS].interval);
+    if (my_world_rank == master_server_rank)
+    {
+        if (doing_periodic_stats)
+            server_timer_arm(ADLB_TIMER_PERIODIC_STATS,
+                             now+server_timers[ADLB_TIMER_PERIODIC_STATS].interval);
+        server_timer_arm(ADLB_TIMER_EXHAUST_CHK,now+server_timers[ADLB_TIMER_EXHAUST_CHK].interval);
+        if (num_servers > 1)
+            server_timer_arm(ADLB_TIMER_QMSTAT,now+server_timers[ADLB_TIMER_QMSTAT].interval);
+        if (use_dbg_prints  &&  num_servers > 1)
+            server_timer_arm(ADLB_TIMER_DBG_TIMING,
+                             now+server_timers[ADLB_TIMER_DBG_TIMING].interval);
     }
     qmstat_req = MPI_REQUEST_NULL;
-    done = 0;
-    while ( ! done )
+    idle_passes = 0;
+    idle_sleep = 0.000001;
+    register_server_handlers();
+    preposted_init();
+    server_done = 0;
+    while ( ! server_done )
     {
-        if (curr_bytes_dmalloced > THRESHOLD_TO_START_PUSH)
+        now = MPI_Wtime();
+        if (bytes_in_use() > THRESHOLD_TO_START_PUSH)
         {
             if ( ! push_query_is_out  &&  num_servers > 1)
             {
@@ -541,12 +746,9 @@ int ADLBP_Server(double hi_malloc, double periodic_log_interval)
                         dbls_temp_buf[8]  = (double) ws->common_len;
                         dbls_temp_buf[9]  = (double) ws->common_server_rank;
                         dbls_temp_buf[10] = (double) ws->common_server_commseqno;
-                        temp_req = amalloc(sizeof(MPI_Request));
+                        iq_slot = iq_slot_create((IBUF_NUMDBLS * sizeof(double)),dbls_temp_buf);
                         MPI_Isend(dbls_temp_buf,IBUF_NUMDBLS,MPI_DOUBLE,cand_rank,
-                                  SS_PUSH_QUERY,adlb_all_comm,temp_req);
-                        iq_node = iq_node_create(temp_req,(IBUF_NUMDBLS * sizeof(double)),
-                                                 dbls_temp_buf);
-                        iq_append(iq_node);
+                                  SS_PUSH_QUERY,adlb_bal_comm,iq_req(iq_slot));
                         push_query_is_out = 1;
                         push_attempt_cntr++;
                         aprintf(1111,"push_query sent to %d\n",cand_rank);
@@ -555,317 +757,38 @@ int ADLBP_Server(double hi_malloc, double periodic_log_interval)
             }
         }
 
-        if (use_dbg_prints  &&  (MPI_Wtime() - dbg_30_time) > DBG_CHECK_TIME)
-        {
-            dbg_30_time = MPI_Wtime();
-            for (rq_node=xq_first(rq); rq_node; rq_node=xq_next(rq,rq_node))
-            {
-                rs = rq_node->data;
-                if ((dbg_30_time - rs->time_stamp) > DBG_CHECK_TIME)
-                {
-                    cand_rank = -1;
-                    for (i=0; i < REQ_TYPE_VECT_SZ; i++)
-                    {
-                        if (rs->req_types[i] < -1)  /* invalid type as place-holder */
-                            break;
-                        cand_rank = find_cand_rank_with_worktype(rs->world_rank,rs->req_types[i]);
-                        if (cand_rank >= 0)
-                            break;
-                    }
-                    if (cand_rank >= 0)
-                        dbg_flag = 1;
-                    else
-                        dbg_flag = 0;
-                    sprintf(dbg_print_buf,"%d %f %d %d %d %d ",
-                            rs->rqseqno,dbg_30_time-rs->time_stamp,rs->world_rank,
-                            rfr_to_rank[rs->world_rank],dbg_rfr_sent_cnt[rs->world_rank],
-                            dbg_flag);
-                    for (i=0; i < REQ_TYPE_VECT_SZ; i++)
-                    {
-                        if (rs->req_types[i] >= 0)
-                        {
-                            sprintf(dbg_temp_buf,"%d ",rs->req_types[i]);
-                            strcat(dbg_print_buf,dbg_temp_buf);
-                        }
-                        else
-                            break;
-                    }
-                    aprintf(0000,"DBG1: %s\n",dbg_print_buf);
-                }
-            }
-            dbg_2_cnt = dbg_10_cnt = dbg_10002_cnt = 0;
-            dbg_oldest_2_time = dbg_oldest_10_time = dbg_oldest_10002_time = 999999999999.0;
-            for (wq_node=xq_first(wq); wq_node; wq_node=xq_next(wq,wq_node))
-            {
-                ws = wq_node->data;
-                if (ws->work_type == 2)
-                {
-                    dbg_2_cnt++;
-                    if (ws->time_stamp < dbg_oldest_2_time)  // older
-                        dbg_oldest_2_time = ws->time_stamp;
-                }
-                else if (ws->work_type == 10)
-                {
-                    dbg_10_cnt++;
-                    if (ws->time_stamp < dbg_oldest_10_time)  // older
-                        dbg_oldest_10_time = ws->time_stamp;
-                }
-                else if (ws->work_type == 2)
-                {
-                    dbg_10002_cnt++;
-                    if (ws->time_stamp < dbg_oldest_10002_time)  // older
-                        dbg_oldest_10002_time = ws->time_stamp;
-                }
-            }
-            if (dbg_oldest_2_time < 999999999999.0)
-                dbg_oldest_2_time = MPI_Wtime() - dbg_oldest_2_time;
-            else
-                dbg_oldest_2_time = 0.0;
-            if (dbg_oldest_10_time < 999999999999.0)
-                dbg_oldest_10_time = MPI_Wtime() - dbg_oldest_10_time;
-            else
-                dbg_oldest_10_time = 0.0;
-            if (dbg_oldest_10002_time < 999999999999.0)
-                dbg_oldest_10002_time = MPI_Wtime() - dbg_oldest_10002_time;
-            else
-                dbg_oldest_10002_time = 0.0;
-            aprintf(0000,"DBG2: %d %f %d %f %d %f\n",
-                    dbg_2_cnt,dbg_oldest_2_time,
-                    dbg_10_cnt,dbg_oldest_10_time,
-                    dbg_10002_cnt,dbg_oldest_10002_time);
-
-            /**/
-            for (wq_node=xq_first(wq); wq_node; wq_node=xq_next(wq,wq_node))
-            {
-                ws = wq_node->data;
-                dbg_wq_by_type[ws->work_type]++;
-                if (ws->target_rank >= 0)
-                    dbg_wq_targ_by_type[ws->work_type]++;
-            }
-            sprintf(dbg_print_buf,"%d; ",wq->count);
-            for (i=0; i < 10010; i++)
-            {
-                if (dbg_wq_by_type[i] > 0)
-                {
-                    sprintf(dbg_temp_buf,"%d:%d ",i,dbg_wq_by_type[i]);
-                    strcat(dbg_print_buf,dbg_temp_buf);
-                }
-                if (dbg_wq_targ_by_type[i] > 0)
-                {
-                    sprintf(dbg_temp_buf,"%dt:%d ",i,dbg_wq_targ_by_type[i]);
-                    strcat(dbg_print_buf,dbg_temp_buf);
-                }
-            }
-            aprintf(0000,"DBG8: %s\n",dbg_print_buf);
-            for (i=0; i < 10010; i++)
-                dbg_wq_by_type[i] = dbg_wq_targ_by_type[i] = 0;
-            /**/
-            dbg_print_buf[0] = '\0';
-            for (i=0; i < 10010; i++)
-            {
-                if (dbg_rfr_attempts_by_type[i] > 0)
-                {
-                    sprintf(dbg_temp_buf,"%d:%d ",i,dbg_rfr_attempts_by_type[i]);
-                    strcat(dbg_print_buf,dbg_temp_buf);
-                }
-            }
-            aprintf(0000,"DBG9: %s\n",dbg_print_buf);
-            for (i=0; i < 10010; i++)
-                dbg_rfr_attempts_by_type[i] = 0;
-            /**/
-
-            sprintf(dbg_print_buf,"%d; ",iprobe_successful_cnt);
-            for (i=0; i < 50; i++)
-            {
-                if (dbg_tags_handled[i] > 0)
-                {
-                    sprintf(dbg_temp_buf,"%d:%d ",i+1000,dbg_tags_handled[i]);
-                    strcat(dbg_print_buf,dbg_temp_buf);
-                }
-            }
-            aprintf(0000,"DBG5: %s\n",dbg_print_buf);
-            iprobe_successful_cnt = 0;
-            for (i=0; i < 50; i++)
-                dbg_tags_handled[i] = 0;
-
-#           ifdef DEBUGGING_BGX
-            GetUnexpectedRequestTagsInDBGTagsBuf(dbg_unexpected_by_tag);
-            sprintf(dbg_print_buf,"%d; ",dbg_max_msg_queue_cnt);
-            for (i=0; i < 50; i++)
-            {
-                if (dbg_unexpected_by_tag[i] > 0)
-                {
-                    sprintf(dbg_temp_buf,"%d:%d ",i+1000,dbg_unexpected_by_tag[i]);
-                    strcat(dbg_print_buf,dbg_temp_buf);
-                }
-            }
-            aprintf(0000,"DBG6: %s\n",dbg_print_buf);
-            dbg_max_msg_queue_cnt = 0;
-            for (i=0; i < 50; i++)
-                dbg_unexpected_by_tag[i] = 0;
-#           endif
-#           ifdef DEBUGGING_SICORTEX
-            aprintf(1,"DBG6: early queue len %d\n",MPIDI_Debug_early_queue_length());
-#           endif
-        }  /* use_dbg_prints etc. */
-
-        if (doing_periodic_stats  &&
-            my_world_rank == master_server_rank  && 
-            (MPI_Wtime() - prev_periodic_msg_time) > periodic_timeout)
-        {
-            temp_buf = amalloc(periodic_buf_num_ints * sizeof(int));
-            temp_req = amalloc(sizeof(MPI_Request));
-            /* put in wq_2darray stuff */
-            for (i=0; i < num_types; i++)
-            {
-                for (j=0; j < (num_app_ranks+1); j++)
-                {
-                    k = (i * (num_app_ranks+1)) + j;
-                    temp_buf[k] = periodic_wq_2darray[i][j];
-                }
-            }
-            /* put in rq_vector stuff */
-            skip = (num_app_ranks + 1) * num_types;  /* skip wq_2d */
-            for (i=0; i < (num_types+2); i++)
-            {
-                k = i + skip;
-                temp_buf[k] = periodic_rq_vector[i];
-            }
-            /* put in put_cnt stuff */
-            skip += num_types + 2;
-            for (i=0; i < num_types; i++)
-            {
-                k = i + skip;
-                temp_buf[k] = periodic_put_cnt[i];
-            }
-            /* put in resolved_reserve stuff */
-            skip += num_types;
-            for (i=0; i < num_types; i++)
-            {
-                k = i + skip;
-                temp_buf[k] = periodic_resolved_reserve_cnt[i];
-            }
-            MPI_Isend(temp_buf,periodic_buf_num_ints,MPI_INT,rhs_rank,
-                      SS_PERIODIC_STATS,adlb_all_comm,temp_req);
-            iq_node = iq_node_create(temp_req,periodic_buf_num_ints*sizeof(int),temp_buf);
-            iq_append(iq_node);
-            prev_periodic_msg_time = MPI_Wtime();
-        }
-        if (my_world_rank == master_server_rank  &&
-            (MPI_Wtime()-prev_exhaust_chk_time) > exhaust_chk_interval)
-        {
-            if (rq->count >= num_apps_this_server)
-            {
-                if (num_servers == 1)
-                {
-                    // send exhausted to apps on rq
-                    while ((rq_node=xq_first(rq)))
-                    {
-                        rs = rq_node->data;
-                        aprintf(0000,"SENDING NMW to rank %06d\n",rs->world_rank);
-                        info_buf[0] = ADLB_DONE_BY_EXHAUSTION;
-                        MPI_Ssend(info_buf,IBUF_NUMINTS,MPI_INT,rs->world_rank,
-                                  TA_RESERVE_RESP,adlb_all_comm);
-                        /* since exhaustion, do NOT alter times for total_time_on_rq */
-                        rq_delete(rq_node);
-                        /* done, so not dealing with periodic stats right now */
-                    }
-                }
-                else
-                {
-                    exhausted_flag = 1;
-                    temp_req = amalloc(sizeof(MPI_Request));
-                    MPI_Isend(info_buf,0,MPI_INT,rhs_rank,SS_EXHAUST_CHK_LOOP_1,
-                              adlb_all_comm,temp_req);
-                    iq_node = iq_node_create(temp_req, 0, NULL);
-                    iq_append(iq_node);
-                }
-            }
-            prev_exhaust_chk_time = MPI_Wtime();
-        }
-        if (iq->count > 0)    /* if outstanding isends */
-        {
-            // if (qmstat_isend_node_ptr)  // check first; may check again below
-            // {
-                // is = qmstat_isend_node_ptr->data;
-                // rc = MPI_Test(is->mpi_req,&flag,&status);
-            // }
-            for (iq_curr_node=xq_first(iq); iq_curr_node; iq_curr_node=iq_next_node)
-            {
-                iq_next_node = xq_next(iq,iq_curr_node);
-                is = iq_curr_node->data;
-                rc = MPI_Test(is->mpi_req,&flag,&status);
-                if (flag)
-                {
-                    // if (iq_curr_node == qmstat_isend_node_ptr)
-                        // qmstat_isend_node_ptr = NULL;
-                    iq_delete(iq_curr_node);  /* also deletes non-NULL buf */
-                }
-            }
-        }
-        if  (num_servers > 1  &&
-             my_world_rank == master_server_rank  &&
-             (MPI_Wtime() - prev_qmstat_msg_time) > qmstat_interval)
-        {
-            if ( ! qmstat_msg_is_out )
-            {
-                qmstat_send_buf = amalloc(qmstat_buflen);
-                pack_qmstat();  /* all info from qmstat_tbl into qmstat_send_buf */
-                temp_req = amalloc(sizeof(MPI_Request));
-                rc = MPI_Isend(qmstat_send_buf,qmstat_buflen,MPI_PACKED,server_comm_rhs,SS_QMSTAT,
-                               adlb_server_comm,temp_req);
-                iq_node = iq_node_create(temp_req,qmstat_buflen,qmstat_send_buf);
-                iq_append(iq_node);
-                qmstat_msg_is_out = 1;
-                prev_qmstat_msg_time = MPI_Wtime();
-            }
-        }
-        if  (use_dbg_prints                       &&
-             num_servers > 1                      &&
-             my_world_rank == master_server_rank  &&
-             (MPI_Wtime() - prev_dbg_msg_start) > dbg_time_interval)
-        {
-            if ( ! dbg_msg_is_out )
-            {
-                dbls_temp_buf = amalloc(IBUF_NUMDBLS * sizeof(double));
-                dbls_temp_buf[0] = MPI_Wtime();  /* loop start time */
-                dbls_temp_buf[1] = MPI_Wtime();  /* hop  start time */
-                temp_req = amalloc(sizeof(MPI_Request));
-                rc = MPI_Isend(dbls_temp_buf,IBUF_NUMDBLS,MPI_DOUBLE,rhs_rank,SS_DBG_TIMING_MSG,
-                               adlb_all_comm,temp_req);
-                iq_node = iq_node_create(temp_req, IBUF_NUMDBLS*sizeof(double), dbls_temp_buf);
-                iq_append(iq_node);
-                dbg_msg_is_out = 1;
-                prev_dbg_msg_start = MPI_Wtime();
-            }
-        }
-        if  (using_debug_server  &&
-             num_events_since_logatds > 0  &&
-             (MPI_Wtime() - prev_logatds_time) > logatds_interval)
-        {
-            log_at_debug_server();
-            num_events_since_logatds = 0;
-            num_reserves_since_logatds = 0;
-            num_reserves_immed_sat_since_logatds = 0;
-            num_reserves_not_in_stat_vec = 0;
-            num_rfr_failed_since_logatds = 0;
-            num_ss_msgs_handled_since_logatds = 0;
-            prev_logatds_time = MPI_Wtime();
-        }
+        if (now >= server_timers_next_due)
+            server_timers_run_due(now);
+        if (iq_count() > 0)    /* if outstanding isends */
+            iq_test_completed();  /* also frees their bufs */
+        if (put_recvs_test() > 0)    /* Iput payloads that have landed */
+            idle_passes = 0;
 
         if (start_looptop_time == 0.0)
-            start_looptop_time = MPI_Wtime();
+            start_looptop_time = now;
         if (qmstat_req == MPI_REQUEST_NULL)
         {
             MPI_Irecv(qmstat_recv_buf,qmstat_buflen,MPI_PACKED,MPI_ANY_SOURCE,
                       SS_QMSTAT,adlb_server_comm,&qmstat_req);
         }
-        /* do PMPI_xxxx calls to avoid frequent logging */
-        rc = PMPI_Test(&qmstat_req,&msg_available,&status);
-        if ( ! msg_available )
-            rc = PMPI_Iprobe(MPI_ANY_SOURCE,MPI_ANY_TAG,adlb_all_comm,&msg_available,&status);
-        if ( ! msg_available )
+        nbatch = server_gather_batch(&qmstat_req);
+        if (nbatch == 0)
+        {
+            if (progress_mode == ADLB_PROGRESS_BACKOFF  &&  ++idle_passes > progress_spin_passes)
+            {
+                /* sleep, but never past the next housekeeping task */
+                next_deadline = now + idle_sleep;
+                if (server_timers_next_due < next_deadline)
+                    next_deadline = server_timers_next_due;
+                server_idle_sleep(next_deadline - now);
+                idle_sleep *= 2.0;
+                if (idle_sleep > progress_max_sleep)
+                    idle_sleep = progress_max_sleep;
+            }
             continue;
+        }
+        idle_passes = 0;
+        idle_sleep = 0.000001;
 
 #ifdef DEBUGGING_BGX
         if (GetUnexpectedRequestCount() > dbg_max_msg_queue_cnt)
@@ -879,1630 +802,2652 @@ int ADLBP_Server(double hi_malloc, double periodic_log_interval)
         dbg_max_msg_queue_cnt = 0;
 #endif
 #endif
-        if (use_dbg_prints)
-            dbg_tags_handled[status.MPI_TAG-1000]++;
-
-        iprobe_successful_cnt++;
-        total_looptop_time += MPI_Wtime() - start_looptop_time;
+        handler_start_time = MPI_Wtime();
+        total_looptop_time += handler_start_time - start_looptop_time;
         start_looptop_time = 0.0;
 
-        from_rank = status.MPI_SOURCE;
-        from_tag = status.MPI_TAG;
-        if (from_tag == FA_PUT_HDR)
+        for (b=0; b < nbatch  &&  ! server_done; b++)
         {
-            MPI_Recv(info_buf,IBUF_NUMINTS,MPI_INT,from_rank,FA_PUT_HDR,adlb_all_comm,&status);
-            if (using_debug_server)
-                num_events_since_logatds++;
-            if (no_more_work_flag)
-            {
-                ack_buf[0] = ADLB_NO_MORE_WORK;
-                MPI_Rsend(ack_buf,IBUF_NUMINTS,MPI_INT,from_rank,TA_ACK_AND_RC,adlb_all_comm);
-                // aprintf(0000, "IN FA_PUT SENT NO_MORE_WORK TO %d\n",from_rank);
-                continue;
-            }
-            work_type    = info_buf[0];
-            work_prio    = info_buf[1];
-            answer_rank  = info_buf[2];
-            target_rank  = info_buf[3];
-            work_len     = info_buf[4];
-            if ((curr_bytes_dmalloced+work_len) > max_malloc)
-            {
-                num_rejected_puts += 1;
-                ack_buf[0] = ADLB_PUT_REJECTED;
-                cand_rank = -1;
-                smallest_dbl = 999999999999.9;
-                for (i=0; i < num_servers; i++)
-                {
-                    server_rank = get_server_rank(i);
-                    if (server_rank != my_world_rank
-                    &&  qmstat_tbl[i].nbytes_used < THRESHOLD_TO_START_PUSH
-                    &&  qmstat_tbl[i].nbytes_used < smallest_dbl)
-                    {
-                        smallest_dbl = qmstat_tbl[i].nbytes_used;
-                        cand_rank = server_rank;
-                    }
-                }
-                if (cand_rank >= 0)
-                    ack_buf[1] = cand_rank;
-                else
-                    ack_buf[1] = -1;
-                ack_buf[2] = 1;  // threshold violation
-                MPI_Rsend(ack_buf,IBUF_NUMINTS,MPI_INT,from_rank,TA_ACK_AND_RC,adlb_all_comm);
-                continue;
-            }
-            work_buf = pmalloc(work_len,__FUNCTION__,__LINE__);  // dmalloc just for puts
-            if (work_buf == NULL)
-            {
-                num_rejected_puts += 1;
-                ack_buf[0] = ADLB_PUT_REJECTED;
-                cand_rank = -1;
-                smallest_dbl = 999999999999.9;
-                for (i=0; i < num_servers; i++)
-                {
-                    server_rank = get_server_rank(i);
-                    if (server_rank != my_world_rank
-                    &&  qmstat_tbl[i].nbytes_used < THRESHOLD_TO_START_PUSH
-                    &&  qmstat_tbl[i].nbytes_used < smallest_dbl)
-                    {
-                        smallest_dbl = qmstat_tbl[i].nbytes_used;
-                        cand_rank = server_rank;
-                    }
-                }
-                if (cand_rank >= 0)
-                    ack_buf[1] = cand_rank;
-                else
-                    ack_buf[1] = -1;
-                ack_buf[2] = 2;  // probable fragmentation
-                MPI_Rsend(ack_buf,IBUF_NUMINTS,MPI_INT,from_rank,TA_ACK_AND_RC,adlb_all_comm);
-                continue;
-            }
-            MPI_Irecv(work_buf,work_len,MPI_BYTE,from_rank,FA_PUT_MSG,adlb_all_comm,&request);
-            ack_buf[0] = SUCCESS;
-            MPI_Rsend(ack_buf,IBUF_NUMINTS,MPI_INT,from_rank,TA_ACK_AND_RC,adlb_all_comm);
-            rc = MPI_Wait(&request,&status);
-            wq_node = wq_node_create(work_type,work_prio,next_wqseqno++,
-                                     answer_rank,target_rank,work_len,work_buf);
-            ws = wq_node->data;
-            ws->home_server_rank        = info_buf[5];  /* esp for targeted work */
-            batch_flag                  = info_buf[6];  /* in batch but not nec with common */
-            ws->common_len              = info_buf[7];
-            ws->common_server_rank      = info_buf[8];
-            ws->common_server_commseqno = info_buf[9];
-            // PTW: if (ws->target_rank >= 0) ws->pinned = 1;
-            ws->time_stamp = MPI_Wtime();
-            wq_append(wq_node);
-            if (doing_periodic_stats)
-            {
-                type_idx = get_type_idx(ws->work_type);
-                if (type_idx < 0) aprintf(1,"** invalid type\n");
-                if (ws->target_rank >= 0)
-                {
-                    periodic_wq_2darray[type_idx][ws->target_rank]++;
-                }
-                else
-                {
-                    periodic_wq_2darray[type_idx][num_app_ranks]++;
-                }
-                periodic_put_cnt[type_idx]++;
-            }
-            rq_node = rq_find_rank_queued_for_type(target_rank,work_type); /* rank may be -1 */
-            if (rq_node)
-            {
-                rs = rq_node->data;
-                ws = wq_node->data;
-                ws->pin_rank = rs->world_rank;
-                if (ws->pin_rank >= 0)
-                    ws->pinned = 1;
-                info_buf[0] = SUCCESS;
-                info_buf[1] = ws->work_type;
-                info_buf[2] = ws->work_prio;
-                info_buf[3] = ws->work_len;
-                info_buf[4] = ws->answer_rank;
-                info_buf[5] = ws->wqseqno;
-                info_buf[6] = my_world_rank;
-                info_buf[7] = ws->common_len;
-                info_buf[8] = ws->common_server_rank;
-                info_buf[9] = ws->common_server_commseqno;
-                aprintf(0000, "IN PUT_HDR, GIVING RESERVATION to %06d\n",rs->world_rank);
-                MPI_Ssend(info_buf,IBUF_NUMINTS,MPI_INT,rs->world_rank,
-                          TA_RESERVE_RESP,adlb_all_comm);
-                if (use_dbg_prints  &&  (MPI_Wtime() - rs->time_stamp) > DBG_CHECK_TIME)
-                {
-                    aprintf(0000,"DBG3: put %d %f %f %d %d\n",
-                            rs->rqseqno,MPI_Wtime()-rs->time_stamp,
-                            MPI_Wtime()-ws->time_stamp,rs->world_rank,ws->work_type);
-                }
-                if (first_time_on_rq[rs->world_rank])
-                    first_time_on_rq[rs->world_rank] = 0;
-                else
-                {
-                    total_time_on_rq += (MPI_Wtime() - rs->time_stamp);
-                    num_rq_nodes_timed++;
-                }
-                if (doing_periodic_stats)
-                {
-                    for (i=0; i < num_types; i++)
-                    {
-                        if (i == 0  && rs->req_types[i] < 0)  /* if wild card */
-                            type_idx = num_types;
-                        else if (rs->req_types[i] >= 0)  /* user type */
-                            type_idx = get_type_idx(rs->req_types[i]);
-                        else    /* list terminator */
-                            break;
-                        if (type_idx < 0) aprintf(1,"** invalid type\n");
-                        periodic_rq_vector[type_idx]--;
-                    }
-                    periodic_rq_vector[num_types+1] = rq->count - 1; /* deleting */
-                    type_idx = get_type_idx(ws->work_type);
-                    if (type_idx < 0) aprintf(1,"** invalid type\n");
-                    periodic_resolved_reserve_cnt[type_idx]++;
-                }
-                rq_delete(rq_node);
-                exhausted_flag = 0;
-            }
-            else
-            {
-                update_local_state();
-            }
-            nputmsgs++;
-            ack_buf[0] = SUCCESS;
-            MPI_Send(ack_buf,IBUF_NUMINTS,MPI_INT,from_rank,TA_ACK_AND_RC,adlb_all_comm);
-            // cblog(1,from_rank,"PAST PUT type %d targrank %d\n",work_type,target_rank);
-            prev_exhaust_chk_time = MPI_Wtime();  /* not exhausted yet */
-            aprintf(0000, "PAST FA_PUT for type %d\n",work_type);
-        }
-        else if (from_tag == FA_PUT_COMMON_HDR)
-        {
-            aprintf(0000, "AT FA_PUT_COMMON from %d\n",from_rank);
-            MPI_Recv(info_buf,IBUF_NUMINTS,MPI_INT,from_rank,from_tag,adlb_all_comm,&status);
-            if (using_debug_server)
-                num_events_since_logatds++;
-            if (no_more_work_flag)
-            {
-                ack_buf[0] = ADLB_NO_MORE_WORK;
-                MPI_Ssend(ack_buf,IBUF_NUMINTS,MPI_INT,from_rank,TA_ACK_AND_RC,adlb_all_comm);
-                // aprintf(0000, "SENT NO_MORE_WORK TO %06d\n",from_rank);
-                continue;
-            }
-            common_len = info_buf[0];
-            if ((curr_bytes_dmalloced+common_len) > max_malloc)
-            {
-                // aprintf(0000, "IN FA_PUT_COMMON REJECTING FROM RANK %06d\n",from_rank);
-                // cblog(1,from_rank,"REJECTED PUT_COMMON type %d\n",info_buf[0]);
-                num_rejected_puts += 1;
-                ack_buf[0] = ADLB_PUT_REJECTED;
-                cand_rank = -1;
-                smallest_dbl = 999999999999.9;
-                for (i=0; i < num_servers; i++)
-                {
-                    server_rank = get_server_rank(i);
-                    if (server_rank != my_world_rank
-                    &&  qmstat_tbl[i].nbytes_used < THRESHOLD_TO_START_PUSH
-                    &&  qmstat_tbl[i].nbytes_used < smallest_dbl)
-                    {
-                        smallest_dbl = qmstat_tbl[i].nbytes_used;
-                        cand_rank = server_rank;
-                    }
-                }
-                if (cand_rank >= 0)
-                    ack_buf[1] = cand_rank;
-                else
-                    ack_buf[1] = -1;
-                ack_buf[2] = 1;  // threshold violation
-                MPI_Rsend(ack_buf,IBUF_NUMINTS,MPI_INT,from_rank,TA_ACK_AND_RC,adlb_all_comm);
-                continue;
-            }
-            common_len = info_buf[0];
-            work_buf = pmalloc(work_len,__FUNCTION__,__LINE__);  // dmalloc just for puts
-            if (work_buf == NULL)
-            {
-                num_rejected_puts += 1;
-                ack_buf[0] = ADLB_PUT_REJECTED;
-                cand_rank = -1;
-                smallest_dbl = 999999999999.9;
-                for (i=0; i < num_servers; i++)
-                {
-                    server_rank = get_server_rank(i);
-                    if (server_rank != my_world_rank
-                    &&  qmstat_tbl[i].nbytes_used < THRESHOLD_TO_START_PUSH
-                    &&  qmstat_tbl[i].nbytes_used < smallest_dbl)
-                    {
-                        smallest_dbl = qmstat_tbl[i].nbytes_used;
-                        cand_rank = server_rank;
-                    }
-                }
-                if (cand_rank >= 0)
-                    ack_buf[1] = cand_rank;
-                else
-                    ack_buf[1] = -1;
-                ack_buf[2] = 2;  // probable fragmentation
-                MPI_Rsend(ack_buf,IBUF_NUMINTS,MPI_INT,from_rank,TA_ACK_AND_RC,adlb_all_comm);
-                continue;
-            }
-            inside_batch_put[from_rank] = 1;
-            ack_buf[0] = SUCCESS;
-            MPI_Ssend(ack_buf,IBUF_NUMINTS,MPI_INT,from_rank,TA_ACK_AND_RC,adlb_all_comm);
-            MPI_Recv(work_buf,common_len,MPI_BYTE,from_rank,
-                     FA_PUT_COMMON_MSG,adlb_all_comm,&status);
-            cq_node = cq_node_create(common_len,work_buf,next_cqseqno);
-            cq_append(cq_node);
-            next_cqseqno++;
-            ack_buf[0] = SUCCESS;
-            ack_buf[1] = next_cqseqno - 1;
-            MPI_Ssend(ack_buf,IBUF_NUMINTS,MPI_INT,from_rank,TA_ACK_AND_RC,adlb_all_comm);
-            aprintf(0000, "PAST FA_PUT_COMMON\n");
-        }
-        else if (from_tag == FA_PUT_BATCH_DONE)
-        {
-            aprintf(0000, "AT FA_PUT_BATCH_DONE\n");
-            MPI_Recv(info_buf,IBUF_NUMINTS,MPI_INT,from_rank,from_tag,adlb_all_comm,&status);
-            inside_batch_put[from_rank] = 0;
-            if (info_buf[0] > 0)  /* common_cqseqno */
+            status = server_batch[b].status;
+#if MPI_VERSION >= 3
+            server_msg = server_batch[b].msg;
+#endif
+            server_msg_slot = server_batch[b].slot;
+            if (use_dbg_prints)
+                dbg_tags_handled[status.MPI_TAG-1000]++;
+            iprobe_successful_cnt++;
+
+            from_rank = status.MPI_SOURCE;
+            from_tag = status.MPI_TAG;
+            tag_idx = from_tag - SERVER_TAG_BASE;
+            if (tag_idx < 0  ||  tag_idx >= NUM_SERVER_TAGS  ||  ! server_handlers[tag_idx])
             {
-                cq_node = cq_find_seqno(info_buf[0]);
-                cs = cq_node->data;
-                cs->refcnt = info_buf[1];
-                if (cs->refcnt == cs->ngets)
-                    cq_delete(cq_node);
+                aprintf(1,"** adlb_server: unexpected tag %d recvd from %d\n",
+                        from_tag,from_rank);
+                exit(-1);
             }
-            if (using_debug_server)
-                num_events_since_logatds++;
-            if (no_more_work_flag)
+            (*server_handlers[tag_idx])(from_rank,from_tag,&status);
+            handler_end_time = MPI_Wtime();
+            server_handler_time[tag_idx] += handler_end_time - handler_start_time;
+            server_handler_cnt[tag_idx]++;
+            handler_start_time = handler_end_time;
+            if (server_msg_slot >= 0
+#if MPI_VERSION >= 3
+            ||  server_msg != MPI_MESSAGE_NULL
+#endif
+               )
             {
-                ack_buf[0] = ADLB_NO_MORE_WORK;
-                MPI_Ssend(ack_buf,IBUF_NUMINTS,MPI_INT,from_rank,TA_ACK_AND_RC,adlb_all_comm);
-                aprintf(0000, "SENT NO_MORE_WORK TO %06d\n",from_rank);
-                continue;
+                aprintf(1,"** adlb_server: handler for tag %d did not receive its msg\n",
+                        from_tag);
+                adlb_server_abort(-1,1);
             }
-            ack_buf[0] = SUCCESS;
-            MPI_Ssend(ack_buf,IBUF_NUMINTS,MPI_INT,from_rank,TA_ACK_AND_RC,adlb_all_comm);
-            aprintf(0000, "PAST FA_PUT_BATCH_DONE\n");
         }
-        else if (from_tag == FA_DID_PUT_AT_REMOTE)
+        if (b < nbatch)    /* a handler ended the loop; the rest are already matched */
+            server_discard_batch(b,nbatch);
+    }
+    preposted_free();
+    while (iq_count() > 0)    /* let the last notifications to apps complete */
+        iq_test_completed();
+    aprintf(1,"SERVER OUT OF LOOP\n");
+    return ADLB_SUCCESS;
+}
+
+/* one handler per msg tag the server loop receives; see register_server_handlers */
+
+/* Checks a put hdr and allocates room for its payload.  On failure NULL is
+   returned and ack_buf holds the rc (and reject details) for the app. */
+static void *put_check_hdr(int *info_buf, int *ack_buf)
+{
+    int i, work_len, server_rank, cand_rank;
+    double smallest_dbl;
+    void *work_buf;
+
+    if (no_more_work_flag)
+    {
+        ack_buf[0] = ADLB_NO_MORE_WORK;
+        return NULL;
+    }
+    work_len     = info_buf[4];
+    if ((bytes_in_use()+pmalloc_footprint(work_len)) > THRESHOLD_TO_REJECT_PUT)
+    {
+        num_rejected_puts += 1;
+        ack_buf[0] = ADLB_PUT_REJECTED;
+        cand_rank = -1;
+        smallest_dbl = 999999999999.9;
+        for (i=0; i < num_servers; i++)
         {
-            MPI_Recv(info_buf,IBUF_NUMINTS,MPI_INT,from_rank,from_tag,adlb_all_comm,&status);
-            work_type   = info_buf[0];
-            target_rank = info_buf[1];
-            server_rank = info_buf[2];
-            tq_node = tq_find_rtr(target_rank,work_type,server_rank);
-            if (tq_node)
-            {
-                ts = tq_node->data;
-                ts->num_stored++;
-            }
-            else
+            server_rank = get_server_rank(i);
+            if (server_rank != my_world_rank
+            &&  qmstat_tbl[i].nbytes_used < THRESHOLD_TO_START_PUSH
+            &&  qmstat_tbl[i].nbytes_used < smallest_dbl)
             {
-                tq_node = tq_node_create(target_rank,work_type,server_rank,1);
-                tq_append(tq_node);
-                ts = tq_node->data;
+                smallest_dbl = qmstat_tbl[i].nbytes_used;
+                cand_rank = server_rank;
             }
-            check_remote_work_for_queued_apps();  /* make sure no one is waiting for this */
         }
-        else if (from_tag == FA_RESERVE)
+        if (cand_rank >= 0)
+            ack_buf[1] = cand_rank;
+        else
+            ack_buf[1] = -1;
+        ack_buf[2] = 1;  // threshold violation
+        return NULL;
+    }
+    work_buf = pmalloc(work_len,__FUNCTION__,__LINE__);  // dmalloc just for puts
+    if (work_buf == NULL)
+    {
+        num_rejected_puts += 1;
+        ack_buf[0] = ADLB_PUT_REJECTED;
+        cand_rank = -1;
+        smallest_dbl = 999999999999.9;
+        for (i=0; i < num_servers; i++)
         {
-            aprintf(0000, "AT FA_RESERVE\n");
-            MPI_Recv(reserve_buf,REQ_TYPE_VECT_SZ+1,MPI_INT,from_rank,FA_RESERVE,
-                     adlb_all_comm,&status);
-            num_reserves++;
-            if (using_debug_server)
-            {
-                num_events_since_logatds++;
-                num_reserves_since_logatds++;
-            }
-            if (no_more_work_flag)
-            {
-                info_buf[0] = ADLB_NO_MORE_WORK;
-                MPI_Send(info_buf,IBUF_NUMINTS,MPI_INT,from_rank,TA_RESERVE_RESP,adlb_all_comm);
-                aprintf(0000, "IN FA_RESERVE SENTa NO_MORE_WORK TO %06d\n",from_rank);
-                continue;
-            }
-            hang_flag = reserve_buf[0];
-            for (i=0; i < REQ_TYPE_VECT_SZ; i++)
-                req_types[i] = reserve_buf[i+1];
-            // cblog(1,from_rank,"AT RESERVE types %d %d %d %d\n",
-                       // req_types[0],req_types[1],req_types[2],req_types[3]);
-            wq_node = wq_find_pre_targeted_hi_prio(from_rank,req_types);
-            if ( ! wq_node)
-                wq_node = wq_find_hi_prio(req_types);
-            if (wq_node)
+            server_rank = get_server_rank(i);
+            if (server_rank != my_world_rank
+            &&  qmstat_tbl[i].nbytes_used < THRESHOLD_TO_START_PUSH
+            &&  qmstat_tbl[i].nbytes_used < smallest_dbl)
             {
-                ws = wq_node->data;
-                ws->pin_rank = from_rank;
-                if (ws->pin_rank >= 0)
-                    ws->pinned = 1;
-                info_buf[0] = SUCCESS;
-                info_buf[1] = ws->work_type;
-                info_buf[2] = ws->work_prio;
-                info_buf[3] = ws->work_len;
-                info_buf[4] = ws->answer_rank;
-                info_buf[5] = ws->wqseqno;
-                info_buf[6] = my_world_rank;
-                info_buf[7] = ws->common_len;
-                info_buf[8] = ws->common_server_rank;
-                info_buf[9] = ws->common_server_commseqno;
-                aprintf(0000, "IN FA_RESERVE SENDING RESERVATION to %06d\n",from_rank);
-                MPI_Send(info_buf,IBUF_NUMINTS,MPI_INT,from_rank,TA_RESERVE_RESP,adlb_all_comm);
-                if (use_dbg_prints)
-                    aprintf(0000,"DBG3: rsv -1 0.0 %f %d %d\n",
-                            MPI_Wtime()-ws->time_stamp,from_rank,ws->work_type);
-                if (using_debug_server)
-                    num_reserves_immed_sat_since_logatds++;
-                /* do not delete here because merely targeted; not given away */
-                if (doing_periodic_stats)
-                {
-                    type_idx = get_type_idx(ws->work_type);
-                    if (type_idx < 0) aprintf(1,"** invalid type\n");
-                    periodic_resolved_reserve_cnt[type_idx]++;
-                }
+                smallest_dbl = qmstat_tbl[i].nbytes_used;
+                cand_rank = server_rank;
             }
-            else
-            {
-                if (hang_flag)
-                {
-                    aprintf(0000,"QUEUEING rank %06d\n",from_rank);
-                    // cblog(1,from_rank,"  QUEUED by %d\n",my_world_rank);
-                    rqseqno = next_rqseqno++;
-                    rq_node = rq_node_create(from_rank,req_types,rqseqno);
-                    rs = rq_node->data;
-                    rs->time_stamp = MPI_Wtime();
-                    /** this small block is solely for computing counters for debug_server **/
-                    cand_rank = -1;  /* default: did not find server that may have this type */
-                    for (i=0; i < REQ_TYPE_VECT_SZ; i++)
-                    {
-                        if (req_types[i] < -1)  /* invalid type as place-holder */
-                            break;
-                        cand_rank = find_cand_rank_with_worktype(rs->world_rank,req_types[i]);
-                        if (cand_rank >= 0)
-                            break;
-                    }
-                    if (cand_rank < 0)
-                        num_reserves_not_in_stat_vec++;
-                    /** end debug block **/
-                    if (doing_periodic_stats)
-                    {
-                        for (i=0; i < num_types; i++)
-                        {
-                            if (i == 0  && rs->req_types[i] < 0)  /* if wild card */
-                                type_idx = num_types;
-                            else if (rs->req_types[i] >= 0)  /* user type */
-                                type_idx = get_type_idx(rs->req_types[i]);
-                            else    /* list terminator */
-                                break;
-                            if (type_idx < 0) aprintf(1,"** invalid type\n");
-                            periodic_rq_vector[type_idx]++;
-                        }
-                        periodic_rq_vector[num_types+1] = rq->count + 1;  /* appending */
-                    }
-                    rq_append(rq_node);
-                    num_reserves_put_on_rq++;
-                    if (rfr_to_rank[rs->world_rank] < 0)
-                    {
-                        for (i=0; i < REQ_TYPE_VECT_SZ; i++)
-                        {
-                            /* no need to check rfr_rank for this new req from user */
-                            if (req_types[i] < -1)  /* invalid type as place-holder */
-                                break;
-                            cand_rank = find_cand_rank_with_worktype(rs->world_rank,req_types[i]);
-                            if (cand_rank >= 0)
-                            {
-                                aprintf(0000,"REQING rqseqno %d fromrank %d\n",rqseqno,cand_rank);
-                                // cblog(1,from_rank,"  REQING from %d ty %d\n",cand_rank,req_types[i]);
-                                temp_buf    = amalloc(RFRBUF_NUMINTS * sizeof(int));
-                                temp_buf[0] = rqseqno;
-                                temp_buf[1] = from_rank;
-                                for (j=0; j < REQ_TYPE_VECT_SZ; j++)
-                                    temp_buf[2+j] = rs->req_types[j];
-                                temp_req    = amalloc(sizeof(MPI_Request));
-                                rc = MPI_Isend(temp_buf,RFRBUF_NUMINTS,MPI_INT,cand_rank,SS_RFR,
-                                               adlb_all_comm,temp_req);
-                                iq_node = iq_node_create(temp_req,(RFRBUF_NUMINTS * sizeof(int)),
-                                                         temp_buf);
-                                iq_append(iq_node);
-                                rfr_to_rank[rs->world_rank] = cand_rank;
-                                rfr_out[cand_rank] = 1;
-                                nrfrs_sent++;
-                                if (use_dbg_prints)
-                                    dbg_rfr_sent_cnt[rs->world_rank]++;
-                                break;
-                            }
-                        }
-                    }
-                }
-                else
-                {
-                    aprintf(0000,"SEND NOCURRWORK TO rank %06d\n",from_rank);
-                    info_buf[0] = NO_CURR_WORK;
-                    MPI_Send(info_buf,IBUF_NUMINTS,MPI_INT,from_rank,TA_RESERVE_RESP,adlb_all_comm);
-                }
-            }
-            // cblog(1,from_rank,"PAST RESERVE\n");
-            aprintf(0000, "PAST FA_RESERVE\n");
-        }
-        else if (from_tag == FA_GET_COMMON)
-        {
-            aprintf(0000, "AT FA_GET_COMMON\n");
-            // cblog(1,from_rank,"AT GET_COMMON\n");
-            MPI_Recv(info_buf,IBUF_NUMINTS,MPI_INT,from_rank,from_tag,adlb_all_comm,&status);
-            cq_node = cq_find_seqno(info_buf[0]);
-            cs = cq_node->data;
-            MPI_Ssend(cs->buf,cs->commlen,MPI_BYTE,from_rank,TA_GET_COMMON_RESP,adlb_all_comm);
-            cs->ngets++;
-            if (cs->refcnt == cs->ngets)
-                cq_delete(cq_node);
-        }
-        else if (from_tag == FA_GET_RESERVED)
-        {
-            aprintf(0000, "AT FA_GET_RESERVED\n");
-            // cblog(1,from_rank,"AT GET_RESERVED\n");
-            MPI_Recv(info_buf,IBUF_NUMINTS,MPI_INT,from_rank,from_tag,adlb_all_comm,&status);
-            if (using_debug_server)
-                num_events_since_logatds++;
-            if (no_more_work_flag)
-            {
-                dbls_info_buf[0] = (double)ADLB_NO_MORE_WORK;
-                MPI_Rsend(dbls_info_buf,IBUF_NUMDBLS,MPI_DOUBLE,from_rank,TA_ACK_AND_RC,adlb_all_comm);
-                aprintf(0000, "IN FA_GET_RESERVED SENTc NO_MORE_WORK TO %06d\n",from_rank);
-                continue;
-            }
-            wqseqno = info_buf[0];
-            wq_node = wq_find_pinned_for_rank(from_rank,wqseqno);
-            if ( ! wq_node)
-            {
-                dbls_info_buf[0] = (double)ERROR;
-                MPI_Rsend(dbls_info_buf,IBUF_NUMDBLS,MPI_DOUBLE,from_rank,
-                          TA_ACK_AND_RC,adlb_all_comm);
-                aprintf(1,"** FAILED GET_RESERVED for rank %06d  wqseqno %d\n",
-                        from_rank,info_buf[0]);
-                adlb_server_abort(-1,1);
-                continue;
-            }
-            ws = wq_node->data;
-            dbls_info_buf[0] = (double) SUCCESS;
-            dbls_info_buf[1] = (double) ws->work_len;
-            dbls_info_buf[2] = (double) (MPI_Wtime() - ws->time_stamp);
-            MPI_Rsend(dbls_info_buf,IBUF_NUMDBLS,MPI_DOUBLE,from_rank,
-                      TA_ACK_AND_RC,adlb_all_comm);
-            MPI_Ssend(ws->work_buf,ws->work_len,MPI_BYTE,from_rank,
-                      TA_GET_RESERVED_RESP,adlb_all_comm);
-            if (doing_periodic_stats)
-            {
-                type_idx = get_type_idx(ws->work_type);
-                if (type_idx < 0) aprintf(1,"** invalid type\n");
-                if (ws->target_rank >= 0)
-                {
-                    periodic_wq_2darray[type_idx][ws->target_rank]--;
-                }
-                else
-                {
-                    periodic_wq_2darray[type_idx][num_app_ranks]--;
-                }
-            }
-            wq_delete(wq_node);
-            update_local_state();
-            // cblog(1,from_rank,"PAST GET_RESERVED\n");
-            aprintf(0000, "PAST FA_GET_RESERVED\n");
         }
-        else if (from_tag == FA_NO_MORE_WORK)
+        if (cand_rank >= 0)
+            ack_buf[1] = cand_rank;
+        else
+            ack_buf[1] = -1;
+        ack_buf[2] = 2;  // probable fragmentation
+        return NULL;
+    }
+    return work_buf;
+}
+
+/* put_check_hdr for a single put; on failure the app has already been sent
+   its rc */
+static void *put_accept_hdr(int from_rank, int *info_buf, int reply_tag)
+{
+    int ack_buf[IBUF_NUMINTS];
+    void *work_buf;
+
+    work_buf = put_check_hdr(info_buf,ack_buf);
+    if (work_buf == NULL)
+    {
+        MPI_Rsend(ack_buf,IBUF_NUMINTS,MPI_INT,from_rank,reply_tag,adlb_all_comm);
+        // aprintf(0000, "IN FA_PUT SENT NO_MORE_WORK TO %d\n",from_rank);
+    }
+    return work_buf;
+}
+
+/* reserves an unpinned unit for an app waiting on the rq and tells it */
+static void give_to_queued_rank(xq_node_t *wq_node, xq_node_t *rq_node, char *dbg_tag)
+{
+    int i, info_buf[IBUF_NUMINTS], type_idx;
+    wq_struct_t *ws;
+    rq_struct_t *rs;
+
+    rs = rq_node->data;
+    ws = wq_node->data;
+    wq_pin(wq_node,rs->world_rank);
+    info_buf[0] = SUCCESS;
+    info_buf[1] = ws->work_type;
+    info_buf[2] = ws->work_prio;
+    info_buf[3] = ws->work_len;
+    info_buf[4] = ws->answer_rank;
+    info_buf[5] = ws->wqseqno;
+    info_buf[6] = my_world_rank;
+    info_buf[7] = ws->common_len;
+    info_buf[8] = ws->common_server_rank;
+    info_buf[9] = ws->common_server_commseqno;
+    aprintf(0000, "GIVING RESERVATION (%s) to %06d\n",dbg_tag,rs->world_rank);
+    isend_ints(info_buf,IBUF_NUMINTS,rs->world_rank,TA_RESERVE_RESP);
+    if (use_dbg_prints  &&  (MPI_Wtime() - rs->time_stamp) > DBG_CHECK_TIME)
+    {
+        aprintf(0000,"DBG3: %s %d %f %f %d %d\n",
+                dbg_tag,rs->rqseqno,MPI_Wtime()-rs->time_stamp,
+                MPI_Wtime()-ws->time_stamp,rs->world_rank,ws->work_type);
+    }
+    if (first_time_on_rq[rs->world_rank])
+        first_time_on_rq[rs->world_rank] = 0;
+    else
+    {
+        total_time_on_rq += (MPI_Wtime() - rs->time_stamp);
+        num_rq_nodes_timed++;
+    }
+    if (doing_periodic_stats)
+    {
+        for (i=0; i < rs->num_req_types; i++)
         {
-            aprintf(0000, "AT FA_NO_MORE_WORK from %06d\n",from_rank);
-            MPI_Recv(info_buf,0,MPI_INT,from_rank,from_tag,adlb_all_comm,&status);
-            if (using_debug_server)
-                num_events_since_logatds++;
-            no_more_work_flag = 1;
-            if (my_world_rank == master_server_rank)
-            {
-                if (num_servers > 1)
-                {
-                    temp_req = amalloc(sizeof(MPI_Request));
-                    rc = MPI_Issend(info_buf,0,MPI_INT,rhs_rank,
-                                    SS_NO_MORE_WORK,adlb_all_comm,temp_req);
-                    iq_node = iq_node_create(temp_req,0,NULL);
-                    iq_append(iq_node);
-                }
-            }
-            else
-            {
-                /* just send it on to master server */
-                temp_req = amalloc(sizeof(MPI_Request));
-                rc = MPI_Issend(info_buf,0,MPI_INT,master_server_rank,
-                                SS_NO_MORE_WORK,adlb_all_comm,temp_req);
-                iq_node = iq_node_create(temp_req,0,NULL);
-                iq_append(iq_node);
-            }
-            while ((rq_node=xq_first(rq)))
-            {
-                rs = rq_node->data;
-                aprintf(0000,"SENDING NMW to rank %06d\n",rs->world_rank);
-                info_buf[0] = ADLB_NO_MORE_WORK;
-                MPI_Ssend(info_buf,IBUF_NUMINTS,MPI_INT,rs->world_rank,
-                          TA_RESERVE_RESP,adlb_all_comm);
-                aprintf(0000,"SENT NMW to rank %06d\n",rs->world_rank);
-                /* since no_more_work, do NOT alter times for total_time_on_rq */
-                if (doing_periodic_stats)
-                {
-                    for (i=0; i < num_types; i++)
-                    {
-                        if (i == 0  && rs->req_types[i] < 0)  /* if wild card */
-                            type_idx = num_types;
-                        else if (rs->req_types[i] >= 0)  /* user type */
-                            type_idx = get_type_idx(rs->req_types[i]);
-                        else    /* list terminator */
-                            break;
-                        if (type_idx < 0) aprintf(1,"** invalid type\n");
-                        periodic_rq_vector[type_idx]--;
-                    }
-                    periodic_rq_vector[num_types+1] = rq->count - 1; /* deleting */
-                    /** not nec when no_more_work
-                    type_idx = get_type_idx(rs->req_types[0]);
-                    periodic_resolved_reserve_cnt[type_idx]++;
-                    **/
-                }
-                rq_delete(rq_node);
-                exhausted_flag = 0;
-            }
-            aprintf(0000, "PAST FA_NO_MORE_WORK from %06d\n",from_rank);
+            if (i == 0  && rs->req_types[i] < 0)  /* if wild card */
+                type_idx = num_types;
+            else if (rs->req_types[i] >= 0)  /* user type */
+                type_idx = get_type_idx(rs->req_types[i]);
+            else    /* list terminator */
+                break;
+            if (type_idx < 0) aprintf(1,"** invalid type\n");
+            periodic_rq_vector[type_idx]--;
         }
-        else if (from_tag == SS_NO_MORE_WORK)
+        periodic_rq_vector[num_types+1] = rq->count - 1; /* deleting */
+        type_idx = get_type_idx(ws->work_type);
+        if (type_idx < 0) aprintf(1,"** invalid type\n");
+        periodic_resolved_reserve_cnt[type_idx]++;
+    }
+    rq_delete(rq_node);
+    exhausted_flag = 0;
+}
+
+/* When no other server has work for it, an app waiting on the rq may take a
+   unit that another app has only prefetched (soft pinned); that app finds it
+   gone when it asks for the data.  Returns 1 if the waiting app was given a
+   unit. */
+static int steal_prefetched_for_queued(xq_node_t *rq_node)
+{
+    xq_node_t *wq_node;
+    rq_struct_t *rs;
+
+    rs = rq_node->data;
+    req_mask_build(req_mask,rs->num_req_types,rs->req_types);
+    wq_node = wq_find_soft_pinned(rs->world_rank,req_mask);
+    if ( ! wq_node)
+        return 0;
+    aprintf(0000,"TAKING BACK prefetched wqseqno %d for %06d\n",
+            ((wq_struct_t *) wq_node->data)->wqseqno,rs->world_rank);
+    wq_unpin(wq_node,-1);
+    num_prefetched_stolen++;
+    give_to_queued_rank(wq_node,rq_node,"stl");
+    return 1;
+}
+
+/* Queues a put's work (or hands it to a rank waiting for it) and sends the
+   app its final ack, unless reply_tag is < 0. */
+static void put_enqueue_work(int from_rank, int *info_buf, void *work_buf, int reply_tag)
+{
+    int ack_buf[IBUF_NUMINTS], work_type, answer_rank, work_prio, work_len,
+        type_idx, target_rank, batch_flag;
+    xq_node_t *wq_node, *rq_node;
+    wq_struct_t *ws;
+
+    work_type    = info_buf[0];
+    work_prio    = info_buf[1];
+    answer_rank  = info_buf[2];
+    target_rank  = info_buf[3];
+    work_len     = info_buf[4];
+    wq_node = wq_node_create(work_type,work_prio,next_wqseqno++,
+                             answer_rank,target_rank,work_len,work_buf);
+    ws = wq_node->data;
+    ws->home_server_rank        = info_buf[5];  /* esp for targeted work */
+    batch_flag                  = info_buf[6];  /* in batch but not nec with common */
+    ws->common_len              = info_buf[7];
+    ws->common_server_rank      = info_buf[8];
+    ws->common_server_commseqno = info_buf[9];
+    // PTW: if (ws->target_rank >= 0) ws->pinned = 1;
+    ws->time_stamp = MPI_Wtime();
+    wq_append(wq_node);
+    if (doing_periodic_stats)
+    {
+        type_idx = get_type_idx(ws->work_type);
+        if (type_idx < 0) aprintf(1,"** invalid type\n");
+        if (ws->target_rank >= 0)
         {
-            num_ss_msgs_handled_since_logatds++;
-            aprintf(0000, "AT SS_NO_MORE_WORK from %06d\n",from_rank);
-            MPI_Recv(info_buf,0,MPI_INT,from_rank,from_tag,adlb_all_comm,&status);
-            if (my_world_rank != master_server_rank  ||  
-                ! no_more_work_flag)  /* I am master, but this is first send by me */
-            {
-                temp_req = amalloc(sizeof(MPI_Request));
-                rc = MPI_Issend(info_buf,0,MPI_INT,rhs_rank,
-                                SS_NO_MORE_WORK,adlb_all_comm,temp_req);
-                iq_node = iq_node_create(temp_req,0,NULL);
-                iq_append(iq_node);
-            }
-            no_more_work_flag = 1;
-            while ((rq_node=xq_first(rq)))
-            {
-                rs = rq_node->data;
-                aprintf(0000,"SENDING NMW to rank %06d\n",rs->world_rank);
-                info_buf[0] = ADLB_NO_MORE_WORK;
-                MPI_Ssend(info_buf,IBUF_NUMINTS,MPI_INT,rs->world_rank,
-                          TA_RESERVE_RESP,adlb_all_comm);
-                aprintf(0000,"SENT NMW to rank %06d\n",rs->world_rank);
-                /* since no_more_work, do NOT alter times for total_time_on_rq */
-                if (doing_periodic_stats)
-                {
-                    for (i=0; i < num_types; i++)
-                    {
-                        if (i == 0  && rs->req_types[i] < 0)  /* if wild card */
-                            type_idx = num_types;
-                        else if (rs->req_types[i] >= 0)  /* user type */
-                            type_idx = get_type_idx(rs->req_types[i]);
-                        else    /* list terminator */
-                            break;
-                        if (type_idx < 0) aprintf(1,"** invalid type\n");
-                        periodic_rq_vector[type_idx]--;
-                    }
-                    periodic_rq_vector[num_types+1] = rq->count - 1; /* deleting */
-                    /** not nec when no_more_work
-                    type_idx = get_type_idx(rs->req_types[0]);
-                    periodic_resolved_reserve_cnt[type_idx]++;
-                    **/
-                }
-                rq_delete(rq_node);
-                exhausted_flag = 0;
-            }
-            aprintf(0000, "PAST SS_NO_MORE_WORK from %06d\n",from_rank);
+            periodic_wq_2darray[type_idx][ws->target_rank]++;
+        }
+        else
+        {
+            periodic_wq_2darray[type_idx][num_app_ranks]++;
+        }
+        periodic_put_cnt[type_idx]++;
+    }
+    rq_node = rq_find_rank_queued_for_type(target_rank,work_type); /* rank may be -1 */
+    if (rq_node)
+        give_to_queued_rank(wq_node,rq_node,"put");
+    else
+        update_local_state();
+    nputmsgs++;
+    if (reply_tag >= 0)
+    {
+        ack_buf[0] = SUCCESS;
+        isend_ints(ack_buf,IBUF_NUMINTS,from_rank,reply_tag);
+    }
+    // cblog(1,from_rank,"PAST PUT type %d targrank %d\n",work_type,target_rank);
+    server_timer_defer(ADLB_TIMER_EXHAUST_CHK,MPI_Wtime());  /* not exhausted yet */
+    aprintf(0000, "PAST FA_PUT for type %d\n",work_type);
+}
+
+/* An Iput's payload follows its hdr and ack as for a Put, but the app sends
+   it only when it next drives its Iputs, so rather than wait for it the
+   server posts the recv here and queues the work when put_recvs_test sees
+   it land.  The table is queue bookkeeping, so it is bmalloc'd. */
+typedef struct put_recv
+{
+    int from_rank;
+    int info_buf[IBUF_NUMINTS];
+    void *work_buf;
+} put_recv_t;
+static MPI_Request *put_recv_reqs = NULL;
+static put_recv_t *put_recvs = NULL;
+static int num_put_recvs = 0, put_recvs_size = 0;
+
+static void put_recv_post(int from_rank, int *info_buf, void *work_buf)
+{
+    int new_size;
+    MPI_Request *new_reqs;
+    put_recv_t *new_recvs;
+
+    if (num_put_recvs == put_recvs_size)
+    {
+        new_size = (put_recvs_size > 0) ? 2 * put_recvs_size : 16;
+        new_reqs = bmalloc(new_size * sizeof(MPI_Request));
+        new_recvs = bmalloc(new_size * sizeof(put_recv_t));
+        if (put_recvs_size > 0)
+        {
+            memcpy(new_reqs,put_recv_reqs,num_put_recvs * sizeof(MPI_Request));
+            memcpy(new_recvs,put_recvs,num_put_recvs * sizeof(put_recv_t));
+            bfree(put_recv_reqs,put_recvs_size * sizeof(MPI_Request));
+            bfree(put_recvs,put_recvs_size * sizeof(put_recv_t));
+        }
+        put_recv_reqs = new_reqs;
+        put_recvs = new_recvs;
+        put_recvs_size = new_size;
+    }
+    put_recvs[num_put_recvs].from_rank = from_rank;
+    memcpy(put_recvs[num_put_recvs].info_buf,info_buf,IBUF_NUMINTS * sizeof(int));
+    put_recvs[num_put_recvs].work_buf = work_buf;
+    MPI_Irecv(work_buf,info_buf[4],MPI_BYTE,from_rank,FA_IPUT_MSG,adlb_all_comm,
+              &put_recv_reqs[num_put_recvs]);
+    num_put_recvs++;
+}
+
+static int put_recvs_test()  /* queues the work of payloads that have landed */
+{
+    int i, flag, ndone;
+    put_recv_t pr;
+
+    ndone = 0;
+    for (i=num_put_recvs-1; i >= 0; i--)    /* the last moves into a done slot */
+    {
+        MPI_Test(&put_recv_reqs[i],&flag,MPI_STATUS_IGNORE);
+        if ( ! flag )
+            continue;
+        pr = put_recvs[i];
+        num_put_recvs--;
+        put_recv_reqs[i] = put_recv_reqs[num_put_recvs];
+        put_recvs[i] = put_recvs[num_put_recvs];
+        put_enqueue_work(pr.from_rank,pr.info_buf,pr.work_buf,TA_IPUT_RESP);
+        ndone++;
+    }
+    return ndone;
+}
+
+static void handle_fa_put_hdr(int from_rank, int from_tag, MPI_Status *status)
+{
+    int info_buf[IBUF_NUMINTS], ack_buf[IBUF_NUMINTS], reply_tag;
+    void *work_buf;
+    MPI_Request request;
+
+    server_recv(info_buf,IBUF_NUMINTS,MPI_INT,status);
+    if (using_debug_server)
+        num_events_since_logatds++;
+    reply_tag = info_buf[10] ? TA_IPUT_RESP : TA_ACK_AND_RC;
+    work_buf = put_accept_hdr(from_rank,info_buf,reply_tag);
+    if (work_buf == NULL)
+        return;
+    ack_buf[0] = SUCCESS;
+    if (info_buf[10])    /* from Iput */
+    {
+        put_recv_post(from_rank,info_buf,work_buf);
+        MPI_Rsend(ack_buf,IBUF_NUMINTS,MPI_INT,from_rank,reply_tag,adlb_all_comm);
+        return;
+    }
+    MPI_Irecv(work_buf,info_buf[4],MPI_BYTE,from_rank,FA_PUT_MSG,adlb_all_comm,&request);
+    MPI_Rsend(ack_buf,IBUF_NUMINTS,MPI_INT,from_rank,TA_ACK_AND_RC,adlb_all_comm);
+    MPI_Wait(&request,status);
+    put_enqueue_work(from_rank,info_buf,work_buf,TA_ACK_AND_RC);
+}
+
+/* hdr and payload in one msg; the app gets only the final ack (or a reject),
+   as TA_IPUT_RESP if hdr[10] says the put came from Iput */
+static void handle_fa_put_eager(int from_rank, int from_tag, MPI_Status *status)
+{
+    int msglen, reply_tag, info_buf[IBUF_NUMINTS];
+    void *work_buf;
+
+    MPI_Get_count(status,MPI_BYTE,&msglen);
+    if (msglen < (int)(IBUF_NUMINTS * sizeof(int))
+    ||  msglen > (int)(IBUF_NUMINTS * sizeof(int)) + PUT_EAGER_MAX_LIMIT)
+    {
+        aprintf(1,"** eager put from %d: msg of %d bytes\n",from_rank,msglen);
+        adlb_server_abort(-1,1);
+    }
+    if ( ! put_stage_buf )
+        put_stage_buf = bmalloc(PUT_STAGE_BYTES);
+    server_recv(put_stage_buf,msglen,MPI_BYTE,status);
+    if (using_debug_server)
+        num_events_since_logatds++;
+    memcpy(info_buf,put_stage_buf,IBUF_NUMINTS * sizeof(int));
+    if (info_buf[4] != msglen - (int)(IBUF_NUMINTS * sizeof(int)))
+    {
+        aprintf(1,"** eager put from %d: msg of %d bytes for work_len %d\n",
+                from_rank,msglen,info_buf[4]);
+        adlb_server_abort(-1,1);
+    }
+    reply_tag = info_buf[10] ? TA_IPUT_RESP : TA_ACK_AND_RC;
+    work_buf = put_accept_hdr(from_rank,info_buf,reply_tag);
+    if (work_buf)
+    {
+        memcpy(work_buf,put_stage_buf + IBUF_NUMINTS * sizeof(int),info_buf[4]);
+        num_eager_puts++;
+        put_enqueue_work(from_rank,info_buf,work_buf,reply_tag);
+    }
+}
+
+/* A group of units for this server: the unit count, a hdr per unit, then
+   the payloads back to back.  Each unit is queued or rejected on its own,
+   and one reply carries an overall rc, a server that may have room, and
+   each unit's rc. */
+static void handle_fa_put_many(int from_rank, int from_tag, MPI_Status *status)
+{
+    int i, msglen, num_units, work_len, offset, *hdrs, *reply,
+        info_buf[IBUF_NUMINTS], ack_buf[IBUF_NUMINTS];
+    void *work_buf;
+
+    MPI_Get_count(status,MPI_BYTE,&msglen);
+    if (msglen < (int) sizeof(int)  ||  msglen > PUT_STAGE_BYTES)
+    {
+        aprintf(1,"** put many from %d: msg of %d bytes\n",from_rank,msglen);
+        adlb_server_abort(-1,1);
+    }
+    if ( ! put_stage_buf )
+        put_stage_buf = bmalloc(PUT_STAGE_BYTES);
+    server_recv(put_stage_buf,msglen,MPI_BYTE,status);
+    if (using_debug_server)
+        num_events_since_logatds++;
+    memcpy(&num_units,put_stage_buf,sizeof(int));
+    hdrs = (int *) (put_stage_buf + sizeof(int));
+    offset = -1;
+    if (num_units > 0  &&  num_units <= PUT_MANY_MAX_UNITS)
+        offset = (1 + num_units * IBUF_NUMINTS) * sizeof(int);
+    for (i=0; i < num_units  &&  offset >= 0  &&  offset <= msglen; i++)
+    {
+        if (hdrs[i*IBUF_NUMINTS+4] < 0)
+            offset = -1;
+        else
+            offset += hdrs[i*IBUF_NUMINTS+4];  /* each at most msglen, so no overflow */
+    }
+    if (offset != msglen)
+    {
+        aprintf(1,"** put many from %d: msg of %d bytes for %d units of %d bytes\n",
+                from_rank,msglen,num_units,offset);
+        adlb_server_abort(-1,1);
+    }
+    reply = amalloc((2+num_units) * sizeof(int));
+    reply[0] = SUCCESS;
+    reply[1] = -1;
+    offset = (1 + num_units * IBUF_NUMINTS) * sizeof(int);
+    for (i=0; i < num_units; i++)
+    {
+        memcpy(info_buf,&hdrs[i*IBUF_NUMINTS],IBUF_NUMINTS * sizeof(int));
+        work_len = info_buf[4];
+        work_buf = put_check_hdr(info_buf,ack_buf);
+        if (work_buf == NULL)
+        {
+            reply[2+i] = ack_buf[0];
+            if (ack_buf[0] == ADLB_NO_MORE_WORK)
+                reply[0] = ADLB_NO_MORE_WORK;
+            else if (ack_buf[1] >= 0)
+                reply[1] = ack_buf[1];
+        }
+        else
+        {
+            memcpy(work_buf,put_stage_buf + offset,work_len);
+            put_enqueue_work(from_rank,info_buf,work_buf,-1);
+            reply[2+i] = SUCCESS;
         }
-        else if (from_tag == SS_END_LOOP_1)
+        offset += work_len;
+    }
+    isend_ints(reply,2+num_units,from_rank,TA_ACK_AND_RC);
+    afree(reply,(2+num_units) * sizeof(int));
+}
+
+static void handle_fa_put_common_hdr(int from_rank, int from_tag, MPI_Status *status)
+{
+    int i, info_buf[IBUF_NUMINTS], ack_buf[IBUF_NUMINTS], server_rank, cand_rank;
+    double smallest_dbl;
+    xq_node_t *cq_node;
+    void *work_buf;
+
+    aprintf(0000, "AT FA_PUT_COMMON from %d\n",from_rank);
+    server_recv(info_buf,IBUF_NUMINTS,MPI_INT,status);
+    if (using_debug_server)
+        num_events_since_logatds++;
+    if (no_more_work_flag)
+    {
+        ack_buf[0] = ADLB_NO_MORE_WORK;
+        isend_ints(ack_buf,IBUF_NUMINTS,from_rank,TA_ACK_AND_RC);
+        // aprintf(0000, "SENT NO_MORE_WORK TO %06d\n",from_rank);
+        return;
+    }
+    common_len = info_buf[0];
+    if ((bytes_in_use()+pmalloc_footprint(common_len)) > THRESHOLD_TO_REJECT_PUT)
+    {
+        // aprintf(0000, "IN FA_PUT_COMMON REJECTING FROM RANK %06d\n",from_rank);
+        // cblog(1,from_rank,"REJECTED PUT_COMMON type %d\n",info_buf[0]);
+        num_rejected_puts += 1;
+        ack_buf[0] = ADLB_PUT_REJECTED;
+        cand_rank = -1;
+        smallest_dbl = 999999999999.9;
+        for (i=0; i < num_servers; i++)
         {
-            num_ss_msgs_handled_since_logatds++;
-            /* only arrives on lhs and if there is more than 1 server */
-            aprintf(0000, "AT SS_END_LOOP_1\n");
-            MPI_Recv(info_buf,0,MPI_INT,from_rank,from_tag,adlb_all_comm,&status);
-            if (my_world_rank == master_server_rank)
+            server_rank = get_server_rank(i);
+            if (server_rank != my_world_rank
+            &&  qmstat_tbl[i].nbytes_used < THRESHOLD_TO_START_PUSH
+            &&  qmstat_tbl[i].nbytes_used < smallest_dbl)
             {
-                /* change it to loop 2 */
-                temp_req = amalloc(sizeof(MPI_Request));
-                rc = MPI_Issend(info_buf,0,MPI_INT,rhs_rank,
-                                SS_END_LOOP_2,adlb_all_comm,temp_req);
-                iq_node = iq_node_create(temp_req,0,NULL);
-                iq_append(iq_node);
+                smallest_dbl = qmstat_tbl[i].nbytes_used;
+                cand_rank = server_rank;
             }
-            else
+        }
+        if (cand_rank >= 0)
+            ack_buf[1] = cand_rank;
+        else
+            ack_buf[1] = -1;
+        ack_buf[2] = 1;  // threshold violation
+        MPI_Rsend(ack_buf,IBUF_NUMINTS,MPI_INT,from_rank,TA_ACK_AND_RC,adlb_all_comm);
+        return;
+    }
+    common_len = info_buf[0];
+    work_buf = pmalloc(common_len,__FUNCTION__,__LINE__);  // dmalloc just for puts
+    if (work_buf == NULL)
+    {
+        num_rejected_puts += 1;
+        ack_buf[0] = ADLB_PUT_REJECTED;
+        cand_rank = -1;
+        smallest_dbl = 999999999999.9;
+        for (i=0; i < num_servers; i++)
+        {
+            server_rank = get_server_rank(i);
+            if (server_rank != my_world_rank
+            &&  qmstat_tbl[i].nbytes_used < THRESHOLD_TO_START_PUSH
+            &&  qmstat_tbl[i].nbytes_used < smallest_dbl)
             {
-                if (num_local_apps_done >= num_apps_this_server)
-                {
-                    holding_end_loop_1 = 0;
-                    temp_req = amalloc(sizeof(MPI_Request));
-                    rc = MPI_Issend(info_buf,0,MPI_INT,rhs_rank,
-                                    SS_END_LOOP_1,adlb_all_comm,temp_req);
-                    iq_node = iq_node_create(temp_req,0,NULL);
-                    iq_append(iq_node);
-                }
-                else
-                    holding_end_loop_1 = 1;
+                smallest_dbl = qmstat_tbl[i].nbytes_used;
+                cand_rank = server_rank;
             }
-            aprintf(0000, "PAST SS_END_LOOP_1\n");
         }
-        else if (from_tag == SS_END_LOOP_2)
+        if (cand_rank >= 0)
+            ack_buf[1] = cand_rank;
+        else
+            ack_buf[1] = -1;
+        ack_buf[2] = 2;  // probable fragmentation
+        MPI_Rsend(ack_buf,IBUF_NUMINTS,MPI_INT,from_rank,TA_ACK_AND_RC,adlb_all_comm);
+        return;
+    }
+    inside_batch_put[from_rank] = 1;
+    ack_buf[0] = SUCCESS;
+    isend_ints(ack_buf,IBUF_NUMINTS,from_rank,TA_ACK_AND_RC);
+    MPI_Recv(work_buf,common_len,MPI_BYTE,from_rank,
+             FA_PUT_COMMON_MSG,adlb_all_comm,status);
+    cq_node = cq_node_create(common_len,work_buf,next_cqseqno);
+    cq_append(cq_node);
+    next_cqseqno++;
+    ack_buf[0] = SUCCESS;
+    ack_buf[1] = next_cqseqno - 1;
+    isend_ints(ack_buf,IBUF_NUMINTS,from_rank,TA_ACK_AND_RC);
+    aprintf(0000, "PAST FA_PUT_COMMON\n");
+}
+
+static void handle_fa_put_batch_done(int from_rank, int from_tag, MPI_Status *status)
+{
+    int info_buf[IBUF_NUMINTS], ack_buf[IBUF_NUMINTS];
+    xq_node_t *cq_node;
+    cq_struct_t *cs;
+
+    aprintf(0000, "AT FA_PUT_BATCH_DONE\n");
+    server_recv(info_buf,IBUF_NUMINTS,MPI_INT,status);
+    inside_batch_put[from_rank] = 0;
+    if (info_buf[0] > 0)  /* common_cqseqno */
+    {
+        cq_node = cq_find_seqno(info_buf[0]);
+        cs = cq_node->data;
+        cs->refcnt = info_buf[1];
+        if (cs->refcnt == cs->ngets)
+            cq_delete(cq_node);
+    }
+    if (using_debug_server)
+        num_events_since_logatds++;
+    if (no_more_work_flag)
+    {
+        ack_buf[0] = ADLB_NO_MORE_WORK;
+        isend_ints(ack_buf,IBUF_NUMINTS,from_rank,TA_ACK_AND_RC);
+        aprintf(0000, "SENT NO_MORE_WORK TO %06d\n",from_rank);
+        return;
+    }
+    ack_buf[0] = SUCCESS;
+    isend_ints(ack_buf,IBUF_NUMINTS,from_rank,TA_ACK_AND_RC);
+    aprintf(0000, "PAST FA_PUT_BATCH_DONE\n");
+}
+
+static void handle_fa_did_put_at_remote(int from_rank, int from_tag, MPI_Status *status)
+{
+    int info_buf[IBUF_NUMINTS], work_type, server_rank, target_rank;
+    xq_node_t *tq_node;
+    tq_struct_t *ts;
+
+    server_recv(info_buf,IBUF_NUMINTS,MPI_INT,status);
+    work_type   = info_buf[0];
+    target_rank = info_buf[1];
+    server_rank = info_buf[2];
+    tq_node = tq_find_rtr(target_rank,work_type,server_rank);
+    if (tq_node)
+    {
+        ts = tq_node->data;
+        ts->num_stored++;
+    }
+    else
+    {
+        tq_node = tq_node_create(target_rank,work_type,server_rank,1);
+        tq_append(tq_node);
+        ts = tq_node->data;
+    }
+    check_remote_work_for_queued_apps();  /* make sure no one is waiting for this */
+}
+
+/* also handles FA_GET_WORK, whose hang_flag is followed by the largest unit
+   the app will take in the resp itself; a local unit that fits is sent
+   with its metadata instead of being reserved */
+static void handle_fa_reserve(int from_rank, int from_tag, MPI_Status *status)
+{
+    int i, *reserve_buf, info_buf[IBUF_NUMINTS], hang_flag, soft_pin, type_idx, cand_rank,
+        rqseqno, *req_types, num_req_types, hdr_nints, max_len, nints, *work_msg, iq_slot;
+    xq_node_t *wq_node, *rq_node;
+    wq_struct_t *ws;
+    rq_struct_t *rs;
+
+    aprintf(0000, "AT FA_RESERVE\n");
+    reserve_buf = recv_ints(status,3,&num_req_types);
+    hdr_nints = (from_tag == FA_GET_WORK) ? 2 : 1;
+    num_req_types -= hdr_nints;    /* hang_flag (and max_len) are first */
+    num_reserves++;
+    if (using_debug_server)
+    {
+        num_events_since_logatds++;
+        num_reserves_since_logatds++;
+    }
+    if (no_more_work_flag)
+    {
+        info_buf[0] = ADLB_NO_MORE_WORK;
+        isend_ints(info_buf,IBUF_NUMINTS,from_rank,TA_RESERVE_RESP);
+        aprintf(0000, "IN FA_RESERVE SENTa NO_MORE_WORK TO %06d\n",from_rank);
+        return;
+    }
+    hang_flag = (reserve_buf[0] == 1);
+    soft_pin = (reserve_buf[0] == RESERVE_PREFETCH);  /* an app filling its prefetch */
+    max_len = (from_tag == FA_GET_WORK) ? reserve_buf[1] : -1;
+    req_types = &reserve_buf[hdr_nints];
+    req_mask_build(req_mask,num_req_types,req_types);
+    // cblog(1,from_rank,"AT RESERVE types %d %d %d %d\n",
+               // req_types[0],req_types[1],req_types[2],req_types[3]);
+    wq_node = wq_find_pre_targeted_hi_prio(from_rank,req_mask);
+    if ( ! wq_node)
+        wq_node = wq_find_hi_prio(req_mask);
+    if (wq_node)
+        ws = wq_node->data;
+    if (wq_node  &&  max_len >= 0  &&  ws->common_len == 0  &&  ws->work_len <= max_len)
+    {
+        wq_pin(wq_node,from_rank);
+        nints = IBUF_NUMINTS + (ws->work_len + sizeof(int) - 1) / sizeof(int);
+        work_msg = amalloc(nints * sizeof(int));
+        work_msg[0] = GOT_WORK;
+        work_msg[1] = ws->work_type;
+        work_msg[2] = ws->work_prio;
+        work_msg[3] = ws->work_len;
+        work_msg[4] = ws->answer_rank;
+        work_msg[5] = ws->target_rank;  /* so an unused prefetch can be put back */
+        memcpy(&work_msg[IBUF_NUMINTS],ws->work_buf,ws->work_len);
+        aprintf(0000, "IN FA_GET_WORK SENDING WORK to %06d\n",from_rank);
+        iq_slot = iq_slot_create(nints * sizeof(int),work_msg);
+        MPI_Isend(work_msg,nints,MPI_INT,from_rank,TA_RESERVE_RESP,adlb_all_comm,
+                  iq_req(iq_slot));
+        if (using_debug_server)
+            num_reserves_immed_sat_since_logatds++;
+        if (doing_periodic_stats)
+        {
+            type_idx = get_type_idx(ws->work_type);
+            if (type_idx < 0) aprintf(1,"** invalid type\n");
+            periodic_resolved_reserve_cnt[type_idx]++;
+        }
+        wq_delete_taken(wq_node);
+    }
+    else if (wq_node)
+    {
+        if (soft_pin)
+            wq_soft_pin(wq_node,from_rank);
+        else
+            wq_pin(wq_node,from_rank);
+        info_buf[0] = SUCCESS;
+        info_buf[1] = ws->work_type;
+        info_buf[2] = ws->work_prio;
+        info_buf[3] = ws->work_len;
+        info_buf[4] = ws->answer_rank;
+        info_buf[5] = ws->wqseqno;
+        info_buf[6] = my_world_rank;
+        info_buf[7] = ws->common_len;
+        info_buf[8] = ws->common_server_rank;
+        info_buf[9] = ws->common_server_commseqno;
+        aprintf(0000, "IN FA_RESERVE SENDING RESERVATION to %06d\n",from_rank);
+        isend_ints(info_buf,IBUF_NUMINTS,from_rank,TA_RESERVE_RESP);
+        if (use_dbg_prints)
+            aprintf(0000,"DBG3: rsv -1 0.0 %f %d %d\n",
+                    MPI_Wtime()-ws->time_stamp,from_rank,ws->work_type);
+        if (using_debug_server)
+            num_reserves_immed_sat_since_logatds++;
+        /* do not delete here because merely targeted; not given away */
+        if (doing_periodic_stats)
         {
-            num_ss_msgs_handled_since_logatds++;
-            aprintf(0000, "AT SS_END_LOOP_2 from %06d\n",from_rank);
-            MPI_Recv(info_buf,0,MPI_INT,from_rank,from_tag,adlb_all_comm,&status);
-            done = 1;
-            if (using_debug_server  &&  my_world_rank == master_server_rank)
+            type_idx = get_type_idx(ws->work_type);
+            if (type_idx < 0) aprintf(1,"** invalid type\n");
+            periodic_resolved_reserve_cnt[type_idx]++;
+        }
+    }
+    else
+    {
+        if (hang_flag)
+        {
+            aprintf(0000,"QUEUEING rank %06d\n",from_rank);
+            // cblog(1,from_rank,"  QUEUED by %d\n",my_world_rank);
+            rqseqno = next_rqseqno++;
+            rq_node = rq_node_create(from_rank,num_req_types,req_types,rqseqno);
+            rs = rq_node->data;
+            rs->time_stamp = MPI_Wtime();
+            /** this small block is solely for computing counters for debug_server **/
+            cand_rank = -1;  /* default: did not find server that may have this type */
+            for (i=0; i < rs->num_req_types; i++)
             {
-                rc = MPI_Issend(info_buf,0,MPI_INT,debug_server_rank,
-                                DS_END,adlb_all_comm,&dummy_req);
+                cand_rank = find_cand_rank_with_worktype(rs->world_rank,rs->req_types[i]);
+                if (cand_rank >= 0)
+                    break;
             }
-            if (my_world_rank != master_server_rank)
+            if (cand_rank < 0)
+                num_reserves_not_in_stat_vec++;
+            /** end debug block **/
+            if (doing_periodic_stats)
             {
-                temp_req = amalloc(sizeof(MPI_Request));
-                rc = MPI_Issend(info_buf,0,MPI_INT,rhs_rank,
-                                SS_END_LOOP_2,adlb_all_comm,temp_req);
-                iq_node = iq_node_create(temp_req,0,NULL);
-                iq_append(iq_node);
+                for (i=0; i < rs->num_req_types; i++)
+                {
+                    if (i == 0  && rs->req_types[i] < 0)  /* if wild card */
+                        type_idx = num_types;
+                    else if (rs->req_types[i] >= 0)  /* user type */
+                        type_idx = get_type_idx(rs->req_types[i]);
+                    else    /* list terminator */
+                        break;
+                    if (type_idx < 0) aprintf(1,"** invalid type\n");
+                    periodic_rq_vector[type_idx]++;
+                }
+                periodic_rq_vector[num_types+1] = rq->count + 1;  /* appending */
             }
-            while ((rq_node=xq_first(rq)))
+            rq_append(rq_node);
+            num_reserves_put_on_rq++;
+            if (rfr_to_rank[rs->world_rank] < 0)
             {
-                rs = rq_node->data;
-                aprintf(0000,"SENDING NMW to rank %06d\n",rs->world_rank);
-                info_buf[0] = ADLB_NO_MORE_WORK;
-                MPI_Ssend(info_buf,IBUF_NUMINTS,MPI_INT,rs->world_rank,
-                          TA_RESERVE_RESP,adlb_all_comm);
-                /* since no_more_work, do NOT alter times for total_time_on_rq */
-                if (doing_periodic_stats)
+                for (i=0; i < rs->num_req_types; i++)
                 {
-                    for (i=0; i < num_types; i++)
+                    /* no need to check rfr_rank for this new req from user */
+                    cand_rank = find_cand_rank_with_worktype(rs->world_rank,rs->req_types[i]);
+                    if (cand_rank >= 0)
                     {
-                        if (i == 0  && rs->req_types[i] < 0)  /* if wild card */
-                            type_idx = num_types;
-                        else if (rs->req_types[i] >= 0)  /* user type */
-                            type_idx = get_type_idx(rs->req_types[i]);
-                        else    /* list terminator */
-                            break;
-                        if (type_idx < 0) aprintf(1,"** invalid type\n");
-                        periodic_rq_vector[type_idx]--;
+                        aprintf(0000,"REQING rqseqno %d fromrank %d\n",rqseqno,cand_rank);
+                        // cblog(1,from_rank,"  REQING from %d ty %d\n",cand_rank,rs->req_types[i]);
+                        send_rfr(cand_rank,rs);
+                        rfr_to_rank[rs->world_rank] = cand_rank;
+                        rfr_out[cand_rank] = 1;
+                        nrfrs_sent++;
+                        if (use_dbg_prints)
+                            dbg_rfr_sent_cnt[rs->world_rank]++;
+                        break;
                     }
-                    periodic_rq_vector[num_types+1] = rq->count - 1; /* deleting */
-                    /** not nec when no_more_work
-                    type_idx = get_type_idx(ws->work_type);
-                    periodic_resolved_reserve_cnt[type_idx]++;
-                    **/
                 }
-                rq_delete(rq_node);
-                exhausted_flag = 0;
+                if (rfr_to_rank[rs->world_rank] < 0)  /* no other server has any */
+                    steal_prefetched_for_queued(rq_node);
             }
-            aprintf(0000, "PAST SS_END_LOOP_2 from %06d\n",from_rank);
         }
-        else if (from_tag == SS_EXHAUST_CHK_LOOP_1)
+        else
         {
-            num_ss_msgs_handled_since_logatds++;
-            MPI_Recv(info_buf,0,MPI_INT,from_rank,from_tag,adlb_all_comm,&status);
-            if (my_world_rank == master_server_rank)
-            {
-                if (rq->count >= num_apps_this_server  &&  exhausted_flag) /* be sure */
-                {
-                    temp_req = amalloc(sizeof(MPI_Request));
-                    MPI_Isend(info_buf,0,MPI_INT,rhs_rank,SS_EXHAUST_CHK_LOOP_2,
-                              adlb_all_comm,temp_req);
-                    iq_node = iq_node_create(temp_req, 0, NULL);
-                    iq_append(iq_node);
-                }
-            }
-            else
-            {
-                if (rq->count >= num_apps_this_server)
-                {
-                    exhausted_flag = 1;
-                    temp_req = amalloc(sizeof(MPI_Request));
-                    MPI_Isend(info_buf,0,MPI_INT,rhs_rank,SS_EXHAUST_CHK_LOOP_1,
-                              adlb_all_comm,temp_req);
-                    iq_node = iq_node_create(temp_req, 0, NULL);
-                    iq_append(iq_node);
-                }
-            }
+            aprintf(0000,"SEND NOCURRWORK TO rank %06d\n",from_rank);
+            info_buf[0] = NO_CURR_WORK;
+            isend_ints(info_buf,IBUF_NUMINTS,from_rank,TA_RESERVE_RESP);
+        }
+    }
+    // cblog(1,from_rank,"PAST RESERVE\n");
+    aprintf(0000, "PAST FA_RESERVE\n");
+}
+
+static void handle_fa_get_common(int from_rank, int from_tag, MPI_Status *status)
+{
+    int info_buf[IBUF_NUMINTS];
+    xq_node_t *cq_node;
+    cq_struct_t *cs;
+
+    aprintf(0000, "AT FA_GET_COMMON\n");
+    // cblog(1,from_rank,"AT GET_COMMON\n");
+    server_recv(info_buf,IBUF_NUMINTS,MPI_INT,status);
+    cq_node = cq_find_seqno(info_buf[0]);
+    cs = cq_node->data;
+    MPI_Ssend(cs->buf,cs->commlen,MPI_BYTE,from_rank,TA_GET_COMMON_RESP,adlb_all_comm);
+    cs->ngets++;
+    if (cs->refcnt == cs->ngets)
+        cq_delete(cq_node);
+}
+
+static void handle_fa_get_reserved(int from_rank, int from_tag, MPI_Status *status)
+{
+    int info_buf[IBUF_NUMINTS], wqseqno, iq_slot;
+    double dbls_info_buf[IBUF_NUMDBLS];
+    xq_node_t *wq_node;
+    wq_struct_t *ws;
+
+    aprintf(0000, "AT FA_GET_RESERVED\n");
+    // cblog(1,from_rank,"AT GET_RESERVED\n");
+    server_recv(info_buf,IBUF_NUMINTS,MPI_INT,status);
+    if (using_debug_server)
+        num_events_since_logatds++;
+    if (no_more_work_flag)
+    {
+        dbls_info_buf[0] = (double)ADLB_NO_MORE_WORK;
+        MPI_Rsend(dbls_info_buf,IBUF_NUMDBLS,MPI_DOUBLE,from_rank,TA_ACK_AND_RC,adlb_all_comm);
+        aprintf(0000, "IN FA_GET_RESERVED SENTc NO_MORE_WORK TO %06d\n",from_rank);
+        return;
+    }
+    wqseqno = info_buf[0];
+    wq_node = wq_find_pinned_for_rank(from_rank,wqseqno);
+    if ( ! wq_node  &&  info_buf[1] == RESERVE_PREFETCH)
+    {
+        dbls_info_buf[0] = (double)NO_CURR_WORK;  /* taken back for another app */
+        MPI_Rsend(dbls_info_buf,IBUF_NUMDBLS,MPI_DOUBLE,from_rank,
+                  TA_ACK_AND_RC,adlb_all_comm);
+        aprintf(0000, "IN FA_GET_RESERVED wqseqno %d was taken back from %06d\n",
+                wqseqno,from_rank);
+        return;
+    }
+    if ( ! wq_node)
+    {
+        dbls_info_buf[0] = (double)ERROR;
+        MPI_Rsend(dbls_info_buf,IBUF_NUMDBLS,MPI_DOUBLE,from_rank,
+                  TA_ACK_AND_RC,adlb_all_comm);
+        aprintf(1,"** FAILED GET_RESERVED for rank %06d  wqseqno %d\n",
+                from_rank,info_buf[0]);
+        adlb_server_abort(-1,1);
+        return;
+    }
+    ws = wq_node->data;
+    dbls_info_buf[0] = (double) SUCCESS;
+    dbls_info_buf[1] = (double) ws->work_len;
+    dbls_info_buf[2] = (double) (MPI_Wtime() - ws->time_stamp);
+    MPI_Rsend(dbls_info_buf,IBUF_NUMDBLS,MPI_DOUBLE,from_rank,
+              TA_ACK_AND_RC,adlb_all_comm);
+    iq_slot = iq_slot_create(ws->work_len,ws->work_buf);
+    iq_set_payload(iq_slot);    /* freed with pfree when the isend completes */
+    MPI_Isend(ws->work_buf,ws->work_len,MPI_BYTE,from_rank,
+              TA_GET_RESERVED_RESP,adlb_all_comm,iq_req(iq_slot));
+    ws->work_buf = NULL;  /* now owned by the isend above */
+    wq_delete_taken(wq_node);
+    // cblog(1,from_rank,"PAST GET_RESERVED\n");
+    aprintf(0000, "PAST FA_GET_RESERVED\n");
+}
+
+/* drops a unit that an app has now been given */
+static void wq_delete_taken(xq_node_t *wq_node)
+{
+    int type_idx;
+    wq_struct_t *ws;
+
+    ws = wq_node->data;
+    if (doing_periodic_stats)
+    {
+        type_idx = get_type_idx(ws->work_type);
+        if (type_idx < 0) aprintf(1,"** invalid type\n");
+        if (ws->target_rank >= 0)
+        {
+            periodic_wq_2darray[type_idx][ws->target_rank]--;
         }
-        else if (from_tag == SS_EXHAUST_CHK_LOOP_2)
+        else
         {
-            num_ss_msgs_handled_since_logatds++;
-            MPI_Recv(info_buf,0,MPI_INT,from_rank,from_tag,adlb_all_comm,&status);
-            if (rq->count >= num_apps_this_server  &&  exhausted_flag) /* be sure */
-            {
-                if (my_world_rank == master_server_rank)
-                {
-                    temp_req = amalloc(sizeof(MPI_Request));
-                    MPI_Isend(info_buf,0,MPI_INT,rhs_rank,SS_DONE_BY_EXHAUSTION,
-                              adlb_all_comm,temp_req);
-                    iq_node = iq_node_create(temp_req, 0, NULL);
-                    iq_append(iq_node);
-                }
-                else
-                {
-                    temp_req = amalloc(sizeof(MPI_Request));
-                    MPI_Isend(info_buf,0,MPI_INT,rhs_rank,SS_EXHAUST_CHK_LOOP_2,
-                              adlb_all_comm,temp_req);
-                    iq_node = iq_node_create(temp_req, 0, NULL);
-                    iq_append(iq_node);
-                }
-            }
+            periodic_wq_2darray[type_idx][num_app_ranks]--;
         }
-        else if (from_tag == SS_DONE_BY_EXHAUSTION)
+    }
+    wq_delete(wq_node);
+    update_local_state();
+}
+
+static void handle_fa_no_more_work(int from_rank, int from_tag, MPI_Status *status)
+{
+    int i, info_buf[IBUF_NUMINTS], type_idx, iq_slot;
+    xq_node_t *rq_node;
+    rq_struct_t *rs;
+
+    aprintf(0000, "AT FA_NO_MORE_WORK from %06d\n",from_rank);
+    server_recv(info_buf,0,MPI_INT,status);
+    if (using_debug_server)
+        num_events_since_logatds++;
+    no_more_work_flag = 1;
+    if (my_world_rank == master_server_rank)
+    {
+        if (num_servers > 1)
         {
-            num_ss_msgs_handled_since_logatds++;
-            MPI_Recv(info_buf,0,MPI_INT,from_rank,from_tag,adlb_all_comm,&status);
-            if (my_world_rank != master_server_rank)
+            iq_slot = iq_slot_create(0,NULL);
+            MPI_Issend(info_buf,0,MPI_INT,rhs_rank,
+                       SS_NO_MORE_WORK,adlb_bal_comm,iq_req(iq_slot));
+        }
+    }
+    else
+    {
+        /* just send it on to master server */
+        iq_slot = iq_slot_create(0,NULL);
+        MPI_Issend(info_buf,0,MPI_INT,master_server_rank,
+                   SS_NO_MORE_WORK,adlb_bal_comm,iq_req(iq_slot));
+    }
+    while ((rq_node=xq_first(rq)))
+    {
+        rs = rq_node->data;
+        aprintf(0000,"SENDING NMW to rank %06d\n",rs->world_rank);
+        info_buf[0] = ADLB_NO_MORE_WORK;
+        isend_ints(info_buf,IBUF_NUMINTS,rs->world_rank,TA_RESERVE_RESP);
+        aprintf(0000,"SENT NMW to rank %06d\n",rs->world_rank);
+        /* since no_more_work, do NOT alter times for total_time_on_rq */
+        if (doing_periodic_stats)
+        {
+            for (i=0; i < rs->num_req_types; i++)
             {
-                temp_req = amalloc(sizeof(MPI_Request));
-                MPI_Isend(info_buf,0,MPI_INT,rhs_rank,SS_DONE_BY_EXHAUSTION,
-                          adlb_all_comm,temp_req);
-                iq_node = iq_node_create(temp_req, 0, NULL);
-                iq_append(iq_node);
+                if (i == 0  && rs->req_types[i] < 0)  /* if wild card */
+                    type_idx = num_types;
+                else if (rs->req_types[i] >= 0)  /* user type */
+                    type_idx = get_type_idx(rs->req_types[i]);
+                else    /* list terminator */
+                    break;
+                if (type_idx < 0) aprintf(1,"** invalid type\n");
+                periodic_rq_vector[type_idx]--;
             }
-            while ((rq_node=xq_first(rq)))
+            periodic_rq_vector[num_types+1] = rq->count - 1; /* deleting */
+            /** not nec when no_more_work
+            type_idx = get_type_idx(rs->req_types[0]);
+            periodic_resolved_reserve_cnt[type_idx]++;
+            **/
+        }
+        rq_delete(rq_node);
+        exhausted_flag = 0;
+    }
+    aprintf(0000, "PAST FA_NO_MORE_WORK from %06d\n",from_rank);
+}
+
+static void handle_ss_no_more_work(int from_rank, int from_tag, MPI_Status *status)
+{
+    int i, info_buf[IBUF_NUMINTS], type_idx, iq_slot;
+    xq_node_t *rq_node;
+    rq_struct_t *rs;
+
+    num_ss_msgs_handled_since_logatds++;
+    aprintf(0000, "AT SS_NO_MORE_WORK from %06d\n",from_rank);
+    server_recv(info_buf,0,MPI_INT,status);
+    if (my_world_rank != master_server_rank  ||  
+        ! no_more_work_flag)  /* I am master, but this is first send by me */
+    {
+        iq_slot = iq_slot_create(0,NULL);
+        MPI_Issend(info_buf,0,MPI_INT,rhs_rank,
+                   SS_NO_MORE_WORK,adlb_bal_comm,iq_req(iq_slot));
+    }
+    no_more_work_flag = 1;
+    while ((rq_node=xq_first(rq)))
+    {
+        rs = rq_node->data;
+        aprintf(0000,"SENDING NMW to rank %06d\n",rs->world_rank);
+        info_buf[0] = ADLB_NO_MORE_WORK;
+        isend_ints(info_buf,IBUF_NUMINTS,rs->world_rank,TA_RESERVE_RESP);
+        aprintf(0000,"SENT NMW to rank %06d\n",rs->world_rank);
+        /* since no_more_work, do NOT alter times for total_time_on_rq */
+        if (doing_periodic_stats)
+        {
+            for (i=0; i < rs->num_req_types; i++)
             {
-                rs = rq_node->data;
-                info_buf[0] = ADLB_DONE_BY_EXHAUSTION;
-                MPI_Ssend(info_buf,IBUF_NUMINTS,MPI_INT,rs->world_rank,
-                          TA_RESERVE_RESP,adlb_all_comm);
-                /* since exhaustion, do NOT alter times for total_time_on_rq */
-                rq_delete(rq_node);
-                /* exhausted_flag = 0; */  /* leave it set here */
-                /* done, so not dealing with periodic stats right now */
+                if (i == 0  && rs->req_types[i] < 0)  /* if wild card */
+                    type_idx = num_types;
+                else if (rs->req_types[i] >= 0)  /* user type */
+                    type_idx = get_type_idx(rs->req_types[i]);
+                else    /* list terminator */
+                    break;
+                if (type_idx < 0) aprintf(1,"** invalid type\n");
+                periodic_rq_vector[type_idx]--;
             }
+            periodic_rq_vector[num_types+1] = rq->count - 1; /* deleting */
+            /** not nec when no_more_work
+            type_idx = get_type_idx(rs->req_types[0]);
+            periodic_resolved_reserve_cnt[type_idx]++;
+            **/
+        }
+        rq_delete(rq_node);
+        exhausted_flag = 0;
+    }
+    aprintf(0000, "PAST SS_NO_MORE_WORK from %06d\n",from_rank);
+}
+
+static void handle_ss_end_loop_1(int from_rank, int from_tag, MPI_Status *status)
+{
+    int info_buf[IBUF_NUMINTS], iq_slot;
+
+    num_ss_msgs_handled_since_logatds++;
+    /* only arrives on lhs and if there is more than 1 server */
+    aprintf(0000, "AT SS_END_LOOP_1\n");
+    server_recv(info_buf,0,MPI_INT,status);
+    if (my_world_rank == master_server_rank)
+    {
+        /* change it to loop 2 */
+        iq_slot = iq_slot_create(0,NULL);
+        MPI_Issend(info_buf,0,MPI_INT,rhs_rank,
+                   SS_END_LOOP_2,adlb_bal_comm,iq_req(iq_slot));
+    }
+    else
+    {
+        if (num_local_apps_done >= num_apps_this_server)
+        {
+            holding_end_loop_1 = 0;
+            iq_slot = iq_slot_create(0,NULL);
+            MPI_Issend(info_buf,0,MPI_INT,rhs_rank,
+                       SS_END_LOOP_1,adlb_bal_comm,iq_req(iq_slot));
         }
-        else if (from_tag == SS_DBG_TIMING_MSG)  /* only sent when use_dbg_prints = 1 */
+        else
+            holding_end_loop_1 = 1;
+    }
+    aprintf(0000, "PAST SS_END_LOOP_1\n");
+}
+
+static void handle_ss_end_loop_2(int from_rank, int from_tag, MPI_Status *status)
+{
+    int i, info_buf[IBUF_NUMINTS], type_idx, iq_slot;
+    xq_node_t *rq_node;
+    rq_struct_t *rs;
+
+    num_ss_msgs_handled_since_logatds++;
+    aprintf(0000, "AT SS_END_LOOP_2 from %06d\n",from_rank);
+    server_recv(info_buf,0,MPI_INT,status);
+    server_done = 1;
+    if (using_debug_server  &&  my_world_rank == master_server_rank)
+    {
+        MPI_Issend(info_buf,0,MPI_INT,debug_server_rank,
+                   DS_END,adlb_tel_comm,&dummy_req);
+    }
+    if (my_world_rank != master_server_rank)
+    {
+        iq_slot = iq_slot_create(0,NULL);
+        MPI_Issend(info_buf,0,MPI_INT,rhs_rank,
+                   SS_END_LOOP_2,adlb_bal_comm,iq_req(iq_slot));
+    }
+    while ((rq_node=xq_first(rq)))
+    {
+        rs = rq_node->data;
+        aprintf(0000,"SENDING NMW to rank %06d\n",rs->world_rank);
+        info_buf[0] = ADLB_NO_MORE_WORK;
+        isend_ints(info_buf,IBUF_NUMINTS,rs->world_rank,TA_RESERVE_RESP);
+        /* since no_more_work, do NOT alter times for total_time_on_rq */
+        if (doing_periodic_stats)
         {
-            num_ss_msgs_handled_since_logatds++;
-            MPI_Recv(dbls_info_buf,IBUF_NUMDBLS,MPI_DOUBLE,from_rank,from_tag,
-                     adlb_all_comm,&status);
-            if (my_world_rank == master_server_rank)
+            for (i=0; i < rs->num_req_types; i++)
             {
-                prev_dbg_msg_timelen = MPI_Wtime() - prev_dbg_msg_start;
-                aprintf(1111,"DBG4: %f %f\n",prev_dbg_msg_timelen,dbg_prev_qmstat_timelen);
-                dbg_msg_is_out = 0;
+                if (i == 0  && rs->req_types[i] < 0)  /* if wild card */
+                    type_idx = num_types;
+                else if (rs->req_types[i] >= 0)  /* user type */
+                    type_idx = get_type_idx(rs->req_types[i]);
+                else    /* list terminator */
+                    break;
+                if (type_idx < 0) aprintf(1,"** invalid type\n");
+                periodic_rq_vector[type_idx]--;
             }
-            else
+            periodic_rq_vector[num_types+1] = rq->count - 1; /* deleting */
+            /** not nec when no_more_work
+            type_idx = get_type_idx(ws->work_type);
+            periodic_resolved_reserve_cnt[type_idx]++;
+            **/
+        }
+        rq_delete(rq_node);
+        exhausted_flag = 0;
+    }
+    aprintf(0000, "PAST SS_END_LOOP_2 from %06d\n",from_rank);
+}
+
+static void handle_ss_exhaust_chk_loop_1(int from_rank, int from_tag, MPI_Status *status)
+{
+    int info_buf[IBUF_NUMINTS], iq_slot;
+
+    num_ss_msgs_handled_since_logatds++;
+    server_recv(info_buf,0,MPI_INT,status);
+    if (my_world_rank == master_server_rank)
+    {
+        if (rq->count >= num_apps_this_server  &&  exhausted_flag) /* be sure */
+        {
+            iq_slot = iq_slot_create(0, NULL);
+            MPI_Isend(info_buf,0,MPI_INT,rhs_rank,SS_EXHAUST_CHK_LOOP_2,
+                      adlb_bal_comm,iq_req(iq_slot));
+        }
+    }
+    else
+    {
+        if (rq->count >= num_apps_this_server)
+        {
+            exhausted_flag = 1;
+            iq_slot = iq_slot_create(0, NULL);
+            MPI_Isend(info_buf,0,MPI_INT,rhs_rank,SS_EXHAUST_CHK_LOOP_1,
+                      adlb_bal_comm,iq_req(iq_slot));
+        }
+    }
+}
+
+static void handle_ss_exhaust_chk_loop_2(int from_rank, int from_tag, MPI_Status *status)
+{
+    int info_buf[IBUF_NUMINTS], iq_slot;
+
+    num_ss_msgs_handled_since_logatds++;
+    server_recv(info_buf,0,MPI_INT,status);
+    if (rq->count >= num_apps_this_server  &&  exhausted_flag) /* be sure */
+    {
+        if (my_world_rank == master_server_rank)
+        {
+            iq_slot = iq_slot_create(0, NULL);
+            MPI_Isend(info_buf,0,MPI_INT,rhs_rank,SS_DONE_BY_EXHAUSTION,
+                      adlb_bal_comm,iq_req(iq_slot));
+        }
+        else
+        {
+            iq_slot = iq_slot_create(0, NULL);
+            MPI_Isend(info_buf,0,MPI_INT,rhs_rank,SS_EXHAUST_CHK_LOOP_2,
+                      adlb_bal_comm,iq_req(iq_slot));
+        }
+    }
+}
+
+static void handle_ss_done_by_exhaustion(int from_rank, int from_tag, MPI_Status *status)
+{
+    int info_buf[IBUF_NUMINTS], iq_slot;
+    xq_node_t *rq_node;
+    rq_struct_t *rs;
+
+    num_ss_msgs_handled_since_logatds++;
+    server_recv(info_buf,0,MPI_INT,status);
+    if (my_world_rank != master_server_rank)
+    {
+        iq_slot = iq_slot_create(0, NULL);
+        MPI_Isend(info_buf,0,MPI_INT,rhs_rank,SS_DONE_BY_EXHAUSTION,
+                  adlb_bal_comm,iq_req(iq_slot));
+    }
+    while ((rq_node=xq_first(rq)))
+    {
+        rs = rq_node->data;
+        info_buf[0] = ADLB_DONE_BY_EXHAUSTION;
+        isend_ints(info_buf,IBUF_NUMINTS,rs->world_rank,TA_RESERVE_RESP);
+        /* since exhaustion, do NOT alter times for total_time_on_rq */
+        rq_delete(rq_node);
+        /* exhausted_flag = 0; */  /* leave it set here */
+        /* done, so not dealing with periodic stats right now */
+    }
+}
+
+/* only sent when use_dbg_prints = 1 */
+static void handle_ss_dbg_timing_msg(int from_rank, int from_tag, MPI_Status *status)
+{
+    int k, iq_slot;
+    double dbls_info_buf[IBUF_NUMDBLS], *dbls_temp_buf, temp_dbl, prev_dbg_msg_timelen;
+    char dbg_print_buf[4096];
+#   ifdef DEBUGGING_BGX
+    int i;
+    char dbg_temp_buf[512];
+#   endif
+
+    num_ss_msgs_handled_since_logatds++;
+    server_recv(dbls_info_buf,IBUF_NUMDBLS,MPI_DOUBLE,status);
+    if (my_world_rank == master_server_rank)
+    {
+        prev_dbg_msg_timelen = MPI_Wtime() - prev_dbg_msg_start;
+        aprintf(1111,"DBG4: %f %f\n",prev_dbg_msg_timelen,dbg_prev_qmstat_timelen);
+        dbg_msg_is_out = 0;
+        server_timer_arm(ADLB_TIMER_DBG_TIMING,
+                         prev_dbg_msg_start+server_timers[ADLB_TIMER_DBG_TIMING].interval);
+    }
+    else
+    {
+#       ifdef DEBUGGING_BGX
+        k = GetUnexpectedRequestCount();
+#       else
+#       ifdef DEBUGGING_SICORTEX
+        k = MPIDI_Debug_early_queue_length();
+#       else
+        k = 0;
+#       endif
+#       endif
+        if ((MPI_Wtime() - dbls_info_buf[1]) > 1.0)
+        {
+            temp_dbl = MPI_Wtime();
+            /* print loop time so far, hop time, unexpected queue count */
+            sprintf(dbg_print_buf,"%f %f %d ",
+                    temp_dbl-dbls_info_buf[0],temp_dbl-dbls_info_buf[1],k);
+#           ifdef DEBUGGING_BGX
+            strcat(dbg_print_buf," ; ");
+            GetUnexpectedRequestTagsInDBGTagsBuf(dbg_unexpected_by_tag);
+            for (i=0; i < 50; i++)
             {
-#               ifdef DEBUGGING_BGX
-                k = GetUnexpectedRequestCount();
-#               else
-#               ifdef DEBUGGING_SICORTEX
-                k = MPIDI_Debug_early_queue_length();
-#               else
-                k = 0;
-#               endif
-#               endif
-                if ((MPI_Wtime() - dbls_info_buf[1]) > 1.0)
+                if (dbg_unexpected_by_tag[i] > 0)
                 {
-                    temp_dbl = MPI_Wtime();
-                    /* print loop time so far, hop time, unexpected queue count */
-                    sprintf(dbg_print_buf,"%f %f %d ",
-                            temp_dbl-dbls_info_buf[0],temp_dbl-dbls_info_buf[1],k);
-#                   ifdef DEBUGGING_BGX
-                    strcat(dbg_print_buf," ; ");
-                    GetUnexpectedRequestTagsInDBGTagsBuf(dbg_unexpected_by_tag);
-                    for (i=0; i < 50; i++)
-                    {
-                        if (dbg_unexpected_by_tag[i] > 0)
-                        {
-                            sprintf(dbg_temp_buf,"%d:%d ",i+1000,dbg_unexpected_by_tag[i]);
-                            strcat(dbg_print_buf,dbg_temp_buf);
-                        }
-                    }
-                    for (i=0; i < 50; i++)
-                        dbg_unexpected_by_tag[i] = 0;
-#                   endif
-                    aprintf(1111,"DBG7: %s\n",dbg_print_buf);
+                    sprintf(dbg_temp_buf,"%d:%d ",i+1000,dbg_unexpected_by_tag[i]);
+                    strcat(dbg_print_buf,dbg_temp_buf);
                 }
-                dbls_temp_buf    = amalloc(IBUF_NUMDBLS * sizeof(double));
-                dbls_temp_buf[0] = dbls_info_buf[0];  /* loop start time */
-                dbls_temp_buf[1] = MPI_Wtime();       /* hop  start time */
-                temp_req = amalloc(sizeof(MPI_Request));
-                rc = MPI_Isend(dbls_temp_buf,IBUF_NUMDBLS,MPI_DOUBLE,rhs_rank,SS_DBG_TIMING_MSG,
-                               adlb_all_comm,temp_req);
-                iq_node = iq_node_create(temp_req, IBUF_NUMDBLS*sizeof(double), dbls_temp_buf);
-                iq_append(iq_node);
             }
+            for (i=0; i < 50; i++)
+                dbg_unexpected_by_tag[i] = 0;
+#           endif
+            aprintf(1111,"DBG7: %s\n",dbg_print_buf);
         }
-        else if (from_tag == SS_QMSTAT)
-        {
-            num_ss_msgs_handled_since_logatds++;
-            aprintf(0000, "AT SS_QMSTAT from %06d\n",from_rank);
-            /****
-            qmstat_buf = amalloc(qmstat_buflen);
-            MPI_Recv(qmstat_buf,qmstat_buflen,MPI_PACKED,from_rank,
-                     SS_QMSTAT,adlb_all_comm,&status);
-            ****/
-            nqmstatmsgs++;
-            update_local_state();  // perhaps not nec here
-            /* backup my entry */
-            server_idx = get_server_idx(my_world_rank);
-            temp_qm.qlen_unpin_untarg = qmstat_tbl[server_idx].qlen_unpin_untarg;
-            temp_qm.nbytes_used   = qmstat_tbl[server_idx].nbytes_used;
-            for (i=0; i < num_types; i++)
-                temp_qm.type_hi_prio[i] = qmstat_tbl[server_idx].type_hi_prio[i];
-            /* unpack */
-            unpack_qmstat();  /* from qmstat_recv_buf into qmstat_tbl */
-            /* restore my entry */
-            qmstat_tbl[server_idx].qlen_unpin_untarg = temp_qm.qlen_unpin_untarg;
-            qmstat_tbl[server_idx].nbytes_used = temp_qm.nbytes_used;
-            for (i=0; i < num_types; i++)
-                qmstat_tbl[server_idx].type_hi_prio[i] = temp_qm.type_hi_prio[i];
-            /* */
-            // dump_qmstat_info();
-            if (my_world_rank == master_server_rank)
+        dbls_temp_buf    = amalloc(IBUF_NUMDBLS * sizeof(double));
+        dbls_temp_buf[0] = dbls_info_buf[0];  /* loop start time */
+        dbls_temp_buf[1] = MPI_Wtime();       /* hop  start time */
+        iq_slot = iq_slot_create(IBUF_NUMDBLS*sizeof(double), dbls_temp_buf);
+        MPI_Isend(dbls_temp_buf,IBUF_NUMDBLS,MPI_DOUBLE,rhs_rank,SS_DBG_TIMING_MSG,
+                  adlb_tel_comm,iq_req(iq_slot));
+    }
+}
+
+static void handle_ss_qmstat(int from_rank, int from_tag, MPI_Status *status)
+{
+    int i, server_idx, iq_slot;
+    double temp_dbl;
+
+    num_ss_msgs_handled_since_logatds++;
+    aprintf(0000, "AT SS_QMSTAT from %06d\n",from_rank);
+    /****
+    qmstat_buf = amalloc(qmstat_buflen);
+    MPI_Recv(qmstat_buf,qmstat_buflen,MPI_PACKED,from_rank,
+             SS_QMSTAT,adlb_all_comm,status);
+    ****/
+    nqmstatmsgs++;
+    update_local_state();  // perhaps not nec here
+    /* backup my entry */
+    server_idx = get_server_idx(my_world_rank);
+    temp_qm.qlen_unpin_untarg = qmstat_tbl[server_idx].qlen_unpin_untarg;
+    temp_qm.nbytes_used   = qmstat_tbl[server_idx].nbytes_used;
+    for (i=0; i < num_types; i++)
+        temp_qm.type_hi_prio[i] = qmstat_tbl[server_idx].type_hi_prio[i];
+    /* unpack */
+    unpack_qmstat();  /* from qmstat_recv_buf into qmstat_tbl */
+    /* restore my entry */
+    qmstat_tbl[server_idx].qlen_unpin_untarg = temp_qm.qlen_unpin_untarg;
+    qmstat_tbl[server_idx].nbytes_used = temp_qm.nbytes_used;
+    for (i=0; i < num_types; i++)
+        qmstat_tbl[server_idx].type_hi_prio[i] = temp_qm.type_hi_prio[i];
+    /* */
+    // dump_qmstat_info();
+    if (my_world_rank == master_server_rank)
+    {
+        temp_dbl = MPI_Wtime() - prev_qmstat_msg_time;
+        dbg_prev_qmstat_timelen = temp_dbl;
+        if (temp_dbl > 5.0)
+            aprintf(1,"one long qmstat trip time was %f\n",temp_dbl);
+        if (temp_dbl > server_timers[ADLB_TIMER_QMSTAT].interval)
+            num_qmstats_exceeded_interval++;
+        sum_of_qmstat_trip_times += temp_dbl;
+        if (temp_dbl > max_qmstat_trip_time)
+            max_qmstat_trip_time = temp_dbl;
+        qmstat_msg_is_out = 0;
+        server_timer_arm(ADLB_TIMER_QMSTAT,
+                         prev_qmstat_msg_time+server_timers[ADLB_TIMER_QMSTAT].interval);
+    }
+    else
+    {
+        qmstat_send_buf = amalloc(qmstat_buflen);
+        pack_qmstat();    /* pack ALL info from qmstat_tbl into qmstat_send_buf */
+        iq_slot = iq_slot_create(qmstat_buflen,qmstat_send_buf);
+        MPI_Isend(qmstat_send_buf,qmstat_buflen,MPI_PACKED,server_comm_rhs,SS_QMSTAT,
+                  adlb_server_comm,iq_req(iq_slot));
+        // qmstat_isend_node_ptr = iq_node;
+    }
+    check_remote_work_for_queued_apps();
+    aprintf(0000, "PAST SS_QMSTAT\n");
+}
+
+static void handle_fa_local_app_done(int from_rank, int from_tag, MPI_Status *status)
+{
+    int info_buf[IBUF_NUMINTS], iq_slot;
+
+    aprintf(0000, "AT FA_LOCAL_APP_DONE from %06d\n",from_rank);
+    server_recv(info_buf,0,MPI_INT,status);
+    if (using_debug_server)
+        num_events_since_logatds++;
+    num_local_apps_done++;
+    if (num_local_apps_done >= num_apps_this_server)
+    {
+        if (my_world_rank == master_server_rank)
+        {
+            if (num_servers == 1)
             {
-                temp_dbl = MPI_Wtime() - prev_qmstat_msg_time;
-                dbg_prev_qmstat_timelen = temp_dbl;
-                if (temp_dbl > 5.0)
-                    aprintf(1,"one long qmstat trip time was %f\n",temp_dbl);
-                if (temp_dbl > qmstat_interval)
-                    num_qmstats_exceeded_interval++;
-                sum_of_qmstat_trip_times += temp_dbl;
-                if (temp_dbl > max_qmstat_trip_time)
-                    max_qmstat_trip_time = temp_dbl;
-                qmstat_msg_is_out = 0;
+                server_done = 1;
+                if (using_debug_server)
+                {
+                    MPI_Issend(info_buf,0,MPI_INT,debug_server_rank,
+                               DS_END,adlb_tel_comm,&dummy_req);
+                }
             }
             else
             {
-                qmstat_send_buf = amalloc(qmstat_buflen);
-                pack_qmstat();    /* pack ALL info from qmstat_tbl into qmstat_send_buf */
-                temp_req = amalloc(sizeof(MPI_Request));
-                rc = MPI_Isend(qmstat_send_buf,qmstat_buflen,MPI_PACKED,server_comm_rhs,SS_QMSTAT,
-                               adlb_server_comm,temp_req);
-                iq_node = iq_node_create(temp_req,qmstat_buflen,qmstat_send_buf);
-                iq_append(iq_node);
-                // qmstat_isend_node_ptr = iq_node;
+                holding_end_loop_1 = 0;
+                iq_slot = iq_slot_create(0,NULL);
+                MPI_Issend(info_buf,0,MPI_INT,rhs_rank,
+                           SS_END_LOOP_1,adlb_bal_comm,iq_req(iq_slot));
             }
-            check_remote_work_for_queued_apps();
-            aprintf(0000, "PAST SS_QMSTAT\n");
         }
-        else if (from_tag == FA_LOCAL_APP_DONE)
+        else
         {
-            aprintf(0000, "AT FA_LOCAL_APP_DONE from %06d\n",from_rank);
-            MPI_Recv(info_buf,0,MPI_INT,from_rank,FA_LOCAL_APP_DONE,adlb_all_comm,&status);
-            if (using_debug_server)
-                num_events_since_logatds++;
-            num_local_apps_done++;
-            if (num_local_apps_done >= num_apps_this_server)
+            if (holding_end_loop_1)
             {
-                if (my_world_rank == master_server_rank)
-                {
-                    if (num_servers == 1)
-                    {
-                        done = 1;
-                        if (using_debug_server)
-                        {
-                            rc = MPI_Issend(info_buf,0,MPI_INT,debug_server_rank,
-                                            DS_END,adlb_all_comm,&dummy_req);
-                        }
-                    }
-                    else
-                    {
-                        holding_end_loop_1 = 0;
-                        temp_req = amalloc(sizeof(MPI_Request));
-                        rc = MPI_Issend(info_buf,0,MPI_INT,rhs_rank,
-                                        SS_END_LOOP_1,adlb_all_comm,temp_req);
-                        iq_node = iq_node_create(temp_req,0,NULL);
-                        iq_append(iq_node);
-                    }
-                }
-                else
-                {
-                    if (holding_end_loop_1)
-                    {
-                        holding_end_loop_1 = 0;
-                        temp_req = amalloc(sizeof(MPI_Request));
-                        rc = MPI_Issend(info_buf,0,MPI_INT,rhs_rank,
-                                        SS_END_LOOP_1,adlb_all_comm,temp_req);
-                        iq_node = iq_node_create(temp_req,0,NULL);
-                        iq_append(iq_node);
-                    }
-                }
+                holding_end_loop_1 = 0;
+                iq_slot = iq_slot_create(0,NULL);
+                MPI_Issend(info_buf,0,MPI_INT,rhs_rank,
+                           SS_END_LOOP_1,adlb_bal_comm,iq_req(iq_slot));
             }
         }
-        else if (from_tag == SS_RFR)
+    }
+}
+
+static void handle_ss_rfr(int from_rank, int from_tag, MPI_Status *status)
+{
+    int j, orig_rqseqno, for_rank, *req_types, num_req_types, prev_target, *temp_buf,
+        *rfr_buf, rfr_nints, iq_slot;
+    xq_node_t *wq_node;
+    wq_struct_t *ws;
+
+    nrfrs_recvd++;
+    num_ss_msgs_handled_since_logatds++;
+    rfr_buf = recv_ints(status,RFR_HDR_NUMINTS+1,&rfr_nints);
+    orig_rqseqno  = rfr_buf[0];
+    for_rank      = rfr_buf[1];  // new for PTW immediately below
+    req_types     = &rfr_buf[RFR_HDR_NUMINTS];
+    num_req_types = rfr_nints - RFR_HDR_NUMINTS;
+    if (use_dbg_prints)
+        for (j=0; j < num_req_types  &&  j < 10010; j++)
+            if (req_types[j] >= 0)
+                dbg_rfr_attempts_by_type[j]++;
+    // aprintf(0000, "AT SS_RFR from %d rqseqno %d\n",from_rank,orig_rqseqno);
+    // PTW:  now need to check for targeted on this remote system as well
+    req_mask_build(req_mask,num_req_types,req_types);
+    wq_node = wq_find_pre_targeted_hi_prio(for_rank,req_mask);
+    if ( ! wq_node)
+        wq_node = wq_find_hi_prio(req_mask);  /* does NOT find targeted */
+    // aprintf(0000,"SS_RFR from %d  for %d  wqnode %p\n",from_rank,for_rank,wq_node);
+    if (wq_node)
+    {
+        ws = wq_node->data;
+        prev_target = ws->target_rank;  // new with PTW
+        wq_pin(wq_node,for_rank);
+        temp_buf    = amalloc(RFR_RESP_NUMINTS * sizeof(int));
+        temp_buf[0] = SUCCESS;
+        temp_buf[1] = orig_rqseqno;
+        temp_buf[2] = for_rank;
+        temp_buf[3] = ws->work_type;
+        temp_buf[4] = ws->work_prio;
+        temp_buf[5] = ws->work_len;
+        temp_buf[6] = ws->answer_rank;
+        temp_buf[7] = ws->wqseqno;
+        temp_buf[8] = prev_target;  /* new with PTW */
+        temp_buf[9]  = ws->common_len;
+        temp_buf[10] = ws->common_server_rank;
+        temp_buf[11] = ws->common_server_commseqno;
+        aprintf(0000,"SENDING RFR_RESP to %d wqseqno %d\n",from_rank,ws->wqseqno);
+        iq_slot = iq_slot_create((RFR_RESP_NUMINTS * sizeof(int)),temp_buf);
+        MPI_Isend(temp_buf,RFR_RESP_NUMINTS,MPI_INT,from_rank,SS_RFR_RESP,
+                  adlb_bal_comm,iq_req(iq_slot));
+    }
+    else
+    {
+        temp_buf    = amalloc((3+num_req_types) * sizeof(int));
+        temp_buf[0] = NO_CURR_WORK;
+        temp_buf[1] = orig_rqseqno;
+        temp_buf[2] = for_rank;
+        for (j=0; j < num_req_types; j++)
+            temp_buf[3+j] = req_types[j];
+        aprintf(0000,"SENDING RFR_RESP to rank %06d  rc -2\n",from_rank);
+        iq_slot = iq_slot_create(((3+num_req_types) * sizeof(int)),temp_buf);
+        MPI_Isend(temp_buf,3+num_req_types,MPI_INT,from_rank,SS_RFR_RESP,
+                  adlb_bal_comm,iq_req(iq_slot));
+        /* assume I previously had work that they are seeking and send an update */
+        update_local_state();
+    }
+    aprintf(0000, "PAST SS_RFR from %06d found_wqnode %p\n",from_rank,wq_node);
+}
+
+static void handle_ss_rfr_resp(int from_rank, int from_tag, MPI_Status *status)
+{
+    int i, rc, info_buf[IBUF_NUMINTS], type_idx, orig_rqseqno, server_idx, cand_rank,
+        for_rank, *temp_buf, *rfr_buf, rfr_nints, iq_slot;
+    xq_node_t *rq_node, *tq_node;
+    rq_struct_t *rs;
+    tq_struct_t *ts;
+
+    num_ss_msgs_handled_since_logatds++;
+    /* room to expand a wildcard failure into all types below */
+    rfr_buf = recv_ints(status,
+                        ((RFR_RESP_NUMINTS > 3+num_types) ? RFR_RESP_NUMINTS : 3+num_types),
+                        &rfr_nints);
+    rc           = rfr_buf[0];
+    orig_rqseqno = rfr_buf[1];
+    for_rank     = rfr_buf[2];
+    // cblog(1,info_buf[3],"  RFR_RESP for me from %d ty %d rc %d\n",
+          // from_rank,orig_req_type,rc);
+    rfr_to_rank[for_rank] = -1;  /* no longer has an outstanding rfr */
+    rfr_out[from_rank] = 0;
+    if (rc == SUCCESS)
+    {
+        aprintf(0000, "AT SS_RFR_RESP from %d for %d rqseqno %d\n",
+                from_rank,for_rank,orig_rqseqno);
+        rq_node = rq_find_seqno(orig_rqseqno);
+        if (rq_node)
         {
-            nrfrs_recvd++;
-            num_ss_msgs_handled_since_logatds++;
-            MPI_Recv(rfr_buf,RFRBUF_NUMINTS,MPI_INT,from_rank,SS_RFR,adlb_all_comm,&status);
-            orig_rqseqno = rfr_buf[0];
-            for_rank     = rfr_buf[1];  // new for PTW immediately below
-            for (j=0; j < REQ_TYPE_VECT_SZ; j++)
-                req_types[j] = rfr_buf[2+j];
-            if (use_dbg_prints)
-                for (j=0; j < REQ_TYPE_VECT_SZ; j++)
-                    if (req_types[j] >= 0)
-                        dbg_rfr_attempts_by_type[j]++;
-            // aprintf(0000, "AT SS_RFR from %d rqseqno %d\n",from_rank,orig_rqseqno);
-            // PTW:  now need to check for targeted on this remote system as well
-            wq_node = wq_find_pre_targeted_hi_prio(for_rank,req_types);
-            if ( ! wq_node)
-                wq_node = wq_find_hi_prio(req_types);  /* does NOT find targeted */
-            // aprintf(0000,"SS_RFR from %d  for %d  wqnode %p\n",from_rank,for_rank,wq_node);
-            if (wq_node)
+            rs = rq_node->data;
+            /* CAREFULLY move values up in info_buf */
+            info_buf[0] = SUCCESS;
+            info_buf[1] = rfr_buf[3];  /* work_type */
+            info_buf[2] = rfr_buf[4];  /* work_prio */
+            info_buf[3] = rfr_buf[5];  /* work_len */
+            info_buf[4] = rfr_buf[6];  /* answer_rank */
+            info_buf[5] = rfr_buf[7];  /* wqseqno */
+            info_buf[6] = from_rank;
+            /* rfr_buf[8]  (prev_target) is used below */
+            info_buf[7] = rfr_buf[9];  /* common_len */
+            info_buf[8] = rfr_buf[10]; /* common_server_rank */
+            info_buf[9] = rfr_buf[11]; /* common_server_commseqno */
+            aprintf(0000,"SS_RFR_RESP: SENDING RESERVATION to rank %06d\n",rs->world_rank);
+            isend_ints(info_buf,IBUF_NUMINTS,rs->world_rank,TA_RESERVE_RESP);
+            if (use_dbg_prints  &&  (MPI_Wtime() - rs->time_stamp) > DBG_CHECK_TIME)
             {
-                ws = wq_node->data;
-                prev_target = ws->target_rank;  // new with PTW
-                ws->pin_rank = for_rank;
-                if (ws->pin_rank >= 0)
-                    ws->pinned = 1;
-                temp_buf    = amalloc(RFRBUF_NUMINTS * sizeof(int));
-                temp_buf[0] = SUCCESS;
-                temp_buf[1] = orig_rqseqno;
-                temp_buf[2] = for_rank;
-                temp_buf[3] = ws->work_type;
-                temp_buf[4] = ws->work_prio;
-                temp_buf[5] = ws->work_len;
-                temp_buf[6] = ws->answer_rank;
-                temp_buf[7] = ws->wqseqno;
-                temp_buf[8] = prev_target;  /* new with PTW */
-                temp_buf[9]  = ws->common_len;
-                temp_buf[10] = ws->common_server_rank;
-                temp_buf[11] = ws->common_server_commseqno;
-                temp_req = amalloc(sizeof(MPI_Request));
-                aprintf(0000,"SENDING RFR_RESP to %d wqseqno %d\n",from_rank,ws->wqseqno);
-                MPI_Isend(temp_buf,RFRBUF_NUMINTS,MPI_INT,from_rank,SS_RFR_RESP,
-                          adlb_all_comm,temp_req);
-                iq_node = iq_node_create(temp_req,(RFRBUF_NUMINTS * sizeof(int)),temp_buf);
-                iq_append(iq_node);
+                aprintf(0000,"DBG3: rfr %d %f -1.0 %d %d\n",
+                        rs->rqseqno,MPI_Wtime()-rs->time_stamp,
+                        rs->world_rank,info_buf[1]);
             }
+            if (first_time_on_rq[rs->world_rank])
+                first_time_on_rq[rs->world_rank] = 0;
             else
             {
-                temp_buf    = amalloc(RFRBUF_NUMINTS * sizeof(int));
-                temp_buf[0] = NO_CURR_WORK;
-                temp_buf[1] = orig_rqseqno;
-                temp_buf[2] = for_rank;
-                for (j=0; j < REQ_TYPE_VECT_SZ; j++)
-                    temp_buf[3+j] = rfr_buf[2+j];
-                temp_req    = amalloc(sizeof(MPI_Request));
-                aprintf(0000,"SENDING RFR_RESP to rank %06d  rc -2\n",from_rank);
-                MPI_Isend(temp_buf,RFRBUF_NUMINTS,MPI_INT,from_rank,SS_RFR_RESP,
-                          adlb_all_comm,temp_req);
-                iq_node = iq_node_create(temp_req, (RFRBUF_NUMINTS * sizeof(int)),temp_buf);
-                iq_append(iq_node);
-                /* assume I previously had work that they are seeking and send an update */
-                update_local_state();
+                total_time_on_rq += (MPI_Wtime() - rs->time_stamp);
+                num_rq_nodes_timed++;
             }
-            aprintf(0000, "PAST SS_RFR from %06d found_wqnode %p\n",from_rank,wq_node);
-        }
-        else if (from_tag == SS_RFR_RESP)
-        {
-            num_ss_msgs_handled_since_logatds++;
-            MPI_Recv(rfr_buf,RFRBUF_NUMINTS,MPI_INT,from_rank,SS_RFR_RESP,
-                     adlb_all_comm,&status);
-            rc           = rfr_buf[0];
-            orig_rqseqno = rfr_buf[1];
-            for_rank     = rfr_buf[2];
-            // cblog(1,info_buf[3],"  RFR_RESP for me from %d ty %d rc %d\n",
-                  // from_rank,orig_req_type,rc);
-            rfr_to_rank[for_rank] = -1;  /* no longer has an outstanding rfr */
-            rfr_out[from_rank] = 0;
-            if (rc == SUCCESS)
+            if (doing_periodic_stats)
             {
-                aprintf(0000, "AT SS_RFR_RESP from %d for %d rqseqno %d\n",
-                        from_rank,for_rank,orig_rqseqno);
-                rq_node = rq_find_seqno(orig_rqseqno);
-                if (rq_node)
-                {
-                    rs = rq_node->data;
-                    /* CAREFULLY move values up in info_buf */
-                    info_buf[0] = SUCCESS;
-                    info_buf[1] = rfr_buf[3];  /* work_type */
-                    info_buf[2] = rfr_buf[4];  /* work_prio */
-                    info_buf[3] = rfr_buf[5];  /* work_len */
-                    info_buf[4] = rfr_buf[6];  /* answer_rank */
-                    info_buf[5] = rfr_buf[7];  /* wqseqno */
-                    info_buf[6] = from_rank;
-                    /* rfr_buf[8]  (prev_target) is used below */
-                    info_buf[7] = rfr_buf[9];  /* common_len */
-                    info_buf[8] = rfr_buf[10]; /* common_server_rank */
-                    info_buf[9] = rfr_buf[11]; /* common_server_commseqno */
-                    aprintf(0000,"SS_RFR_RESP: SENDING RESERVATION to rank %06d\n",rs->world_rank);
-                    MPI_Ssend(info_buf,IBUF_NUMINTS,MPI_INT,rs->world_rank,
-                              TA_RESERVE_RESP,adlb_all_comm);
-                    if (use_dbg_prints  &&  (MPI_Wtime() - rs->time_stamp) > DBG_CHECK_TIME)
-                    {
-                        aprintf(0000,"DBG3: rfr %d %f -1.0 %d %d\n",
-                                rs->rqseqno,MPI_Wtime()-rs->time_stamp,
-                                rs->world_rank,info_buf[1]);
-                    }
-                    if (first_time_on_rq[rs->world_rank])
-                        first_time_on_rq[rs->world_rank] = 0;
-                    else
-                    {
-                        total_time_on_rq += (MPI_Wtime() - rs->time_stamp);
-                        num_rq_nodes_timed++;
-                    }
-                    if (doing_periodic_stats)
-                    {
-                        for (i=0; i < num_types; i++)
-                        {
-                            if (i == 0  && rs->req_types[i] < 0)  /* if wild card */
-                                type_idx = num_types;
-                            else if (rs->req_types[i] >= 0)  /* user type */
-                                type_idx = get_type_idx(rs->req_types[i]);
-                            else    /* list terminator */
-                                break;
-                            if (type_idx < 0) aprintf(1,"** invalid type\n");
-                            periodic_rq_vector[type_idx]--;
-                        }
-                        periodic_rq_vector[num_types+1] = rq->count - 1; /* deleting */
-                        type_idx = get_type_idx(rfr_buf[3]);
-                        if (type_idx < 0) aprintf(1,"** invalid type\n");
-                        periodic_resolved_reserve_cnt[type_idx]++;
-                    }
-                    rq_delete(rq_node);
-                    exhausted_flag = 0;
-                    if (for_rank == rfr_buf[8])  /* if for_rank is also target rank */
-                    {
-                        tq_node = tq_find_rtr(for_rank,rfr_buf[3],from_rank);
-                        if (tq_node)
-                        {
-                            ts = tq_node->data;
-                            ts->num_stored--;
-                            if (ts->num_stored <= 0)
-                            {
-                                tq_delete(tq_node);
-                            }
-                        }
-                    }
-                }
-                else
+                for (i=0; i < rs->num_req_types; i++)
                 {
-                    /* OK; a PUT may have caused this rqseqno to be deleted earlier */
-                    /*  but, now need to un-reserve at remote server */
-                    temp_buf    = amalloc(IBUF_NUMINTS * sizeof(int));
-                    temp_buf[0] = for_rank;     /* reserved-for rank */
-                    temp_buf[1] = rfr_buf[7];  /* wqseqno on remote server */
-                    temp_buf[2] = rfr_buf[8];  /* prev_target on remote host */  // new with PTW
-                    temp_req    = amalloc(sizeof(MPI_Request));
-                    aprintf(0000,"SENDING UNRESERVE to %06d  forrank %d wqseqno %d\n",from_rank,rfr_buf[3],rfr_buf[8]);
-                    MPI_Isend(temp_buf,IBUF_NUMINTS,MPI_INT,from_rank,SS_UNRESERVE,
-                              adlb_all_comm,temp_req);
-                    iq_node = iq_node_create(temp_req, (IBUF_NUMINTS * sizeof(int)),temp_buf);
-                    iq_append(iq_node);
+                    if (i == 0  && rs->req_types[i] < 0)  /* if wild card */
+                        type_idx = num_types;
+                    else if (rs->req_types[i] >= 0)  /* user type */
+                        type_idx = get_type_idx(rs->req_types[i]);
+                    else    /* list terminator */
+                        break;
+                    if (type_idx < 0) aprintf(1,"** invalid type\n");
+                    periodic_rq_vector[type_idx]--;
                 }
-                check_remote_work_for_queued_apps();  /* may do another rfr for for_rank */
+                periodic_rq_vector[num_types+1] = rq->count - 1; /* deleting */
+                type_idx = get_type_idx(rfr_buf[3]);
+                if (type_idx < 0) aprintf(1,"** invalid type\n");
+                periodic_resolved_reserve_cnt[type_idx]++;
             }
-            else
+            rq_delete(rq_node);
+            exhausted_flag = 0;
+            if (for_rank == rfr_buf[8])  /* if for_rank is also target rank */
             {
-                aprintf(0000,"RECVD SS_RFR_RESP from %06d rc %d\n",from_rank,rc);
-                if (using_debug_server)
-                    num_rfr_failed_since_logatds++;
-                server_idx  = get_server_idx(from_rank);
-                /* setup to patch status vector and tq; if wildcard, do all types */
-                if (rfr_buf[3] < 0)  /* if wild card */
-                {
-                    for (i=0; i < num_types; i++)
-                        rfr_buf[3+i] = user_types[i];
-                    rfr_buf[3+i] = -1;
-                }
-                /* patch status vector and tq */
-                for (i=3; i < 3+REQ_TYPE_VECT_SZ && rfr_buf[i] >= 0; i++)
-                {
-                    /* patch status vector */
-                    type_idx = get_type_idx(rfr_buf[i]);
-                    if (type_idx < 0) aprintf(1,"** invalid type\n");
-                    qmstat_tbl[server_idx].type_hi_prio[type_idx] = ADLB_LOWEST_PRIO;
-
-                    /* patch tq if nec */
-                    for (tq_node=xq_first(tq); tq_node; tq_node=xq_next(tq,tq_node))
-                    {
-                        ts = tq_node->data;
-                        if (ts->app_rank == for_rank             &&
-                            ts->remote_server_rank == from_rank  &&
-                            ts->work_type == rfr_buf[i])
-                        {
-                            ts->num_stored--; /* can NOT delete now; do below */
-                            if (ts->num_stored <= 0)
-                            {
-                                tq_prev = tq_node->prev;
-                                tq_delete(tq_node);
-                                tq_node = tq_prev;
-                            }
-                            num_tq_nodes_fixed++;
-                        }
-                    }
-                }
-
-                rq_node = rq_find_seqno(orig_rqseqno);
-                if (rq_node)
+                tq_node = tq_find_rtr(for_rank,rfr_buf[3],from_rank);
+                if (tq_node)
                 {
-                    rs = rq_node->data;  /* grab it again */
-                    for (i=0; i < REQ_TYPE_VECT_SZ; i++)
+                    ts = tq_node->data;
+                    ts->num_stored--;
+                    if (ts->num_stored <= 0)
                     {
-                        if (rs->req_types[i] < -1)  /* invalid type as place-holder */
-                            break;
-                        cand_rank = find_cand_rank_with_worktype(rs->world_rank,rs->req_types[i]);
-                        if (cand_rank >= 0)
-                        {
-                            temp_buf    = amalloc(RFRBUF_NUMINTS * sizeof(int));
-                            temp_buf[0] = orig_rqseqno;
-                            temp_buf[1] = rs->world_rank;
-                            for (j=0; j < REQ_TYPE_VECT_SZ; j++)
-                                temp_buf[2+j] = rs->req_types[j];
-                            temp_req    = amalloc(sizeof(MPI_Request));
-                            aprintf(0000,"REQING from alt rqseqno %d fromrank %d\n",
-                                    orig_rqseqno,cand_rank);
-                            // cblog(1,rs->world_rank,"  REQING from alt %d ty %d\n",
-                                  // cand_rank,rs->req_types[i]);
-                            MPI_Isend(temp_buf,RFRBUF_NUMINTS,MPI_INT,cand_rank,SS_RFR,
-                                      adlb_all_comm,temp_req);
-                            iq_node = iq_node_create(temp_req,(RFRBUF_NUMINTS * sizeof(int)),
-                                                     temp_buf);
-                            iq_append(iq_node);
-                            rfr_to_rank[rs->world_rank] = cand_rank;
-                            rfr_out[cand_rank] = 1;
-                            nrfrs_sent++;
-                            if (use_dbg_prints)
-                                dbg_rfr_sent_cnt[rs->world_rank]++;
-                            break;
-                        }
+                        tq_delete(tq_node);
                     }
                 }
-                else
-                {
-                    /* OK; a PUT may have caused this rqseqno to be deleted earlier */
-                    /* aprintf(1,"** INVALID STATE; rqseqno %d not found\n",orig_rqseqno); */
-                }
-                check_remote_work_for_queued_apps();  /* may do another rfr for for_rank */
             }
-            aprintf(0000, "PAST SS_RFR_RESP\n");
         }
-        else if (from_tag == SS_UNRESERVE)
+        else
         {
-            num_ss_msgs_handled_since_logatds++;
-            MPI_Recv(info_buf,IBUF_NUMINTS,MPI_INT,from_rank,SS_UNRESERVE,
-                     adlb_all_comm,&status);
-            aprintf(0000, "AT UNRESERVE from %06d  rrank %d wqseqno %d\n",from_rank,info_buf[0],info_buf[1]);
-            wq_node = wq_find_pinned_for_rank(info_buf[0],info_buf[1]);  /* rank,wqseqno */
-            if (wq_node)
-            {
-                ws = wq_node->data;
-                ws->pin_rank = info_buf[2];  /* may be -1 */
-                ws->pinned = 0; // PTW: UNcomment to support pushing targeted work
-            }
-            else
-            {
-                aprintf(1, "** UNRESERVE did not find rank %d wqseqno %d from %06d\n",
-                        info_buf[0],info_buf[1],from_rank);
-            }
-            aprintf(0000, "PAST UNRESERVE from %06d\n",from_rank);
+            /* OK; a PUT may have caused this rqseqno to be deleted earlier */
+            /*  but, now need to un-reserve at remote server */
+            temp_buf    = amalloc(IBUF_NUMINTS * sizeof(int));
+            temp_buf[0] = for_rank;     /* reserved-for rank */
+            temp_buf[1] = rfr_buf[7];  /* wqseqno on remote server */
+            temp_buf[2] = rfr_buf[8];  /* prev_target on remote host */  // new with PTW
+            aprintf(0000,"SENDING UNRESERVE to %06d  forrank %d wqseqno %d\n",from_rank,rfr_buf[3],rfr_buf[8]);
+            iq_slot = iq_slot_create((IBUF_NUMINTS * sizeof(int)),temp_buf);
+            MPI_Isend(temp_buf,IBUF_NUMINTS,MPI_INT,from_rank,SS_UNRESERVE,
+                      adlb_bal_comm,iq_req(iq_slot));
+        }
+        check_remote_work_for_queued_apps();  /* may do another rfr for for_rank */
+    }
+    else
+    {
+        aprintf(0000,"RECVD SS_RFR_RESP from %06d rc %d\n",from_rank,rc);
+        if (using_debug_server)
+            num_rfr_failed_since_logatds++;
+        server_idx  = get_server_idx(from_rank);
+        /* setup to patch status vector and tq; if wildcard, do all types */
+        if (rfr_buf[3] < 0)  /* if wild card */
+        {
+            for (i=0; i < num_types; i++)
+                rfr_buf[3+i] = user_types[i];
+            rfr_nints = 3 + num_types;
         }
-        else if (from_tag == SS_MOVING_TARGETED_WORK)
+        /* patch status vector and tq */
+        for (i=3; i < rfr_nints && rfr_buf[i] >= 0; i++)
         {
-            num_ss_msgs_handled_since_logatds++;
-            aprintf(0000, "AT MOVING_TARGETED_WORK from %d\n",from_rank);
-            MPI_Recv(info_buf,IBUF_NUMINTS,MPI_INT,from_rank,SS_MOVING_TARGETED_WORK,
-                     adlb_all_comm,&status);
-            tq_node = tq_find_rtr(info_buf[0],info_buf[1],info_buf[2]);
+            /* patch status vector */
+            type_idx = get_type_idx(rfr_buf[i]);
+            if (type_idx < 0) aprintf(1,"** invalid type\n");
+            qmstat_tbl[server_idx].type_hi_prio[type_idx] = ADLB_LOWEST_PRIO;
+
+            /* patch tq if nec */
+            tq_node = tq_find_rtr(for_rank,rfr_buf[i],from_rank);
             if (tq_node)
             {
                 ts = tq_node->data;
                 ts->num_stored--;
                 if (ts->num_stored <= 0)
                     tq_delete(tq_node);
+                num_tq_nodes_fixed++;
             }
-            else
-            {
-                /* this is OK; it just means home_server did the push */
-                aprintf(0,"** couldn't find tq record: %d %d %d ; %d\n",
-                        info_buf[0],info_buf[1],info_buf[2],info_buf[3]);
-            }
-            if (info_buf[3] != my_world_rank)  /* if not put in my wq, update my tq */
+        }
+
+        rq_node = rq_find_seqno(orig_rqseqno);
+        if (rq_node)
+        {
+            rs = rq_node->data;  /* grab it again */
+            for (i=0; i < rs->num_req_types; i++)
             {
-                tq_node = tq_find_rtr(info_buf[0],info_buf[1],info_buf[3]);
-                if (tq_node)
-                {
-                    ts = tq_node->data;
-                    ts->num_stored++;
-                }
-                else
+                cand_rank = find_cand_rank_with_worktype(rs->world_rank,rs->req_types[i]);
+                if (cand_rank >= 0)
                 {
-                    tq_node = tq_node_create(info_buf[0],info_buf[1],info_buf[3],1);
-                    tq_append(tq_node);
-                    ts = tq_node->data;
+                    aprintf(0000,"REQING from alt rqseqno %d fromrank %d\n",
+                            orig_rqseqno,cand_rank);
+                    // cblog(1,rs->world_rank,"  REQING from alt %d ty %d\n",
+                          // cand_rank,rs->req_types[i]);
+                    send_rfr(cand_rank,rs);
+                    rfr_to_rank[rs->world_rank] = cand_rank;
+                    rfr_out[cand_rank] = 1;
+                    nrfrs_sent++;
+                    if (use_dbg_prints)
+                        dbg_rfr_sent_cnt[rs->world_rank]++;
+                    break;
                 }
             }
-            check_remote_work_for_queued_apps();  /* make sure no one is waiting for this */
-            aprintf(0000, "PAST MOVING_TARGETED_WORK from %06d\n",from_rank);
-        }
-        else if (from_tag == SS_PUSH_QUERY)
-        {
-            num_ss_msgs_handled_since_logatds++;
-            aprintf(0000, "AT SS_PUSH_QUERY from %06d\n",from_rank);
-            MPI_Recv(dbls_info_buf,IBUF_NUMDBLS,MPI_DOUBLE,from_rank,SS_PUSH_QUERY,
-                     adlb_all_comm,&status);
-            work_type    = (int) dbls_info_buf[0];
-            work_prio    = (int) dbls_info_buf[1];
-            work_len     = (int) dbls_info_buf[2];
-            answer_rank  = (int) dbls_info_buf[3];
-            /* remaining dbls_info_buf[x] used below */
-
-            dbls_temp_buf = amalloc(IBUF_NUMDBLS * sizeof(double));
-            if ((curr_bytes_dmalloced+work_len) >= THRESHOLD_TO_START_PUSH)
+        }
+        else
+        {
+            /* OK; a PUT may have caused this rqseqno to be deleted earlier */
+            /* aprintf(1,"** INVALID STATE; rqseqno %d not found\n",orig_rqseqno); */
+        }
+        check_remote_work_for_queued_apps();  /* may do another rfr for for_rank */
+    }
+    aprintf(0000, "PAST SS_RFR_RESP\n");
+}
+
+/* also handles FA_UNRESERVE, by which an app hands back a unit it prefetched
+   but did not use; such a unit may already have been taken back */
+static void handle_ss_unreserve(int from_rank, int from_tag, MPI_Status *status)
+{
+    int info_buf[IBUF_NUMINTS];
+    xq_node_t *wq_node, *rq_node;
+    wq_struct_t *ws;
+
+    if (from_tag == SS_UNRESERVE)
+        num_ss_msgs_handled_since_logatds++;
+    server_recv(info_buf,IBUF_NUMINTS,MPI_INT,status);
+    aprintf(0000, "AT UNRESERVE from %06d  rrank %d wqseqno %d\n",from_rank,info_buf[0],info_buf[1]);
+    wq_node = wq_find_pinned_for_rank(info_buf[0],info_buf[1]);  /* rank,wqseqno */
+    if (wq_node)
+    {
+        wq_unpin(wq_node,info_buf[2]);  /* pin_rank may be -1 */
+        ws = wq_node->data;
+        rq_node = rq_find_rank_queued_for_type(ws->target_rank,ws->work_type);
+        if (rq_node)
+            give_to_queued_rank(wq_node,rq_node,"unr");
+        else
+            update_local_state();
+    }
+    else if (from_tag == SS_UNRESERVE)
+    {
+        aprintf(1, "** UNRESERVE did not find rank %d wqseqno %d from %06d\n",
+                info_buf[0],info_buf[1],from_rank);
+    }
+    aprintf(0000, "PAST UNRESERVE from %06d\n",from_rank);
+}
+
+static void handle_ss_moving_targeted_work(int from_rank, int from_tag, MPI_Status *status)
+{
+    int info_buf[IBUF_NUMINTS];
+    xq_node_t *tq_node;
+    tq_struct_t *ts;
+
+    num_ss_msgs_handled_since_logatds++;
+    aprintf(0000, "AT MOVING_TARGETED_WORK from %d\n",from_rank);
+    server_recv(info_buf,IBUF_NUMINTS,MPI_INT,status);
+    tq_node = tq_find_rtr(info_buf[0],info_buf[1],info_buf[2]);
+    if (tq_node)
+    {
+        ts = tq_node->data;
+        ts->num_stored--;
+        if (ts->num_stored <= 0)
+            tq_delete(tq_node);
+    }
+    else
+    {
+        /* this is OK; it just means home_server did the push */
+        aprintf(0,"** couldn't find tq record: %d %d %d ; %d\n",
+                info_buf[0],info_buf[1],info_buf[2],info_buf[3]);
+    }
+    if (info_buf[3] != my_world_rank)  /* if not put in my wq, update my tq */
+    {
+        tq_node = tq_find_rtr(info_buf[0],info_buf[1],info_buf[3]);
+        if (tq_node)
+        {
+            ts = tq_node->data;
+            ts->num_stored++;
+        }
+        else
+        {
+            tq_node = tq_node_create(info_buf[0],info_buf[1],info_buf[3],1);
+            tq_append(tq_node);
+            ts = tq_node->data;
+        }
+    }
+    check_remote_work_for_queued_apps();  /* make sure no one is waiting for this */
+    aprintf(0000, "PAST MOVING_TARGETED_WORK from %06d\n",from_rank);
+}
+
+static void handle_ss_push_query(int from_rank, int from_tag, MPI_Status *status)
+{
+    int work_type, answer_rank, work_prio, work_len, iq_slot;
+    double dbls_info_buf[IBUF_NUMDBLS], *dbls_temp_buf;
+    xq_node_t *wq_node;
+    wq_struct_t *ws;
+    void *work_buf;
+
+    num_ss_msgs_handled_since_logatds++;
+    aprintf(0000, "AT SS_PUSH_QUERY from %06d\n",from_rank);
+    server_recv(dbls_info_buf,IBUF_NUMDBLS,MPI_DOUBLE,status);
+    work_type    = (int) dbls_info_buf[0];
+    work_prio    = (int) dbls_info_buf[1];
+    work_len     = (int) dbls_info_buf[2];
+    answer_rank  = (int) dbls_info_buf[3];
+    /* remaining dbls_info_buf[x] used below */
+
+    dbls_temp_buf = amalloc(IBUF_NUMDBLS * sizeof(double));
+    if ((bytes_in_use()+pmalloc_footprint(work_len)) >= THRESHOLD_TO_START_PUSH)
+    {
+        dbls_temp_buf[0] = (double) -1;
+        dbls_temp_buf[1] = bytes_in_use();
+        dbls_temp_buf[2] = dbls_info_buf[7];  /* seqno on pusher */
+        dbls_temp_buf[3] = next_wqseqno;      /* seqno it will have here */
+        iq_slot = iq_slot_create(IBUF_NUMDBLS*sizeof(double), dbls_temp_buf);
+        MPI_Isend(dbls_temp_buf,IBUF_NUMDBLS,MPI_DOUBLE,from_rank,
+                  SS_PUSH_QUERY_RESP,adlb_bal_comm,iq_req(iq_slot));
+        return;
+    }
+
+    dbls_temp_buf[0] = (double) my_world_rank;
+    dbls_temp_buf[1] = bytes_in_use();
+    dbls_temp_buf[2] = dbls_info_buf[7];  /* seqno on pusher */
+    dbls_temp_buf[3] = next_wqseqno;      /* seqno it will have here */
+    iq_slot = iq_slot_create(IBUF_NUMDBLS*sizeof(double), dbls_temp_buf);
+    MPI_Isend(dbls_temp_buf,IBUF_NUMDBLS,MPI_DOUBLE,from_rank,
+              SS_PUSH_QUERY_RESP,adlb_bal_comm,iq_req(iq_slot));
+
+    work_buf                    = pmalloc(work_len,__FUNCTION__,__LINE__);
+    if ( ! work_buf)
+    {
+        aprintf(1,"** aborting: no memory for pushed work of len %d\n",work_len);
+        adlb_server_abort(-1,1);
+    }
+    wq_node = wq_node_create(work_type,work_prio,next_wqseqno++,answer_rank,
+                             my_world_rank,work_len,work_buf);  /* target is me for now */
+    ws = wq_node->data;
+    ws->time_stamp              = dbls_info_buf[4];
+    ws->target_rank             = my_world_rank;  /* reserve for me until push_hdr */
+    ws->temp_target_rank        = (int) dbls_info_buf[5];
+    ws->home_server_rank        = (int) dbls_info_buf[6];
+    /* ws->wqseqno                 = (int) dbls_info_buf[7]; */ /* use local wqseqno */
+    ws->common_len              = (int) dbls_info_buf[8];
+    ws->common_server_rank      = (int) dbls_info_buf[9];
+    ws->common_server_commseqno = (int) dbls_info_buf[10];
+    ws->pin_rank                = my_world_rank;  /* pin for myself until push */
+    ws->pinned                  = 1;              /* */
+    wq_append(wq_node);
+}
+
+static void handle_ss_push_query_resp(int from_rank, int from_tag, MPI_Status *status)
+{
+    int work_len, type_idx, server_idx, to_rank, *temp_buf, iq_slot;
+    double dbls_info_buf[IBUF_NUMDBLS];
+    xq_node_t *wq_node;
+    wq_struct_t *ws;
+    void *work_buf;
+
+    num_ss_msgs_handled_since_logatds++;
+    server_recv(dbls_info_buf,IBUF_NUMDBLS,MPI_DOUBLE,status);
+    to_rank = (int) dbls_info_buf[0];
+    server_idx = get_server_idx(from_rank);
+    qmstat_tbl[server_idx].nbytes_used = dbls_info_buf[1];
+    push_query_is_out = 0; 
+    if (to_rank < 0)
+        return;
+    if (push_attempt_cntr >= MAX_PUSH_ATTEMPTS && (MPI_Wtime()-job_start_time) > 30)
+    {
+        aprintf(1,"** adlb_server: push succeeded after %d attempts\n",
+                push_attempt_cntr);
+    }
+    push_attempt_cntr = 0; 
+    wq_node = wq_find_seqno( (int) dbls_info_buf[2] );
+    if (wq_node)
+        ws = wq_node->data;
+    if ( ! wq_node  ||  ws->pinned)  /* may have been Reserved or retrieved via Get */
+    {
+        temp_buf = amalloc(IBUF_NUMINTS * sizeof(int));
+        temp_buf[0] = (int) dbls_info_buf[3];  /* wqseqno on pushee */
+        iq_slot = iq_slot_create((IBUF_NUMINTS * sizeof(int)),temp_buf);
+        MPI_Isend(temp_buf,IBUF_NUMINTS,MPI_INT,to_rank,SS_PUSH_DEL,
+                  adlb_bal_comm,iq_req(iq_slot));
+        return;
+    }
+
+    temp_buf = amalloc(IBUF_NUMINTS * sizeof(int));
+    temp_buf[0] = (int) dbls_info_buf[3];  /* wqseqno on pushee */
+    iq_slot = iq_slot_create((IBUF_NUMINTS * sizeof(int)),temp_buf);
+    MPI_Isend(temp_buf,IBUF_NUMINTS,MPI_INT,to_rank,SS_PUSH_HDR,
+              adlb_bal_comm,iq_req(iq_slot));
+
+    work_len = ws->work_len;
+    work_buf = ws->work_buf;
+    iq_slot = iq_slot_create(work_len,work_buf);
+    iq_set_payload(iq_slot);    /* freed with pfree when the isend completes */
+    MPI_Isend(work_buf,work_len,MPI_BYTE,to_rank,SS_PUSH_WORK,adlb_bal_comm,iq_req(iq_slot));
+    if (doing_periodic_stats)
+    {
+        type_idx = get_type_idx(ws->work_type);
+        if (type_idx < 0) aprintf(1,"** invalid type\n");
+        if (ws->target_rank >= 0)
+        {
+            periodic_wq_2darray[type_idx][ws->target_rank]--;
+        }
+        else
+        {
+            periodic_wq_2darray[type_idx][num_app_ranks]--;
+        }
+    }
+    ws->work_buf = NULL;  /* **** so the delete below will not free the work_buf **** */
+    wq_delete(wq_node);   /*      because it has been used by the Isend above    **** */
+    npushed_from_here++;
+    update_local_state();
+}
+
+static void handle_ss_push_hdr(int from_rank, int from_tag, MPI_Status *status)
+{
+    int i, info_buf[IBUF_NUMINTS], type_idx, *temp_buf, iq_slot;
+    xq_node_t *wq_node, *rq_node, *tq_node;
+    wq_struct_t *ws;
+    rq_struct_t *rs;
+    tq_struct_t *ts;
+
+    num_ss_msgs_handled_since_logatds++;
+    aprintf(0000, "AT SS_PUSH_HDR from %06d\n",from_rank);
+    server_recv(info_buf,IBUF_NUMINTS,MPI_INT,status);
+    wq_node = wq_find_seqno(info_buf[0]);
+    if ( ! wq_node)
+    {
+        aprintf(1,"** aborting: invalid push_hdr from %d  wqseqno %d\n",
+                from_rank,info_buf[0]);
+        adlb_server_abort(-1,1);
+    }
+    ws = wq_node->data;
+    ws->target_rank = ws->temp_target_rank;  /* switch back to real target now */
+    wq_unpin(wq_node,-1);  /* no longer pinned here */
+    MPI_Recv(ws->work_buf,ws->work_len,MPI_BYTE,from_rank,SS_PUSH_WORK,
+             adlb_bal_comm,status);
+    npushed_to_here++;
+    if (ws->target_rank >= 0)
+    {
+        if (ws->home_server_rank == my_world_rank)
+        {
+            tq_node = tq_find_rtr(ws->target_rank,ws->work_type,from_rank);
+            if (tq_node)
+            {
+                ts = tq_node->data;
+                ts->num_stored--;
+                if (ts->num_stored <= 0)
+                    tq_delete(tq_node);
+            }
+        }
+        else
+        {
+            temp_buf    = amalloc(IBUF_NUMINTS * sizeof(int));
+            temp_buf[0] = ws->target_rank;
+            temp_buf[1] = ws->work_type;
+            temp_buf[2] = from_rank;      /* data moved from server */
+            temp_buf[3] = my_world_rank;  /* data moved to server */
+            iq_slot = iq_slot_create((IBUF_NUMINTS * sizeof(int)) ,temp_buf);
+            MPI_Isend(temp_buf,IBUF_NUMINTS,MPI_INT,ws->home_server_rank,
+                      SS_MOVING_TARGETED_WORK,adlb_bal_comm,iq_req(iq_slot));
+        }
+    }
+    if (doing_periodic_stats)
+    {
+        type_idx = get_type_idx(ws->work_type);
+        if (type_idx < 0) aprintf(1,"** invalid type\n");
+        if (ws->target_rank >= 0)
+        {
+            periodic_wq_2darray[type_idx][ws->target_rank]++;
+        }
+        else
+        {
+            periodic_wq_2darray[type_idx][num_app_ranks]++;
+        }
+    }
+    // target_rank = -1;  //PTW: targeted is NOW pushed /* targeted work is not pushed */
+    rq_node = rq_find_rank_queued_for_type(ws->target_rank,ws->work_type);
+    if (rq_node)
+    {
+        rs = rq_node->data;
+        wq_pin(wq_node,rs->world_rank);
+        info_buf[0] = SUCCESS;
+        info_buf[1] = ws->work_type;
+        info_buf[2] = ws->work_prio;
+        info_buf[3] = ws->work_len;
+        info_buf[4] = ws->answer_rank;
+        info_buf[5] = ws->wqseqno;
+        info_buf[6] = my_world_rank;
+        info_buf[7] = ws->common_len;
+        info_buf[8] = ws->common_server_rank;
+        info_buf[9] = ws->common_server_commseqno;
+        aprintf(0000,"IN SS_PUSH_HDR SENDING RESERVATION to rank %06d\n",rs->world_rank);
+        isend_ints(info_buf,IBUF_NUMINTS,rs->world_rank,TA_RESERVE_RESP);
+        if (use_dbg_prints  &&  (MPI_Wtime() - rs->time_stamp) > DBG_CHECK_TIME)
+        {
+            aprintf(0000,"DBG3: psh %d %f %f %d %d\n",
+                    rs->rqseqno,MPI_Wtime()-rs->time_stamp,
+                    MPI_Wtime()-ws->time_stamp,rs->world_rank,ws->work_type);
+        }
+        if (first_time_on_rq[rs->world_rank])
+            first_time_on_rq[rs->world_rank] = 0;
+        else
+        {
+            total_time_on_rq += (MPI_Wtime() - rs->time_stamp);
+            num_rq_nodes_timed++;
+        }
+        if (doing_periodic_stats)
+        {
+            for (i=0; i < rs->num_req_types; i++)
             {
-                dbls_temp_buf[0] = (double) -1;
-                dbls_temp_buf[1] = curr_bytes_dmalloced;
-                dbls_temp_buf[2] = dbls_info_buf[7];  /* seqno on pusher */
-                dbls_temp_buf[3] = next_wqseqno;      /* seqno it will have here */
-                temp_req = amalloc(sizeof(MPI_Request));
-                rc = MPI_Isend(dbls_temp_buf,IBUF_NUMDBLS,MPI_DOUBLE,from_rank,
-                               SS_PUSH_QUERY_RESP,adlb_all_comm,temp_req);
-                iq_node = iq_node_create(temp_req, IBUF_NUMDBLS*sizeof(double), dbls_temp_buf);
-                iq_append(iq_node);
-                continue;
+                if (i == 0  && rs->req_types[i] < 0)  /* if wild card */
+                    type_idx = num_types;
+                else if (rs->req_types[i] >= 0)  /* user type */
+                    type_idx = get_type_idx(rs->req_types[i]);
+                else    /* list terminator */
+                    break;
+                if (type_idx < 0) aprintf(1,"** invalid type\n");
+                periodic_rq_vector[type_idx]--;
             }
+            periodic_rq_vector[num_types+1] = rq->count - 1; /* deleting */
+            type_idx = get_type_idx(ws->work_type);
+            if (type_idx < 0) aprintf(1,"** invalid type\n");
+            periodic_resolved_reserve_cnt[type_idx]++;
+        }
+        rq_delete(rq_node);
+        exhausted_flag = 0;
+    }
+    else
+    {
+        update_local_state();
+    }
+    aprintf(0000, "PAST SS_PUSH_HDR from %06d\n",from_rank);
+}
+
+static void handle_ss_push_del(int from_rank, int from_tag, MPI_Status *status)
+{
+    int info_buf[IBUF_NUMINTS];
+    xq_node_t *wq_node;
+
+    num_ss_msgs_handled_since_logatds++;
+    aprintf(0000, "AT SS_PUSH_DEL from %06d\n",from_rank);
+    server_recv(info_buf,IBUF_NUMINTS,MPI_INT,status);
+    wq_node = wq_find_seqno(info_buf[0]);
+    if ( ! wq_node)
+    {
+        aprintf(1,"** aborting: invalid push_del from %d  wqseqno %d\n",
+                from_rank,info_buf[0]);
+        adlb_server_abort(-1,1);
+    }
+    wq_delete(wq_node);
+    /* no need to update state here; actual push never occurred */
+}
+
+static void handle_fa_adlb_abort(int from_rank, int from_tag, MPI_Status *status)
+{
+    int info_buf[IBUF_NUMINTS];
+
+    server_recv(info_buf,IBUF_NUMINTS,MPI_INT,status);
+    aprintf(1,"** adlb_server: recvd abort %d from app %06d\n",
+            info_buf[0],from_rank);
+    adlb_server_abort(info_buf[0],0);  /* do not call mpi_abort; client will do it */
+    aprintf(0000, "PAST FA_ADLB_ABORT from %06d\n",from_rank);
+}
+
+static void handle_fa_log(int from_rank, int from_tag, MPI_Status *status)
+{
+    server_recv(log_buf,100,MPI_BYTE,status);
+    // cblog(1,from_rank,log_buf);
+}
+
+static void handle_ss_adlb_abort(int from_rank, int from_tag, MPI_Status *status)
+{
+    int info_buf[IBUF_NUMINTS];
+
+    num_ss_msgs_handled_since_logatds++;
+    aprintf(0000, "AT SS_ADLB_ABORT from %06d\n",from_rank);
+    server_recv(info_buf,IBUF_NUMINTS,MPI_INT,status);
+    aprintf(1,"** adlb_server: HANDLING ADLB_ABORT from server %06d\n",from_rank);
+    print_final_stats();
+    MPI_Isend(info_buf,IBUF_NUMINTS,MPI_INT,rhs_rank,SS_ADLB_ABORT,
+              adlb_bal_comm,&dummy_req);
+    aprintf(0000, "PAST SS_ADLB_ABORT from %06d\n",from_rank);
+    sleep(10);
+    MPI_Abort(MPI_COMM_WORLD,info_buf[0]);  /* only after servers have all reacted */
+}
 
-            dbls_temp_buf[0] = (double) my_world_rank;
-            dbls_temp_buf[1] = curr_bytes_dmalloced;
-            dbls_temp_buf[2] = dbls_info_buf[7];  /* seqno on pusher */
-            dbls_temp_buf[3] = next_wqseqno;      /* seqno it will have here */
-            temp_req = amalloc(sizeof(MPI_Request));
-            rc = MPI_Isend(dbls_temp_buf,IBUF_NUMDBLS,MPI_DOUBLE,from_rank,
-                           SS_PUSH_QUERY_RESP,adlb_all_comm,temp_req);
-            iq_node = iq_node_create(temp_req, IBUF_NUMDBLS*sizeof(double), dbls_temp_buf);
-            iq_append(iq_node);
-
-            work_buf                    = amalloc(work_len);
-            wq_node = wq_node_create(work_type,work_prio,next_wqseqno++,answer_rank,
-                                     my_world_rank,work_len,work_buf);  /* target is me for now */
-            ws = wq_node->data;
-            ws->time_stamp              = dbls_info_buf[4];
-            ws->target_rank             = my_world_rank;  /* reserve for me until push_hdr */
-            ws->temp_target_rank        = (int) dbls_info_buf[5];
-            ws->home_server_rank        = (int) dbls_info_buf[6];
-            /* ws->wqseqno                 = (int) dbls_info_buf[7]; */ /* use local wqseqno */
-            ws->common_len              = (int) dbls_info_buf[8];
-            ws->common_server_rank      = (int) dbls_info_buf[9];
-            ws->common_server_commseqno = (int) dbls_info_buf[10];
-            ws->pin_rank                = my_world_rank;  /* pin for myself until push */
-            ws->pinned                  = 1;              /* */
-            wq_append(wq_node);
-        }
-        else if (from_tag == SS_PUSH_QUERY_RESP)
-        {
-            num_ss_msgs_handled_since_logatds++;
-            MPI_Recv(dbls_info_buf,IBUF_NUMDBLS,MPI_DOUBLE,from_rank,SS_PUSH_QUERY_RESP,
-                     adlb_all_comm,&status);
-            to_rank = (int) dbls_info_buf[0];
-            server_idx = get_server_idx(from_rank);
-            qmstat_tbl[server_idx].nbytes_used = dbls_info_buf[1];
-            push_query_is_out = 0; 
-            if (to_rank < 0)
-                continue;
-            if (push_attempt_cntr >= MAX_PUSH_ATTEMPTS && (MPI_Wtime()-job_start_time) > 30)
-            {
-                aprintf(1,"** adlb_server: push succeeded after %d attempts\n",
-                        push_attempt_cntr);
-            }
-            push_attempt_cntr = 0; 
-            wq_node = wq_find_seqno( (int) dbls_info_buf[2] );
-            if (wq_node)
-                ws = wq_node->data;
-            if ( ! wq_node  ||  ws->pinned)  /* may have been Reserved or retrieved via Get */
-            {
-                temp_buf = amalloc(IBUF_NUMINTS * sizeof(int));
-                temp_buf[0] = (int) dbls_info_buf[3];  /* wqseqno on pushee */
-                temp_req = amalloc(sizeof(MPI_Request));
-                MPI_Isend(temp_buf,IBUF_NUMINTS,MPI_INT,to_rank,SS_PUSH_DEL,
-                          adlb_all_comm,temp_req);
-                iq_node = iq_node_create(temp_req,(IBUF_NUMINTS * sizeof(int)),temp_buf);
-                iq_append(iq_node);
-                continue;
-            }
+static void handle_ss_periodic_stats(int from_rank, int from_tag, MPI_Status *status)
+{
+    int i, j, k, *temp_buf, nbytes_printed, nbytes_left_to_print, skip, iq_slot;
+    char *temp_char_buf, temp_str[64];
 
-            temp_buf = amalloc(IBUF_NUMINTS * sizeof(int));
-            temp_buf[0] = (int) dbls_info_buf[3];  /* wqseqno on pushee */
-            temp_req = amalloc(sizeof(MPI_Request));
-            MPI_Isend(temp_buf,IBUF_NUMINTS,MPI_INT,to_rank,SS_PUSH_HDR,
-                      adlb_all_comm,temp_req);
-            iq_node = iq_node_create(temp_req,(IBUF_NUMINTS * sizeof(int)),temp_buf);
-            iq_append(iq_node);
-
-            work_len = ws->work_len;
-            work_buf = ws->work_buf;
-            temp_req = amalloc(sizeof(MPI_Request));
-            MPI_Isend(work_buf,work_len,MPI_BYTE,to_rank,SS_PUSH_WORK,adlb_all_comm,temp_req);
-            iq_node = iq_node_create(temp_req,work_len,work_buf);
-            iq_append(iq_node);
-            if (doing_periodic_stats)
-            {
-                type_idx = get_type_idx(ws->work_type);
-                if (type_idx < 0) aprintf(1,"** invalid type\n");
-                if (ws->target_rank >= 0)
-                {
-                    periodic_wq_2darray[type_idx][ws->target_rank]--;
-                }
-                else
-                {
-                    periodic_wq_2darray[type_idx][num_app_ranks]--;
-                }
-            }
-            ws->work_buf = NULL;  /* **** so the delete below will not free the work_buf **** */
-            wq_delete(wq_node);   /*      because it has been used by the Isend above    **** */
-            npushed_from_here++;
-            update_local_state();
+    num_ss_msgs_handled_since_logatds++;
+    server_recv(periodic_buf,periodic_buf_num_ints,MPI_INT,status);
+    if (my_world_rank == master_server_rank)
+    {
+        temp_char_buf = amalloc(periodic_buf_num_ints * 9);  /* assume int < 9 chars */
+        temp_char_buf[0] = '\0';
+        for (i=0; i < periodic_buf_num_ints; i++)
+        {
+            sprintf(temp_str,"%d ",periodic_buf[i]);
+            strcat(temp_char_buf,temp_str);
         }
-        else if (from_tag == SS_PUSH_HDR)
+        nbytes_printed = 0;
+        nbytes_left_to_print = strlen(temp_char_buf);
+        for (i=0; nbytes_left_to_print > 0; i++)
         {
-            num_ss_msgs_handled_since_logatds++;
-            aprintf(0000, "AT SS_PUSH_HDR from %06d\n",from_rank);
-            MPI_Recv(info_buf,IBUF_NUMINTS,MPI_INT,from_rank,SS_PUSH_HDR,
-                     adlb_all_comm,&status);
-            wq_node = wq_find_seqno(info_buf[0]);
-            if ( ! wq_node)
-            {
-                aprintf(1,"** aborting: invalid push_hdr from %d  wqseqno %d\n",
-                        from_rank,info_buf[0]);
-                adlb_server_abort(-1,1);
-            }
-            ws = wq_node->data;
-            ws->target_rank = ws->temp_target_rank;  /* switch back to real target now */
-            ws->pin_rank = -1;  /* no longer pinned here */
-            ws->pinned   = 0;
-            MPI_Recv(ws->work_buf,ws->work_len,MPI_BYTE,from_rank,SS_PUSH_WORK,
-                     adlb_all_comm,&status);
-            npushed_to_here++;
-            if (ws->target_rank >= 0)
-            {
-                if (ws->home_server_rank == my_world_rank)
-                {
-                    tq_node = tq_find_rtr(ws->target_rank,ws->work_type,from_rank);
-                    if (tq_node)
-                    {
-                        ts = tq_node->data;
-                        ts->num_stored--;
-                        if (ts->num_stored <= 0)
-                            tq_delete(tq_node);
-                    }
-                }
-                else
-                {
-                    temp_buf    = amalloc(IBUF_NUMINTS * sizeof(int));
-                    temp_buf[0] = ws->target_rank;
-                    temp_buf[1] = ws->work_type;
-                    temp_buf[2] = from_rank;      /* data moved from server */
-                    temp_buf[3] = my_world_rank;  /* data moved to server */
-                    temp_req    = amalloc(sizeof(MPI_Request));
-                    rc = MPI_Isend(temp_buf,IBUF_NUMINTS,MPI_INT,ws->home_server_rank,
-                                   SS_MOVING_TARGETED_WORK,adlb_all_comm,temp_req);
-                    iq_node = iq_node_create(temp_req, (IBUF_NUMINTS * sizeof(int)) ,temp_buf);
-                    iq_append(iq_node);
-                }
-            }
-            if (doing_periodic_stats)
-            {
-                type_idx = get_type_idx(ws->work_type);
-                if (type_idx < 0) aprintf(1,"** invalid type\n");
-                if (ws->target_rank >= 0)
-                {
-                    periodic_wq_2darray[type_idx][ws->target_rank]++;
-                }
-                else
-                {
-                    periodic_wq_2darray[type_idx][num_app_ranks]++;
-                }
-            }
-            // target_rank = -1;  //PTW: targeted is NOW pushed /* targeted work is not pushed */
-            rq_node = rq_find_rank_queued_for_type(ws->target_rank,ws->work_type);
-            if (rq_node)
-            {
-                rs = rq_node->data;
-                ws->pin_rank = rs->world_rank;
-                if (ws->pin_rank >= 0)
-                    ws->pinned = 1;
-                info_buf[0] = SUCCESS;
-                info_buf[1] = ws->work_type;
-                info_buf[2] = ws->work_prio;
-                info_buf[3] = ws->work_len;
-                info_buf[4] = ws->answer_rank;
-                info_buf[5] = ws->wqseqno;
-                info_buf[6] = my_world_rank;
-                info_buf[7] = ws->common_len;
-                info_buf[8] = ws->common_server_rank;
-                info_buf[9] = ws->common_server_commseqno;
-                aprintf(0000,"IN SS_PUSH_HDR SENDING RESERVATION to rank %06d\n",rs->world_rank);
-                MPI_Ssend(info_buf,IBUF_NUMINTS,MPI_INT,rs->world_rank,
-                          TA_RESERVE_RESP,adlb_all_comm);
-                if (use_dbg_prints  &&  (MPI_Wtime() - rs->time_stamp) > DBG_CHECK_TIME)
-                {
-                    aprintf(0000,"DBG3: psh %d %f %f %d %d\n",
-                            rs->rqseqno,MPI_Wtime()-rs->time_stamp,
-                            MPI_Wtime()-ws->time_stamp,rs->world_rank,ws->work_type);
-                }
-                if (first_time_on_rq[rs->world_rank])
-                    first_time_on_rq[rs->world_rank] = 0;
-                else
-                {
-                    total_time_on_rq += (MPI_Wtime() - rs->time_stamp);
-                    num_rq_nodes_timed++;
-                }
-                if (doing_periodic_stats)
-                {
-                    for (i=0; i < num_types; i++)
-                    {
-                        if (i == 0  && rs->req_types[i] < 0)  /* if wild card */
-                            type_idx = num_types;
-                        else if (rs->req_types[i] >= 0)  /* user type */
-                            type_idx = get_type_idx(rs->req_types[i]);
-                        else    /* list terminator */
-                            break;
-                        if (type_idx < 0) aprintf(1,"** invalid type\n");
-                        periodic_rq_vector[type_idx]--;
-                    }
-                    periodic_rq_vector[num_types+1] = rq->count - 1; /* deleting */
-                    type_idx = get_type_idx(ws->work_type);
-                    if (type_idx < 0) aprintf(1,"** invalid type\n");
-                    periodic_resolved_reserve_cnt[type_idx]++;
-                }
-                rq_delete(rq_node);
-                exhausted_flag = 0;
-            }
+            if (nbytes_left_to_print > 500)  /* also a header on each line */
+                k = 500;
             else
-            {
-                update_local_state();
-            }
-            aprintf(0000, "PAST SS_PUSH_HDR from %06d\n",from_rank);
+                k = nbytes_left_to_print;
+            memcpy(buf1000,temp_char_buf+nbytes_printed,k);
+            buf1000[k] = '\0';
+            aprintf(1,"STAT_APS: lct=%d: %s\n",i,buf1000);
+            nbytes_printed += k;
+            nbytes_left_to_print -= k;
         }
-        else if (from_tag == SS_PUSH_DEL)
+        afree(temp_char_buf,periodic_buf_num_ints * 16);
+    }
+    else
+    {
+        temp_buf = amalloc(periodic_buf_num_ints * sizeof(int));
+        /* put in wq_2darray stuff */
+        for (i=0; i < num_types; i++)
         {
-            num_ss_msgs_handled_since_logatds++;
-            aprintf(0000, "AT SS_PUSH_DEL from %06d\n",from_rank);
-            MPI_Recv(info_buf,IBUF_NUMINTS,MPI_INT,from_rank,SS_PUSH_DEL,
-                     adlb_all_comm,&status);
-            wq_node = wq_find_seqno(info_buf[0]);
-            if ( ! wq_node)
+            for (j=0; j < (num_app_ranks+1); j++)
             {
-                aprintf(1,"** aborting: invalid push_del from %d  wqseqno %d\n",
-                        from_rank,info_buf[0]);
-                adlb_server_abort(-1,1);
+                k = (i * (num_app_ranks+1)) + j;
+                temp_buf[k] = periodic_buf[k] + periodic_wq_2darray[i][j];
             }
-            wq_delete(wq_node);
-            /* no need to update state here; actual push never occurred */
         }
-        else if (from_tag == FA_ADLB_ABORT)
+        /* put in rq_vector stuff */
+        skip = (num_app_ranks + 1) * num_types;  /* skip wq_2d */
+        for (i=0; i < (num_types+2); i++)
+        {
+            k = i + skip;
+            temp_buf[k] = periodic_buf[k] + periodic_rq_vector[i];
+        }
+        /* put in put_cnt stuff */
+        skip += num_types + 2;
+        for (i=0; i < num_types; i++)
         {
-            MPI_Recv(info_buf,IBUF_NUMINTS,MPI_INT,from_rank,FA_ADLB_ABORT,
-                     adlb_all_comm,&status);
-            aprintf(1,"** adlb_server: recvd abort %d from app %06d\n",
-                    info_buf[0],from_rank);
-            adlb_server_abort(info_buf[0],0);  /* do not call mpi_abort; client will do it */
-            aprintf(0000, "PAST FA_ADLB_ABORT from %06d\n",from_rank);
+            k = i + skip;
+            temp_buf[k] = periodic_buf[k] + periodic_put_cnt[i];
         }
-        else if (from_tag == FA_LOG)
+        /* put in resolved_reserve stuff */
+        skip += num_types;
+        for (i=0; i < num_types; i++)
         {
-            MPI_Recv(log_buf,100,MPI_BYTE,from_rank,FA_LOG,adlb_all_comm,&status);
-            // cblog(1,from_rank,log_buf);
+            k = i + skip;
+            temp_buf[k] = periodic_buf[k] + periodic_resolved_reserve_cnt[i];
         }
-        else if (from_tag == SS_ADLB_ABORT)
+        iq_slot = iq_slot_create(periodic_buf_num_ints*sizeof(int),temp_buf);
+        MPI_Isend(temp_buf,periodic_buf_num_ints,MPI_INT,rhs_rank,
+                  SS_PERIODIC_STATS,adlb_tel_comm,iq_req(iq_slot));
+    }
+    for (i=0; i < num_types; i++)
+    {
+        periodic_put_cnt[i] = 0;
+        periodic_resolved_reserve_cnt[i] = 0;
+    }
+}
+
+static void handle_fa_info_num_work_units(int from_rank, int from_tag, MPI_Status *status)
+{
+    int info_buf[IBUF_NUMINTS], work_type;
+    xq_node_t *wq_node;
+    wq_struct_t *ws;
+
+    server_recv(info_buf,IBUF_NUMINTS,MPI_INT,status);
+    work_type = info_buf[0];
+    info_buf[0] = ADLB_LOWEST_PRIO;    /* max prio of that type */
+    info_buf[1] = 0;                   /* num of that type AND max prio */
+    info_buf[2] = 0;                   /* num total of that type */
+    if (no_more_work_flag)
+        info_buf[3] = ADLB_NO_MORE_WORK;
+    else
+        info_buf[3] = 0;
+    for (wq_node=xq_first(wq); wq_node; wq_node=xq_next(wq,wq_node))
+    {
+        ws = wq_node->data;
+        if (ws->work_type == work_type)
         {
-            num_ss_msgs_handled_since_logatds++;
-            aprintf(0000, "AT SS_ADLB_ABORT from %06d\n",from_rank);
-            MPI_Recv(info_buf,IBUF_NUMINTS,MPI_INT,from_rank,SS_ADLB_ABORT,
-                     adlb_all_comm,&status);
-            aprintf(1,"** adlb_server: HANDLING ADLB_ABORT from server %06d\n",from_rank);
-            print_final_stats();
-            MPI_Isend(info_buf,IBUF_NUMINTS,MPI_INT,rhs_rank,SS_ADLB_ABORT,
-                      adlb_all_comm,&dummy_req);
-            aprintf(0000, "PAST SS_ADLB_ABORT from %06d\n",from_rank);
-            sleep(10);
-            MPI_Abort(MPI_COMM_WORLD,info_buf[0]);  /* only after servers have all reacted */
-        }
-        else if (from_tag == SS_PERIODIC_STATS)
-        {
-            num_ss_msgs_handled_since_logatds++;
-            MPI_Recv(periodic_buf,periodic_buf_num_ints,MPI_INT,from_rank,SS_PERIODIC_STATS,
-                     adlb_all_comm,&status);
-            if (my_world_rank == master_server_rank)
+            if (ws->work_prio > info_buf[0])
+                info_buf[0] = ws->work_prio;
+            info_buf[2]++;
+        }
+    }
+    for (wq_node=xq_first(wq); wq_node; wq_node=xq_next(wq,wq_node))
+    {
+        ws = wq_node->data;
+        if (ws->work_type == work_type  &&  ws->work_prio == info_buf[0])
+            info_buf[1]++;
+    }
+    isend_ints(info_buf,IBUF_NUMINTS,from_rank,TA_ACK_AND_RC);
+}
+
+/* housekeeping tasks run off the server_timers table; each gets the time
+   of the loop pass that found it due */
+
+static void timer_dbg_check(double now)
+{
+    int i, cand_rank, dbg_flag;
+    int dbg_2_cnt, dbg_10_cnt, dbg_10002_cnt;
+    double dbg_oldest_2_time, dbg_oldest_10_time, dbg_oldest_10002_time;
+    xq_node_t *wq_node, *rq_node;
+    wq_struct_t *ws;
+    rq_struct_t *rs;
+    char dbg_temp_buf[512], dbg_print_buf[4096];
+
+    for (rq_node=xq_first(rq); rq_node; rq_node=xq_next(rq,rq_node))
+    {
+        rs = rq_node->data;
+        if ((now - rs->time_stamp) > DBG_CHECK_TIME)
+        {
+            cand_rank = -1;
+            for (i=0; i < rs->num_req_types; i++)
             {
-                temp_char_buf = amalloc(periodic_buf_num_ints * 9);  /* assume int < 9 chars */
-                temp_char_buf[0] = '\0';
-                for (i=0; i < periodic_buf_num_ints; i++)
-                {
-                    sprintf(temp_str,"%d ",periodic_buf[i]);
-                    strcat(temp_char_buf,temp_str);
-                }
-                nbytes_printed = 0;
-                nbytes_left_to_print = strlen(temp_char_buf);
-                for (i=0; nbytes_left_to_print > 0; i++)
-                {
-                    if (nbytes_left_to_print > 500)  /* also a header on each line */
-                        k = 500;
-                    else
-                        k = nbytes_left_to_print;
-                    memcpy(buf1000,temp_char_buf+nbytes_printed,k);
-                    buf1000[k] = '\0';
-                    aprintf(1,"STAT_APS: lct=%d: %s\n",i,buf1000);
-                    nbytes_printed += k;
-                    nbytes_left_to_print -= k;
-                }
-                afree(temp_char_buf,periodic_buf_num_ints * 16);
+                cand_rank = find_cand_rank_with_worktype(rs->world_rank,rs->req_types[i]);
+                if (cand_rank >= 0)
+                    break;
             }
+            if (cand_rank >= 0)
+                dbg_flag = 1;
             else
+                dbg_flag = 0;
+            sprintf(dbg_print_buf,"%d %f %d %d %d %d ",
+                    rs->rqseqno,now-rs->time_stamp,rs->world_rank,
+                    rfr_to_rank[rs->world_rank],dbg_rfr_sent_cnt[rs->world_rank],
+                    dbg_flag);
+            for (i=0; i < rs->num_req_types; i++)
             {
-                temp_buf = amalloc(periodic_buf_num_ints * sizeof(int));
-                temp_req = amalloc(sizeof(MPI_Request));
-                /* put in wq_2darray stuff */
-                for (i=0; i < num_types; i++)
-                {
-                    for (j=0; j < (num_app_ranks+1); j++)
-                    {
-                        k = (i * (num_app_ranks+1)) + j;
-                        temp_buf[k] = periodic_buf[k] + periodic_wq_2darray[i][j];
-                    }
-                }
-                /* put in rq_vector stuff */
-                skip = (num_app_ranks + 1) * num_types;  /* skip wq_2d */
-                for (i=0; i < (num_types+2); i++)
-                {
-                    k = i + skip;
-                    temp_buf[k] = periodic_buf[k] + periodic_rq_vector[i];
-                }
-                /* put in put_cnt stuff */
-                skip += num_types + 2;
-                for (i=0; i < num_types; i++)
-                {
-                    k = i + skip;
-                    temp_buf[k] = periodic_buf[k] + periodic_put_cnt[i];
-                }
-                /* put in resolved_reserve stuff */
-                skip += num_types;
-                for (i=0; i < num_types; i++)
+                if (rs->req_types[i] >= 0)
                 {
-                    k = i + skip;
-                    temp_buf[k] = periodic_buf[k] + periodic_resolved_reserve_cnt[i];
+                    sprintf(dbg_temp_buf,"%d ",rs->req_types[i]);
+                    if ((strlen(dbg_print_buf) + strlen(dbg_temp_buf)) >= 4096)
+                        break;
+                    strcat(dbg_print_buf,dbg_temp_buf);
                 }
-                MPI_Isend(temp_buf,periodic_buf_num_ints,MPI_INT,rhs_rank,
-                          SS_PERIODIC_STATS,adlb_all_comm,temp_req);
-                iq_node = iq_node_create(temp_req,periodic_buf_num_ints*sizeof(int),temp_buf);
-                iq_append(iq_node);
+                else
+                    break;
             }
-            for (i=0; i < num_types; i++)
+            aprintf(0000,"DBG1: %s\n",dbg_print_buf);
+        }
+    }
+    dbg_2_cnt = dbg_10_cnt = dbg_10002_cnt = 0;
+    dbg_oldest_2_time = dbg_oldest_10_time = dbg_oldest_10002_time = 999999999999.0;
+    for (wq_node=xq_first(wq); wq_node; wq_node=xq_next(wq,wq_node))
+    {
+        ws = wq_node->data;
+        if (ws->work_type == 2)
+        {
+            dbg_2_cnt++;
+            if (ws->time_stamp < dbg_oldest_2_time)  // older
+                dbg_oldest_2_time = ws->time_stamp;
+        }
+        else if (ws->work_type == 10)
+        {
+            dbg_10_cnt++;
+            if (ws->time_stamp < dbg_oldest_10_time)  // older
+                dbg_oldest_10_time = ws->time_stamp;
+        }
+        else if (ws->work_type == 2)
+        {
+            dbg_10002_cnt++;
+            if (ws->time_stamp < dbg_oldest_10002_time)  // older
+                dbg_oldest_10002_time = ws->time_stamp;
+        }
+    }
+    if (dbg_oldest_2_time < 999999999999.0)
+        dbg_oldest_2_time = MPI_Wtime() - dbg_oldest_2_time;
+    else
+        dbg_oldest_2_time = 0.0;
+    if (dbg_oldest_10_time < 999999999999.0)
+        dbg_oldest_10_time = MPI_Wtime() - dbg_oldest_10_time;
+    else
+        dbg_oldest_10_time = 0.0;
+    if (dbg_oldest_10002_time < 999999999999.0)
+        dbg_oldest_10002_time = MPI_Wtime() - dbg_oldest_10002_time;
+    else
+        dbg_oldest_10002_time = 0.0;
+    aprintf(0000,"DBG2: %d %f %d %f %d %f\n",
+            dbg_2_cnt,dbg_oldest_2_time,
+            dbg_10_cnt,dbg_oldest_10_time,
+            dbg_10002_cnt,dbg_oldest_10002_time);
+
+    /**/
+    for (wq_node=xq_first(wq); wq_node; wq_node=xq_next(wq,wq_node))
+    {
+        ws = wq_node->data;
+        dbg_wq_by_type[ws->work_type]++;
+        if (ws->target_rank >= 0)
+            dbg_wq_targ_by_type[ws->work_type]++;
+    }
+    sprintf(dbg_print_buf,"%d; ",wq->count);
+    for (i=0; i < 10010; i++)
+    {
+        if (dbg_wq_by_type[i] > 0)
+        {
+            sprintf(dbg_temp_buf,"%d:%d ",i,dbg_wq_by_type[i]);
+            strcat(dbg_print_buf,dbg_temp_buf);
+        }
+        if (dbg_wq_targ_by_type[i] > 0)
+        {
+            sprintf(dbg_temp_buf,"%dt:%d ",i,dbg_wq_targ_by_type[i]);
+            strcat(dbg_print_buf,dbg_temp_buf);
+        }
+    }
+    aprintf(0000,"DBG8: %s\n",dbg_print_buf);
+    for (i=0; i < 10010; i++)
+        dbg_wq_by_type[i] = dbg_wq_targ_by_type[i] = 0;
+    /**/
+    dbg_print_buf[0] = '\0';
+    for (i=0; i < 10010; i++)
+    {
+        if (dbg_rfr_attempts_by_type[i] > 0)
+        {
+            sprintf(dbg_temp_buf,"%d:%d ",i,dbg_rfr_attempts_by_type[i]);
+            strcat(dbg_print_buf,dbg_temp_buf);
+        }
+    }
+    aprintf(0000,"DBG9: %s\n",dbg_print_buf);
+    for (i=0; i < 10010; i++)
+        dbg_rfr_attempts_by_type[i] = 0;
+    /**/
+
+    sprintf(dbg_print_buf,"%d; ",iprobe_successful_cnt);
+    for (i=0; i < 50; i++)
+    {
+        if (dbg_tags_handled[i] > 0)
+        {
+            sprintf(dbg_temp_buf,"%d:%d ",i+1000,dbg_tags_handled[i]);
+            strcat(dbg_print_buf,dbg_temp_buf);
+        }
+    }
+    aprintf(0000,"DBG5: %s\n",dbg_print_buf);
+    iprobe_successful_cnt = 0;
+    for (i=0; i < 50; i++)
+        dbg_tags_handled[i] = 0;
+
+#   ifdef DEBUGGING_BGX
+    GetUnexpectedRequestTagsInDBGTagsBuf(dbg_unexpected_by_tag);
+    sprintf(dbg_print_buf,"%d; ",dbg_max_msg_queue_cnt);
+    for (i=0; i < 50; i++)
+    {
+        if (dbg_unexpected_by_tag[i] > 0)
+        {
+            sprintf(dbg_temp_buf,"%d:%d ",i+1000,dbg_unexpected_by_tag[i]);
+            strcat(dbg_print_buf,dbg_temp_buf);
+        }
+    }
+    aprintf(0000,"DBG6: %s\n",dbg_print_buf);
+    dbg_max_msg_queue_cnt = 0;
+    for (i=0; i < 50; i++)
+        dbg_unexpected_by_tag[i] = 0;
+#   endif
+#   ifdef DEBUGGING_SICORTEX
+    aprintf(1,"DBG6: early queue len %d\n",MPIDI_Debug_early_queue_length());
+#   endif
+}
+
+static void timer_periodic_stats(double now)
+{
+    int i, j, k, skip, *temp_buf, iq_slot;
+
+    temp_buf = amalloc(periodic_buf_num_ints * sizeof(int));
+    /* put in wq_2darray stuff */
+    for (i=0; i < num_types; i++)
+    {
+        for (j=0; j < (num_app_ranks+1); j++)
+        {
+            k = (i * (num_app_ranks+1)) + j;
+            temp_buf[k] = periodic_wq_2darray[i][j];
+        }
+    }
+    /* put in rq_vector stuff */
+    skip = (num_app_ranks + 1) * num_types;  /* skip wq_2d */
+    for (i=0; i < (num_types+2); i++)
+    {
+        k = i + skip;
+        temp_buf[k] = periodic_rq_vector[i];
+    }
+    /* put in put_cnt stuff */
+    skip += num_types + 2;
+    for (i=0; i < num_types; i++)
+    {
+        k = i + skip;
+        temp_buf[k] = periodic_put_cnt[i];
+    }
+    /* put in resolved_reserve stuff */
+    skip += num_types;
+    for (i=0; i < num_types; i++)
+    {
+        k = i + skip;
+        temp_buf[k] = periodic_resolved_reserve_cnt[i];
+    }
+    iq_slot = iq_slot_create(periodic_buf_num_ints*sizeof(int),temp_buf);
+    MPI_Isend(temp_buf,periodic_buf_num_ints,MPI_INT,rhs_rank,
+              SS_PERIODIC_STATS,adlb_tel_comm,iq_req(iq_slot));
+}
+
+static void timer_exhaust_chk(double now)
+{
+    int info_buf[IBUF_NUMINTS], iq_slot;
+    xq_node_t *rq_node;
+    rq_struct_t *rs;
+
+    if (rq->count >= num_apps_this_server)
+    {
+        if (num_servers == 1)
+        {
+            // send exhausted to apps on rq
+            while ((rq_node=xq_first(rq)))
             {
-                periodic_put_cnt[i] = 0;
-                periodic_resolved_reserve_cnt[i] = 0;
+                rs = rq_node->data;
+                aprintf(0000,"SENDING NMW to rank %06d\n",rs->world_rank);
+                info_buf[0] = ADLB_DONE_BY_EXHAUSTION;
+                isend_ints(info_buf,IBUF_NUMINTS,rs->world_rank,TA_RESERVE_RESP);
+                /* since exhaustion, do NOT alter times for total_time_on_rq */
+                rq_delete(rq_node);
+                /* done, so not dealing with periodic stats right now */
             }
         }
-        else if (from_tag == FA_INFO_NUM_WORK_UNITS)
+        else
         {
-            MPI_Recv(info_buf,IBUF_NUMINTS,MPI_INT,from_rank,FA_INFO_NUM_WORK_UNITS,
-                     adlb_all_comm,&status);
-            work_type = info_buf[0];
-            info_buf[0] = ADLB_LOWEST_PRIO;    /* max prio of that type */
-            info_buf[1] = 0;                   /* num of that type AND max prio */
-            info_buf[2] = 0;                   /* num total of that type */
-            if (no_more_work_flag)
-                info_buf[3] = ADLB_NO_MORE_WORK;
-            else
-                info_buf[3] = 0;
-            for (wq_node=xq_first(wq); wq_node; wq_node=xq_next(wq,wq_node))
+            exhausted_flag = 1;
+            iq_slot = iq_slot_create(0, NULL);
+            MPI_Isend(info_buf,0,MPI_INT,rhs_rank,SS_EXHAUST_CHK_LOOP_1,
+                      adlb_bal_comm,iq_req(iq_slot));
+        }
+    }
+}
+
+static void timer_qmstat(double now)
+{
+    int iq_slot;
+
+    if ( ! qmstat_msg_is_out )
+    {
+        qmstat_send_buf = amalloc(qmstat_buflen);
+        pack_qmstat();  /* all info from qmstat_tbl into qmstat_send_buf */
+        iq_slot = iq_slot_create(qmstat_buflen,qmstat_send_buf);
+        MPI_Isend(qmstat_send_buf,qmstat_buflen,MPI_PACKED,server_comm_rhs,SS_QMSTAT,
+                  adlb_server_comm,iq_req(iq_slot));
+        qmstat_msg_is_out = 1;
+        prev_qmstat_msg_time = now;
+        server_timer_disarm(ADLB_TIMER_QMSTAT);  /* rearmed when it gets back */
+    }
+}
+
+static void timer_dbg_timing(double now)
+{
+    int iq_slot;
+    double *dbls_temp_buf;
+
+    if ( ! dbg_msg_is_out )
+    {
+        dbls_temp_buf = amalloc(IBUF_NUMDBLS * sizeof(double));
+        dbls_temp_buf[0] = now;  /* loop start time */
+        dbls_temp_buf[1] = now;  /* hop  start time */
+        iq_slot = iq_slot_create(IBUF_NUMDBLS*sizeof(double), dbls_temp_buf);
+        MPI_Isend(dbls_temp_buf,IBUF_NUMDBLS,MPI_DOUBLE,rhs_rank,SS_DBG_TIMING_MSG,
+                  adlb_tel_comm,iq_req(iq_slot));
+        dbg_msg_is_out = 1;
+        prev_dbg_msg_start = now;
+        server_timer_disarm(ADLB_TIMER_DBG_TIMING);  /* rearmed when it gets back */
+    }
+}
+
+static void timer_logatds(double now)
+{
+    if (num_events_since_logatds == 0)
+        return;
+    log_at_debug_server();
+    num_events_since_logatds = 0;
+    num_reserves_since_logatds = 0;
+    num_reserves_immed_sat_since_logatds = 0;
+    num_reserves_not_in_stat_vec = 0;
+    num_rfr_failed_since_logatds = 0;
+    num_ss_msgs_handled_since_logatds = 0;
+}
+
+static void server_timer_arm(int timer, double due)
+{
+    server_timers[timer].next_due = due;
+    if (due < server_timers_next_due)
+        server_timers_next_due = due;
+}
+
+static void server_timer_disarm(int timer)
+{
+    server_timers[timer].next_due = SERVER_TIMER_OFF;
+}
+
+/* push back an armed timer, e.g. the exhaustion check after a put */
+static void server_timer_defer(int timer, double now)
+{
+    if (server_timers[timer].next_due != SERVER_TIMER_OFF)
+        server_timers[timer].next_due = now + server_timers[timer].interval;
+}
+
+static void server_timers_run_due(double now)
+{
+    int i;
+    double start_time;
+
+    for (i=0; i < ADLB_NUM_TIMERS; i++)
+    {
+        if (server_timers[i].next_due > now)
+            continue;
+        /* rearm first so the task may disarm itself */
+        server_timers[i].next_due = now + server_timers[i].interval;
+        start_time = MPI_Wtime();
+        (*server_timers[i].run)(now);
+        server_timers[i].run_time += MPI_Wtime() - start_time;
+        server_timers[i].run_cnt++;
+    }
+    server_timers_next_due = SERVER_TIMER_OFF;
+    for (i=0; i < ADLB_NUM_TIMERS; i++)
+        if (server_timers[i].next_due < server_timers_next_due)
+            server_timers_next_due = server_timers[i].next_due;
+}
+
+static void preposted_init()
+{
+    int i, j, per_tag;
+
+    per_tag = (num_apps_this_server > 0) ? num_apps_this_server : 1;
+    num_preposted = NUM_PREPOSTED_TAGS * per_tag;
+    preposted_reqs = amalloc(num_preposted * sizeof(MPI_Request));
+    preposted_bufs = amalloc(num_preposted * IBUF_NUMINTS * sizeof(int));
+    for (i=0; i < NUM_PREPOSTED_TAGS; i++)
+        for (j=0; j < per_tag; j++)
+            MPI_Recv_init(&preposted_bufs[(i*per_tag+j)*IBUF_NUMINTS],IBUF_NUMINTS,MPI_INT,
+                          MPI_ANY_SOURCE,preposted_tags[i],adlb_all_comm,
+                          &preposted_reqs[i*per_tag+j]);
+    MPI_Startall(num_preposted,preposted_reqs);
+}
+
+static void preposted_free()
+{
+    int i;
+    MPI_Status status;
+
+    for (i=0; i < num_preposted; i++)
+    {
+        MPI_Cancel(&preposted_reqs[i]);
+        MPI_Wait(&preposted_reqs[i],&status);
+        MPI_Request_free(&preposted_reqs[i]);
+    }
+    afree(preposted_reqs,num_preposted * sizeof(MPI_Request));
+    afree(preposted_bufs,num_preposted * IBUF_NUMINTS * sizeof(int));
+    num_preposted = 0;
+}
+
+/* The server matches each msg once: server_probe finds it either in a
+   preposted slot or on one comm's unexpected queue, and the handler's first
+   recv, server_recv, reads it from there.  The sources are tried round-robin,
+   starting one further along on each call, so none can starve the others.
+   Without MPI-3 matched probes the unexpected queues fall back to
+   Iprobe + Recv. */
+static int server_probe(int *flag, MPI_Status *status)
+{
+    static int first_src = 0;
+    int rc, pass, src;
+
+    rc = MPI_SUCCESS;
+    *flag = 0;
+    first_src = (first_src + 1) % (NUM_PROBE_COMMS + 1);
+    for (pass=0; pass < NUM_PROBE_COMMS + 1  &&  ! *flag; pass++)
+    {
+        src = (first_src + pass) % (NUM_PROBE_COMMS + 1);
+        /* do PMPI_xxxx calls to avoid frequent logging */
+        if (src == NUM_PROBE_COMMS)
+        {
+            rc = PMPI_Testany(num_preposted,preposted_reqs,&server_msg_slot,flag,status);
+            if (server_msg_slot == MPI_UNDEFINED)
             {
-                ws = wq_node->data;
-                if (ws->work_type == work_type)
-                {
-                    if (ws->work_prio > info_buf[0])
-                        info_buf[0] = ws->work_prio;
-                    info_buf[2]++;
-                }
+                server_msg_slot = -1;
+                *flag = 0;
             }
-            for (wq_node=xq_first(wq); wq_node; wq_node=xq_next(wq,wq_node))
+        }
+        else
+        {
+#if MPI_VERSION >= 3
+            rc = PMPI_Improbe(MPI_ANY_SOURCE,MPI_ANY_TAG,*probe_comms[src],flag,
+                              &server_msg,status);
+#else
+            rc = PMPI_Iprobe(MPI_ANY_SOURCE,MPI_ANY_TAG,*probe_comms[src],flag,status);
+            if (*flag)
             {
-                ws = wq_node->data;
-                if (ws->work_type == work_type  &&  ws->work_prio == info_buf[0])
-                    info_buf[1]++;
+                server_msg_source = status->MPI_SOURCE;
+                server_msg_tag = status->MPI_TAG;
+                server_msg_comm = *probe_comms[src];
             }
-            rc = MPI_Ssend(info_buf,IBUF_NUMINTS,MPI_INT,from_rank,TA_ACK_AND_RC,
-                           adlb_all_comm);
+#endif
+        }
+    }
+    return rc;
+}
+
+static int server_gather_batch(MPI_Request *qmstat_req)
+{
+    int i, j, n, tag_idx, flag;
+    server_batch_entry_t temp;
+
+    n = 0;
+    /* do PMPI_xxxx calls to avoid frequent logging */
+    PMPI_Test(qmstat_req,&flag,&server_batch[n].status);
+    while (n < server_batch_max)
+    {
+        if ( ! flag )
+        {
+            server_probe(&flag,&server_batch[n].status);
+            if ( ! flag )
+                break;
         }
+#if MPI_VERSION >= 3
+        server_batch[n].msg = server_msg;
+        server_msg = MPI_MESSAGE_NULL;
+#endif
+        server_batch[n].slot = server_msg_slot;
+        server_msg_slot = -1;
+        tag_idx = server_batch[n].status.MPI_TAG - SERVER_TAG_BASE;
+        if (tag_idx >= 0  &&  tag_idx < NUM_SERVER_TAGS)
+            server_batch[n].prio = msg_class_prio[server_handler_class[tag_idx]];
         else
+            server_batch[n].prio = -1;    /* let the loop report it right away */
+        n++;
+        flag = 0;
+        /* its handler receives the SS_PUSH_WORK that follows it, so do not let
+           a probe match that first */
+        if (server_batch[n-1].status.MPI_TAG == SS_PUSH_HDR)
+            break;
+        /* these can end the loop; do not match msgs that would be left behind */
+        if (server_batch[n-1].status.MPI_TAG == SS_END_LOOP_2          ||
+            server_batch[n-1].status.MPI_TAG == SS_DONE_BY_EXHAUSTION  ||
+            server_batch[n-1].status.MPI_TAG == FA_ADLB_ABORT)
+            break;
+#if MPI_VERSION < 3
+        if (server_batch[n-1].slot < 0)    /* only one unmatched probe at a time */
+            break;
+#endif
+    }
+    /* stable insertion sort by class priority; a msg never moves ahead of
+       an earlier one from the same rank, so each rank's msgs keep the order
+       the protocol expects and only the interleaving across ranks changes */
+    for (i=1; i < n; i++)
+    {
+        temp = server_batch[i];
+        for (j=i; j > 0  &&  server_batch[j-1].prio > temp.prio
+                         &&  server_batch[j-1].status.MPI_SOURCE != temp.status.MPI_SOURCE; j--)
+            server_batch[j] = server_batch[j-1];
+        server_batch[j] = temp;
+    }
+    return n;
+}
+
+/* receives and drops batch entries first..nbatch-1, which were matched by a
+   probe or completed in a preposted slot before a handler ended the loop */
+static void server_discard_batch(int first, int nbatch)
+{
+    int b, count, info_buf[IBUF_NUMINTS];
+    char *buf;
+    MPI_Status status;
+
+    for (b=first; b < nbatch; b++)
+    {
+        status = server_batch[b].status;
+        aprintf(0000,"discarding msg tag %d from %d at end of loop\n",
+                status.MPI_TAG,status.MPI_SOURCE);
+        server_msg_slot = server_batch[b].slot;
+#if MPI_VERSION >= 3
+        server_msg = server_batch[b].msg;
+#endif
+        if (server_msg_slot >= 0)
+            server_recv(info_buf,IBUF_NUMINTS,MPI_INT,&status);
+        else if (status.MPI_TAG != SS_QMSTAT)    /* qmstat already landed in its buf */
         {
-            aprintf(1,"** adlb_server: unexpected tag %d recvd from %d on adlb_all_comm\n",
-                    from_tag,from_rank);
-            exit(-1);
+            MPI_Get_count(&status,MPI_BYTE,&count);
+            buf = amalloc(count > 0 ? count : 1);
+            server_recv(buf,count,MPI_BYTE,&status);
+            afree(buf,count > 0 ? count : 1);
         }
     }
-    aprintf(1,"SERVER OUT OF LOOP\n");
-    return ADLB_SUCCESS;
+}
+
+static int server_recv(void *buf, int count, MPI_Datatype datatype, MPI_Status *status)
+{
+    if (server_msg_slot >= 0)
+    {
+        /* already received by the loop; status still describes it */
+        if (datatype != MPI_INT  ||  count != IBUF_NUMINTS)
+        {
+            aprintf(1,"** server_recv: preposted msg tag %d read as %d items\n",
+                    status->MPI_TAG,count);
+            adlb_server_abort(-1,1);
+        }
+        memcpy(buf,&preposted_bufs[server_msg_slot*IBUF_NUMINTS],IBUF_NUMINTS * sizeof(int));
+        MPI_Start(&preposted_reqs[server_msg_slot]);
+        server_msg_slot = -1;
+        return MPI_SUCCESS;
+    }
+#if MPI_VERSION >= 3
+    return MPI_Mrecv(buf,count,datatype,&server_msg,status);
+#else
+    return MPI_Recv(buf,count,datatype,server_msg_source,server_msg_tag,server_msg_comm,status);
+#endif
+}
+
+/* Isends a copy of ints that the iq owns until the send completes, so the
+   server never waits for an app to match a reply or notification. */
+static void isend_ints(int *ints, int nints, int to_rank, int tag)
+{
+    int *buf, iq_slot;
+
+    buf = amalloc(nints * sizeof(int));
+    memcpy(buf,ints,nints * sizeof(int));
+    iq_slot = iq_slot_create(nints * sizeof(int),buf);
+    MPI_Isend(buf,nints,MPI_INT,to_rank,tag,adlb_all_comm,iq_req(iq_slot));
+}
+
+static void server_idle_sleep(double secs)
+{
+    struct timespec ts;
+
+    if (secs <= 0.0)
+        return;
+    ts.tv_sec  = (time_t) secs;
+    ts.tv_nsec = (long) ((secs - (double) ts.tv_sec) * 1000000000.0);
+    nanosleep(&ts,NULL);
+    num_idle_sleeps++;
+    total_idle_sleep_time += secs;
+}
+
+static void register_server_handler(int tag, server_handler_t handler, char *name, int msg_class)
+{
+    server_handlers[tag-SERVER_TAG_BASE] = handler;
+    server_handler_names[tag-SERVER_TAG_BASE] = name;
+    server_handler_class[tag-SERVER_TAG_BASE] = msg_class;
+}
+
+static void register_server_handlers()
+{
+    int i;
+
+    for (i=0; i < NUM_SERVER_TAGS; i++)
+    {
+        server_handlers[i] = NULL;
+        server_handler_names[i] = NULL;
+        server_handler_class[i] = ADLB_MSG_CLASS_BALANCE;
+        server_handler_time[i] = 0.0;
+        server_handler_cnt[i] = 0.0;
+    }
+    register_server_handler(FA_PUT_HDR,handle_fa_put_hdr,"FA_PUT_HDR",
+                            ADLB_MSG_CLASS_BALANCE);
+    register_server_handler(FA_PUT_EAGER,handle_fa_put_eager,"FA_PUT_EAGER",
+                            ADLB_MSG_CLASS_BALANCE);
+    register_server_handler(FA_PUT_MANY,handle_fa_put_many,"FA_PUT_MANY",
+                            ADLB_MSG_CLASS_BALANCE);
+    register_server_handler(FA_PUT_COMMON_HDR,handle_fa_put_common_hdr,"FA_PUT_COMMON_HDR",
+                            ADLB_MSG_CLASS_BALANCE);
+    register_server_handler(FA_PUT_BATCH_DONE,handle_fa_put_batch_done,"FA_PUT_BATCH_DONE",
+                            ADLB_MSG_CLASS_BALANCE);
+    register_server_handler(FA_DID_PUT_AT_REMOTE,handle_fa_did_put_at_remote,"FA_DID_PUT_AT_REMOTE",
+                            ADLB_MSG_CLASS_BALANCE);
+    register_server_handler(FA_GET_WORK,handle_fa_reserve,"FA_GET_WORK",
+                            ADLB_MSG_CLASS_REQUEST);
+    register_server_handler(FA_RESERVE,handle_fa_reserve,"FA_RESERVE",
+                            ADLB_MSG_CLASS_REQUEST);
+    register_server_handler(FA_GET_COMMON,handle_fa_get_common,"FA_GET_COMMON",
+                            ADLB_MSG_CLASS_REQUEST);
+    register_server_handler(FA_GET_RESERVED,handle_fa_get_reserved,"FA_GET_RESERVED",
+                            ADLB_MSG_CLASS_REQUEST);
+    register_server_handler(FA_NO_MORE_WORK,handle_fa_no_more_work,"FA_NO_MORE_WORK",
+                            ADLB_MSG_CLASS_BALANCE);
+    register_server_handler(SS_NO_MORE_WORK,handle_ss_no_more_work,"SS_NO_MORE_WORK",
+                            ADLB_MSG_CLASS_BALANCE);
+    register_server_handler(SS_END_LOOP_1,handle_ss_end_loop_1,"SS_END_LOOP_1",
+                            ADLB_MSG_CLASS_BALANCE);
+    register_server_handler(SS_END_LOOP_2,handle_ss_end_loop_2,"SS_END_LOOP_2",
+                            ADLB_MSG_CLASS_BALANCE);
+    register_server_handler(SS_EXHAUST_CHK_LOOP_1,handle_ss_exhaust_chk_loop_1,"SS_EXHAUST_CHK_LOOP_1",
+                            ADLB_MSG_CLASS_BALANCE);
+    register_server_handler(SS_EXHAUST_CHK_LOOP_2,handle_ss_exhaust_chk_loop_2,"SS_EXHAUST_CHK_LOOP_2",
+                            ADLB_MSG_CLASS_BALANCE);
+    register_server_handler(SS_DONE_BY_EXHAUSTION,handle_ss_done_by_exhaustion,"SS_DONE_BY_EXHAUSTION",
+                            ADLB_MSG_CLASS_BALANCE);
+    register_server_handler(SS_DBG_TIMING_MSG,handle_ss_dbg_timing_msg,"SS_DBG_TIMING_MSG",
+                            ADLB_MSG_CLASS_STATS);
+    register_server_handler(SS_QMSTAT,handle_ss_qmstat,"SS_QMSTAT",
+                            ADLB_MSG_CLASS_BALANCE);
+    register_server_handler(FA_LOCAL_APP_DONE,handle_fa_local_app_done,"FA_LOCAL_APP_DONE",
+                            ADLB_MSG_CLASS_BALANCE);
+    register_server_handler(SS_RFR,handle_ss_rfr,"SS_RFR",
+                            ADLB_MSG_CLASS_REQUEST);
+    register_server_handler(SS_RFR_RESP,handle_ss_rfr_resp,"SS_RFR_RESP",
+                            ADLB_MSG_CLASS_REQUEST);
+    register_server_handler(SS_UNRESERVE,handle_ss_unreserve,"SS_UNRESERVE",
+                            ADLB_MSG_CLASS_BALANCE);
+    register_server_handler(FA_UNRESERVE,handle_ss_unreserve,"FA_UNRESERVE",
+                            ADLB_MSG_CLASS_REQUEST);
+    register_server_handler(SS_MOVING_TARGETED_WORK,handle_ss_moving_targeted_work,"SS_MOVING_TARGETED_WORK",
+                            ADLB_MSG_CLASS_BALANCE);
+    register_server_handler(SS_PUSH_QUERY,handle_ss_push_query,"SS_PUSH_QUERY",
+                            ADLB_MSG_CLASS_BALANCE);
+    register_server_handler(SS_PUSH_QUERY_RESP,handle_ss_push_query_resp,"SS_PUSH_QUERY_RESP",
+                            ADLB_MSG_CLASS_BALANCE);
+    register_server_handler(SS_PUSH_HDR,handle_ss_push_hdr,"SS_PUSH_HDR",
+                            ADLB_MSG_CLASS_BALANCE);
+    register_server_handler(SS_PUSH_DEL,handle_ss_push_del,"SS_PUSH_DEL",
+                            ADLB_MSG_CLASS_BALANCE);
+    register_server_handler(FA_ADLB_ABORT,handle_fa_adlb_abort,"FA_ADLB_ABORT",
+                            ADLB_MSG_CLASS_BALANCE);
+    register_server_handler(FA_LOG,handle_fa_log,"FA_LOG",
+                            ADLB_MSG_CLASS_STATS);
+    register_server_handler(SS_ADLB_ABORT,handle_ss_adlb_abort,"SS_ADLB_ABORT",
+                            ADLB_MSG_CLASS_BALANCE);
+    register_server_handler(SS_PERIODIC_STATS,handle_ss_periodic_stats,"SS_PERIODIC_STATS",
+                            ADLB_MSG_CLASS_STATS);
+    register_server_handler(FA_INFO_NUM_WORK_UNITS,handle_fa_info_num_work_units,"FA_INFO_NUM_WORK_UNITS",
+                            ADLB_MSG_CLASS_BALANCE);
 }
 
 static void adlb_server_abort(int code, int mpi_abort_flag)
@@ -2516,7 +3461,7 @@ static void adlb_server_abort(int code, int mpi_abort_flag)
     info_buf[1] = my_world_rank;  /* originating rank */
     info_buf[2] = my_world_rank;  /* server for rank (myself) */
     MPI_Isend(info_buf,IBUF_NUMINTS,MPI_INT,rhs_rank,SS_ADLB_ABORT,
-              adlb_all_comm,&dummy_req);
+              adlb_bal_comm,&dummy_req);
     sleep(10);  // give all servers a chance to dump their info
     if (mpi_abort_flag)  /* client should do the abort */
     {
@@ -2534,6 +3479,7 @@ int ADLBP_Debug_server(double timeout)
         aggr_ss_msgs_handled = 0, aggr_unexpected_msgqcnt = 0;
     double prev_recv_time, prev_minute_mark;
     MPI_Status status;
+    MPI_Comm probe_comm;
 
     aprintf(1,"I am DEBUG SERVER\n");
     aprintf(1,"** debug_server logging output fields: "   /* multi-line str */
@@ -2594,11 +3540,18 @@ int ADLBP_Debug_server(double timeout)
             aggr_unexpected_msgqcnt = 0;
             prev_minute_mark = MPI_Wtime();
         }
-        rc = MPI_Iprobe(MPI_ANY_SOURCE,MPI_ANY_TAG,adlb_all_comm,&msg_available,&status);
+        /* servers log and end on adlb_tel_comm; an app aborts on adlb_all_comm */
+        probe_comm = adlb_tel_comm;
+        rc = MPI_Iprobe(MPI_ANY_SOURCE,MPI_ANY_TAG,probe_comm,&msg_available,&status);
+        if ( ! msg_available )
+        {
+            probe_comm = adlb_all_comm;
+            rc = MPI_Iprobe(MPI_ANY_SOURCE,MPI_ANY_TAG,probe_comm,&msg_available,&status);
+        }
         if ( ! msg_available )
             continue;
-        rc = MPI_Recv(info_buf,IBUF_NUMINTS,MPI_INT,MPI_ANY_SOURCE,MPI_ANY_TAG,
-                      adlb_all_comm,&status);
+        rc = MPI_Recv(info_buf,IBUF_NUMINTS,MPI_INT,status.MPI_SOURCE,status.MPI_TAG,
+                      probe_comm,&status);
         if (status.MPI_TAG == DS_LOG)
         {
             prev_recv_time = MPI_Wtime();  /* reset time */
@@ -2728,6 +3681,7 @@ int ADLBP_End_batch_put()
 
     // sprintf(log_buf,"EBs\n");
     // MPI_Ssend(log_buf,100,MPI_BYTE,my_server_rank,FA_LOG,adlb_all_comm);
+    iput_wait_all();  /* so common_refcnt counts the batch's Iputs */
     rc = ADLB_SUCCESS;  /* may be reset below */
     if (common_server_rank >= 0)
     {
@@ -2751,118 +3705,595 @@ int ADLBP_End_batch_put()
 }
 
 
-int ADLBP_Put(void *work_buf, int work_len, int target_rank, int answer_rank,
-              int work_type, int work_prio)
+int ADLBP_Put(void *work_buf, int work_len, int target_rank, int answer_rank,
+              int work_type, int work_prio)
+{
+    int rc, put_attempt_cntr, sleep_cntr, home_server_rank, to_server_rank, eager, msglen,
+        other_servers_may_have_space, send_buf[IBUF_NUMINTS], info_buf[IBUF_NUMINTS];
+    MPI_Status status;
+    MPI_Request request;
+
+    if (work_type < -1  ||  get_type_idx(work_type) < 0)
+    {
+        aprintf(1,"** invalid work_type %d to ADLB_Put\n",work_type);
+        ADLBP_Abort(-1);
+    }
+    if (target_rank >= 0)
+        to_server_rank = num_app_ranks + (target_rank % num_servers);
+    else
+    {
+        to_server_rank = next_server_rank_for_put++;
+        if (next_server_rank_for_put >= (master_server_rank+num_servers))
+            next_server_rank_for_put = master_server_rank;
+    }
+    /* small work goes eagerly: hdr and payload in one msg, one reply */
+    eager = (work_len <= put_eager_max);
+    if (eager)
+    {
+        msglen = IBUF_NUMINTS * sizeof(int) + work_len;
+        if (msglen > put_eager_buflen)
+        {
+            if (put_eager_buf)
+                afree(put_eager_buf,put_eager_buflen);
+            put_eager_buf = amalloc(msglen);
+            put_eager_buflen = msglen;
+        }
+        memcpy(put_eager_buf + IBUF_NUMINTS * sizeof(int),work_buf,work_len);
+    }
+    other_servers_may_have_space = 1;  /* reset below */
+    home_server_rank = to_server_rank;
+    sleep_cntr = 0;
+    put_attempt_cntr = 0;
+    while (1)
+    {
+        if (put_attempt_cntr  &&  (put_attempt_cntr % num_servers) == 0)
+        {
+            if (put_attempt_cntr >= (num_servers*2)  &&  ! other_servers_may_have_space)
+            {
+                aprintf(1,"** put: put_attempt_cntr %d\n",put_attempt_cntr);
+                sleep(1);
+                sleep_cntr++;
+                if (sleep_cntr > 1000)
+                {
+                    aprintf(1,"** rejecting put; put_attempt_cntr %d\n",put_attempt_cntr);
+                    return ADLB_PUT_REJECTED;
+                }
+            }
+            other_servers_may_have_space = 0;
+            /* may use a nanosleep here sometime; about qmstat_interval */
+        }
+        put_attempt_cntr++;
+        send_buf[0] = work_type;
+        send_buf[1] = work_prio;
+        send_buf[2] = answer_rank;
+        send_buf[3] = target_rank;
+        send_buf[4] = work_len;
+        send_buf[5] = home_server_rank;
+        if (inside_batch_put[my_world_rank])
+            send_buf[6] = 1;  /* inside batch but not necessarily with common */
+        else
+            send_buf[6] = 0;
+        send_buf[7] = common_len;
+        send_buf[8] = common_server_rank;  /* >= 0 -> this is unique part for a common */
+        send_buf[9] = common_server_commseqno;  /**/
+        send_buf[10] = 0;  /* reply with TA_ACK_AND_RC */
+        rc = MPI_Irecv(info_buf,IBUF_NUMINTS,MPI_INT,to_server_rank,TA_ACK_AND_RC,
+                       adlb_all_comm,&request);
+        if (eager)
+        {
+            memcpy(put_eager_buf,send_buf,IBUF_NUMINTS * sizeof(int));
+            rc = MPI_Send(put_eager_buf,msglen,MPI_BYTE,to_server_rank,FA_PUT_EAGER,
+                          adlb_all_comm);
+        }
+        else
+            rc = MPI_Send(send_buf,IBUF_NUMINTS,MPI_INT,to_server_rank,FA_PUT_HDR,adlb_all_comm);
+        rc = MPI_Wait(&request,&status);
+        if (info_buf[0] == ADLB_NO_MORE_WORK)
+        {
+            aprintf(1,"RETURNING NO_MORE_WORK TO APP\n");
+            return info_buf[0];
+        }
+        else if (info_buf[0] == ADLB_DONE_BY_EXHAUSTION)
+        {
+            // aprintf(1,"RETURNING DONE_BY_EXHAUSTION TO APP\n");
+            return info_buf[0];
+        }
+        if (info_buf[0] == ADLB_PUT_REJECTED)
+        {
+            if (info_buf[2] == 1)
+                aprintf(1,"put rejected by %d for %d bytes due to threshold violation\n",
+                        to_server_rank,work_len);
+            else if (info_buf[2] == 2)
+                aprintf(1,"put rejected by %d for %d bytes due to probable fragmentation\n",
+                        to_server_rank,work_len);
+            if (info_buf[1] >= 0)  /* rank of another server that may have data */
+                other_servers_may_have_space = 1;
+            to_server_rank = next_server_rank_for_put++;
+            if (next_server_rank_for_put >= (master_server_rank+num_servers))
+                next_server_rank_for_put = master_server_rank;
+            continue;
+        }
+        if (info_buf[0] < 0)
+            return info_buf[0];  /* e.g. ERROR */
+        if ( ! eager )  /* else that was the final ack */
+        {
+            rc = MPI_Rsend(work_buf,work_len,MPI_BYTE,to_server_rank,FA_PUT_MSG,adlb_all_comm);
+            rc = MPI_Recv(info_buf,IBUF_NUMINTS,MPI_INT,to_server_rank,TA_ACK_AND_RC,
+                          adlb_all_comm,&status);
+        }
+        if (target_rank >= 0  &&  home_server_rank != to_server_rank)
+        {
+            send_buf[0] = work_type;
+            send_buf[1] = target_rank;
+            send_buf[2] = to_server_rank;
+            rc = MPI_Send(send_buf,IBUF_NUMINTS,MPI_INT,home_server_rank,
+                          FA_DID_PUT_AT_REMOTE,adlb_all_comm);
+        }
+        if (common_len > 0)
+            common_refcnt++;
+        if (info_buf[0] == ADLB_NO_MORE_WORK)
+            aprintf(1,"RETURNING NO_MORE_WORK TO APP\n");
+        // else if (info_buf[0] == ADLB_DONE_BY_EXHAUSTION)
+            // aprintf(1,"RETURNING DONE_BY_EXHAUSTION TO APP\n");
+        if (info_buf[0] < 0)  /* e.g. ERROR  */
+            return info_buf[0];
+        break;
+    }
+    // sprintf(log_buf,"Pe tr %d ty%d\n",to_server_rank,work_type);
+    // MPI_Ssend(log_buf,100,MPI_BYTE,my_server_rank,FA_LOG,adlb_all_comm);
+    return ADLB_SUCCESS;
+}
+
+/* round robin over the servers, skipping any with an Iput of ours in flight
+   unless all have one */
+static int iput_next_server()
+{
+    int i, server_rank;
+
+    server_rank = next_server_rank_for_put;
+    for (i=0; i < num_servers; i++)
+    {
+        server_rank = next_server_rank_for_put++;
+        if (next_server_rank_for_put >= (master_server_rank+num_servers))
+            next_server_rank_for_put = master_server_rank;
+        if (iput_server_busy[server_rank-master_server_rank] < 0)
+            break;
+    }
+    return server_rank;
+}
+
+static void iput_send(int handle)
+{
+    iput_req_t *r = &iput_reqs[handle];
+
+    if (iput_server_busy[r->to_server_rank-master_server_rank] >= 0)
+        return;
+    if (r->retry_time > 0.0  &&  MPI_Wtime() < r->retry_time)
+        return;
+    r->put_attempt_cntr++;
+    MPI_Irecv(r->reply,IBUF_NUMINTS,MPI_INT,r->to_server_rank,TA_IPUT_RESP,
+              adlb_all_comm,&r->reqs[1]);
+    if (r->eager)
+        MPI_Isend(r->buf,r->msglen,MPI_BYTE,r->to_server_rank,FA_PUT_EAGER,
+                  adlb_all_comm,&r->reqs[0]);
+    else
+        MPI_Isend(r->buf,IBUF_NUMINTS,MPI_INT,r->to_server_rank,FA_PUT_HDR,
+                  adlb_all_comm,&r->reqs[0]);
+    iput_server_busy[r->to_server_rank-master_server_rank] = handle;
+    r->state = IPUT_SENT;
+}
+
+static void iput_finish(iput_req_t *r, int rc)
+{
+    afree(r->buf,r->msglen);
+    r->buf = NULL;
+    r->rc = rc;
+    r->state = IPUT_DONE;
+}
+
+/* Moves each outstanding Iput along as far as it can go without blocking;
+   the same steps and retry policy as Put, but a round of rejections sets a
+   time to retry instead of sleeping. */
+static void iput_progress()
+{
+    int h, flag, rc, send_buf[IBUF_NUMINTS];
+    iput_req_t *r;
+
+    for (h=0; h < num_iput_reqs; h++)
+    {
+        r = &iput_reqs[h];
+        if (r->state == IPUT_WAITING)
+        {
+            iput_send(h);
+            continue;
+        }
+        if (r->state != IPUT_SENT  &&  r->state != IPUT_MSG_SENT)
+            continue;
+        MPI_Testall(2,r->reqs,&flag,MPI_STATUSES_IGNORE);
+        if ( ! flag )
+            continue;
+        if (r->state == IPUT_SENT  &&  ! r->eager  &&  r->reply[0] == SUCCESS)
+        {
+            /* the server took the hdr and has posted the recv for the payload */
+            MPI_Irecv(r->reply,IBUF_NUMINTS,MPI_INT,r->to_server_rank,TA_IPUT_RESP,
+                      adlb_all_comm,&r->reqs[1]);
+            MPI_Isend(r->buf + IBUF_NUMINTS * sizeof(int),r->msglen - IBUF_NUMINTS * sizeof(int),
+                      MPI_BYTE,r->to_server_rank,FA_IPUT_MSG,adlb_all_comm,&r->reqs[0]);
+            r->state = IPUT_MSG_SENT;
+            continue;
+        }
+        iput_server_busy[r->to_server_rank-master_server_rank] = -1;
+        if (r->reply[0] == ADLB_PUT_REJECTED)
+        {
+            if (r->reply[2] == 1)
+                aprintf(1,"iput rejected by %d for %d bytes due to threshold violation\n",
+                        r->to_server_rank,((int *)r->buf)[4]);
+            else if (r->reply[2] == 2)
+                aprintf(1,"iput rejected by %d for %d bytes due to probable fragmentation\n",
+                        r->to_server_rank,((int *)r->buf)[4]);
+            if (r->reply[1] >= 0)  /* rank of another server that may have data */
+                r->other_servers_may_have_space = 1;
+            r->to_server_rank = iput_next_server();
+            if ((r->put_attempt_cntr % num_servers) == 0)
+            {
+                if (r->put_attempt_cntr >= (num_servers*2)  &&  ! r->other_servers_may_have_space)
+                {
+                    aprintf(1,"** iput: put_attempt_cntr %d\n",r->put_attempt_cntr);
+                    r->retry_time = MPI_Wtime() + 1.0;
+                    r->sleep_cntr++;
+                    if (r->sleep_cntr > 1000)
+                    {
+                        aprintf(1,"** rejecting iput; put_attempt_cntr %d\n",
+                                r->put_attempt_cntr);
+                        iput_finish(r,ADLB_PUT_REJECTED);
+                        continue;
+                    }
+                }
+                r->other_servers_may_have_space = 0;
+            }
+            r->state = IPUT_WAITING;
+            iput_send(h);
+            continue;
+        }
+        rc = r->reply[0];
+        if (rc == ADLB_NO_MORE_WORK)
+            aprintf(1,"RETURNING NO_MORE_WORK TO APP\n");
+        if (rc >= 0)
+        {
+            if (r->target_rank >= 0  &&  r->home_server_rank != r->to_server_rank)
+            {
+                send_buf[0] = ((int *)r->buf)[0];  /* work_type */
+                send_buf[1] = r->target_rank;
+                send_buf[2] = r->to_server_rank;
+                MPI_Send(send_buf,IBUF_NUMINTS,MPI_INT,r->home_server_rank,
+                         FA_DID_PUT_AT_REMOTE,adlb_all_comm);
+            }
+            if (((int *)r->buf)[7] > 0)  /* common_len when it was Iput */
+                common_refcnt++;
+            rc = ADLB_SUCCESS;
+        }
+        iput_finish(r,rc);
+    }
+}
+
+static void iput_wait_all()
+{
+    int h, pending;
+
+    do
+    {
+        iput_progress();
+        pending = 0;
+        for (h=0; h < num_iput_reqs; h++)
+            if (iput_reqs[h].state == IPUT_WAITING  ||  iput_reqs[h].state == IPUT_SENT
+            ||  iput_reqs[h].state == IPUT_MSG_SENT)
+                pending = 1;
+    } while (pending);
+}
+
+/* Like Put, but returns at once with a handle for Test/Wait; work_buf is
+   copied, so the app may reuse it right away.  Iputs to different servers
+   proceed at the same time. */
+int ADLBP_Iput(void *work_buf, int work_len, int target_rank, int answer_rank,
+               int work_type, int work_prio, int *put_req)
+{
+    int i, h, new_num, *hdr;
+    iput_req_t *r, *old_reqs;
+
+    if (work_type < -1  ||  get_type_idx(work_type) < 0)
+    {
+        aprintf(1,"** invalid work_type %d to ADLB_Iput\n",work_type);
+        ADLBP_Abort(-1);
+    }
+    if (iput_server_busy == NULL)
+    {
+        iput_server_busy = amalloc(num_servers * sizeof(int));
+        for (h=0; h < num_servers; h++)
+            iput_server_busy[h] = -1;
+    }
+    for (h=0; h < num_iput_reqs; h++)
+        if (iput_reqs[h].state == IPUT_FREE)
+            break;
+    if (h == num_iput_reqs)  /* none free; double the table */
+    {
+        new_num = (num_iput_reqs > 0) ? 2 * num_iput_reqs : 16;
+        old_reqs = iput_reqs;
+        iput_reqs = amalloc(new_num * sizeof(iput_req_t));
+        if (old_reqs)
+        {
+            memcpy(iput_reqs,old_reqs,num_iput_reqs * sizeof(iput_req_t));
+            afree(old_reqs,num_iput_reqs * sizeof(iput_req_t));
+        }
+        for (i=num_iput_reqs; i < new_num; i++)
+        {
+            iput_reqs[i].state = IPUT_FREE;
+            iput_reqs[i].reply = amalloc(IBUF_NUMINTS * sizeof(int));
+        }
+        num_iput_reqs = new_num;
+    }
+    r = &iput_reqs[h];
+    if (target_rank >= 0)
+        r->to_server_rank = num_app_ranks + (target_rank % num_servers);
+    else
+        r->to_server_rank = iput_next_server();
+    r->home_server_rank = r->to_server_rank;
+    r->target_rank = target_rank;
+    r->eager = (work_len <= put_eager_max);
+    r->msglen = IBUF_NUMINTS * sizeof(int) + work_len;
+    r->buf = amalloc(r->msglen);
+    hdr = (int *) r->buf;
+    hdr[0] = work_type;
+    hdr[1] = work_prio;
+    hdr[2] = answer_rank;
+    hdr[3] = target_rank;
+    hdr[4] = work_len;
+    hdr[5] = r->home_server_rank;
+    hdr[6] = inside_batch_put[my_world_rank] ? 1 : 0;
+    hdr[7] = common_len;
+    hdr[8] = common_server_rank;
+    hdr[9] = common_server_commseqno;
+    hdr[10] = 1;  /* reply with TA_IPUT_RESP */
+    hdr[11] = 0;
+    memcpy(r->buf + IBUF_NUMINTS * sizeof(int),work_buf,work_len);
+    r->put_attempt_cntr = 0;
+    r->sleep_cntr = 0;
+    r->other_servers_may_have_space = 1;
+    r->retry_time = 0.0;
+    r->state = IPUT_WAITING;
+    *put_req = h;
+    iput_progress();
+    return ADLB_SUCCESS;
+}
+
+/* sets flag when the Iput is done and then returns its rc (as Put would),
+   releasing the handle; else returns ADLB_SUCCESS */
+int ADLBP_Test(int put_req, int *flag)
+{
+    iput_req_t *r;
+
+    *flag = 0;
+    if (put_req < 0  ||  put_req >= num_iput_reqs  ||  iput_reqs[put_req].state == IPUT_FREE)
+        return ADLB_ERROR;
+    iput_progress();
+    r = &iput_reqs[put_req];
+    if (r->state != IPUT_DONE)
+        return ADLB_SUCCESS;
+    *flag = 1;
+    r->state = IPUT_FREE;
+    return r->rc;
+}
+
+int ADLBP_Wait(int put_req)
 {
-    int rc, put_attempt_cntr, sleep_cntr, home_server_rank, to_server_rank,
-        other_servers_may_have_space, send_buf[IBUF_NUMINTS], info_buf[IBUF_NUMINTS];
-    MPI_Status status;
-    MPI_Request request;
+    int rc, flag;
 
-    if (work_type < -1  ||  get_type_idx(work_type) < 0)
+    do
     {
-        aprintf(1,"** invalid work_type %d to ADLB_Put\n",work_type);
-        ADLBP_Abort(-1);
+        rc = ADLBP_Test(put_req,&flag);
+    } while ( ! flag  &&  rc == ADLB_SUCCESS);
+    return rc;
+}
+
+/* Puts num_units units, sending those of at most put_eager_max bytes as
+   FA_PUT_MANY msgs per server, each at most PUT_MANY_MAX_UNITS units and
+   PUT_STAGE_BYTES, and any larger ones via Put.  Untargeted units
+   go round robin over the servers as with Put; units a server rejects are
+   regrouped for the next servers, with Put's retry policy applied to each
+   round.  Returns the first non-SUCCESS rc, as Put would. */
+int ADLBP_Put_many(int num_units, void *work_bufs[], int work_lens[], int target_ranks[],
+                   int answer_ranks[], int work_types[], int work_prios[])
+{
+    int i, k, rc, sidx, num_pending, num_rejected, put_attempt_cntr, sleep_cntr,
+        other_servers_may_have_space, send_buf[IBUF_NUMINTS];
+    int *to_server, *home_server, *retry_server, *group_cnt, *group_len, **replies, *hdr;
+    char **msgs, *p, *in_group;
+    MPI_Request *reqs;
+
+    for (i=0; i < num_units; i++)
+    {
+        if (work_types[i] < -1  ||  get_type_idx(work_types[i]) < 0)
+        {
+            aprintf(1,"** invalid work_type %d to ADLB_Put_many\n",work_types[i]);
+            ADLBP_Abort(-1);
+        }
     }
-    if (target_rank >= 0)
-        to_server_rank = num_app_ranks + (target_rank % num_servers);
-    else
+    if (num_units <= 0)
+        return ADLB_SUCCESS;
+    to_server   = amalloc(num_units * sizeof(int));
+    home_server = amalloc(num_units * sizeof(int));
+    retry_server = amalloc(num_units * sizeof(int));
+    in_group    = amalloc(num_units * sizeof(char));
+    group_cnt   = amalloc(num_servers * sizeof(int));
+    group_len   = amalloc(num_servers * sizeof(int));
+    replies     = amalloc(num_servers * sizeof(int *));
+    msgs        = amalloc(num_servers * sizeof(char *));
+    reqs        = amalloc(2 * num_servers * sizeof(MPI_Request));
+    rc = ADLB_SUCCESS;
+    num_pending = 0;
+    for (i=0; i < num_units  &&  rc == ADLB_SUCCESS; i++)
     {
-        to_server_rank = next_server_rank_for_put++;
-        if (next_server_rank_for_put >= (master_server_rank+num_servers))
-            next_server_rank_for_put = master_server_rank;
+        to_server[i] = -1;  /* done */
+        if (work_lens[i] > put_eager_max)
+        {
+            rc = ADLBP_Put(work_bufs[i],work_lens[i],target_ranks[i],answer_ranks[i],
+                           work_types[i],work_prios[i]);
+            continue;
+        }
+        if (target_ranks[i] >= 0)
+            to_server[i] = num_app_ranks + (target_ranks[i] % num_servers);
+        else
+        {
+            to_server[i] = next_server_rank_for_put++;
+            if (next_server_rank_for_put >= (master_server_rank+num_servers))
+                next_server_rank_for_put = master_server_rank;
+        }
+        home_server[i] = to_server[i];
+        num_pending++;
     }
     other_servers_may_have_space = 1;  /* reset below */
-    home_server_rank = to_server_rank;
     sleep_cntr = 0;
     put_attempt_cntr = 0;
-    while (1)
+    num_rejected = 1;  /* so the first round counts as an attempt */
+    while (num_pending > 0  &&  rc == ADLB_SUCCESS)
     {
-        if (put_attempt_cntr  &&  (put_attempt_cntr % num_servers) == 0)
+        /* a round that only sends what did not fit in the last one's groups
+           is not another attempt */
+        if (num_rejected  &&  put_attempt_cntr  &&  (put_attempt_cntr % num_servers) == 0)
         {
             if (put_attempt_cntr >= (num_servers*2)  &&  ! other_servers_may_have_space)
             {
-                aprintf(1,"** put: put_attempt_cntr %d\n",put_attempt_cntr);
+                aprintf(1,"** put many: put_attempt_cntr %d\n",put_attempt_cntr);
                 sleep(1);
                 sleep_cntr++;
                 if (sleep_cntr > 1000)
                 {
-                    aprintf(1,"** rejecting put; put_attempt_cntr %d\n",put_attempt_cntr);
-                    return ADLB_PUT_REJECTED;
+                    aprintf(1,"** rejecting put many; put_attempt_cntr %d\n",put_attempt_cntr);
+                    rc = ADLB_PUT_REJECTED;
+                    break;
                 }
             }
             other_servers_may_have_space = 0;
-            /* may use a nanosleep here sometime; about qmstat_interval */
         }
-        put_attempt_cntr++;
-        send_buf[0] = work_type;
-        send_buf[1] = work_prio;
-        send_buf[2] = answer_rank;
-        send_buf[3] = target_rank;
-        send_buf[4] = work_len;
-        send_buf[5] = home_server_rank;
-        if (inside_batch_put[my_world_rank])
-            send_buf[6] = 1;  /* inside batch but not necessarily with common */
-        else
-            send_buf[6] = 0;
-        send_buf[7] = common_len;
-        send_buf[8] = common_server_rank;  /* >= 0 -> this is unique part for a common */
-        send_buf[9] = common_server_commseqno;  /**/
-        rc = MPI_Irecv(info_buf,IBUF_NUMINTS,MPI_INT,to_server_rank,TA_ACK_AND_RC,
-                       adlb_all_comm,&request);
-        rc = MPI_Send(send_buf,IBUF_NUMINTS,MPI_INT,to_server_rank,FA_PUT_HDR,adlb_all_comm);
-        rc = MPI_Wait(&request,&status);
-        if (info_buf[0] == ADLB_NO_MORE_WORK)
+        if (num_rejected)
+            put_attempt_cntr++;
+        num_rejected = 0;
+        /* size each server's group, up to PUT_MANY_MAX_UNITS units and
+           PUT_STAGE_BYTES, leaving the rest for the next round; then frame
+           and send it */
+        for (sidx=0; sidx < num_servers; sidx++)
         {
-            aprintf(1,"RETURNING NO_MORE_WORK TO APP\n");
-            return info_buf[0];
+            group_cnt[sidx] = 0;
+            group_len[sidx] = sizeof(int);
         }
-        else if (info_buf[0] == ADLB_DONE_BY_EXHAUSTION)
+        for (i=0; i < num_units; i++)
         {
-            // aprintf(1,"RETURNING DONE_BY_EXHAUSTION TO APP\n");
-            return info_buf[0];
+            in_group[i] = 0;
+            if (to_server[i] < 0)
+                continue;
+            sidx = to_server[i] - master_server_rank;
+            if (group_cnt[sidx] >= PUT_MANY_MAX_UNITS
+            ||  group_len[sidx] + IBUF_NUMINTS * sizeof(int) + work_lens[i] > PUT_STAGE_BYTES)
+                continue;
+            in_group[i] = 1;
+            group_cnt[sidx]++;
+            group_len[sidx] += IBUF_NUMINTS * sizeof(int) + work_lens[i];
         }
-        if (info_buf[0] == ADLB_PUT_REJECTED)
+        for (sidx=0; sidx < num_servers; sidx++)
         {
-            if (info_buf[2] == 1)
-                aprintf(1,"put rejected by %d for %d bytes due to threshold violation\n",
-                        to_server_rank,work_len);
-            else if (info_buf[2] == 2)
-                aprintf(1,"put rejected by %d for %d bytes due to probable fragmentation\n",
-                        to_server_rank,work_len);
-            if (info_buf[1] >= 0)  /* rank of another server that may have data */
-                other_servers_may_have_space = 1;
-            to_server_rank = next_server_rank_for_put++;
-            if (next_server_rank_for_put >= (master_server_rank+num_servers))
-                next_server_rank_for_put = master_server_rank;
-            continue;
+            reqs[2*sidx] = reqs[2*sidx+1] = MPI_REQUEST_NULL;
+            if (group_cnt[sidx] == 0)
+                continue;
+            msgs[sidx] = amalloc(group_len[sidx]);
+            replies[sidx] = amalloc((2+group_cnt[sidx]) * sizeof(int));
+            memcpy(msgs[sidx],&group_cnt[sidx],sizeof(int));
+            hdr = (int *) (msgs[sidx] + sizeof(int));
+            p = msgs[sidx] + (1 + group_cnt[sidx] * IBUF_NUMINTS) * sizeof(int);
+            for (i=0; i < num_units; i++)
+            {
+                if ( ! in_group[i]  ||  to_server[i] != master_server_rank + sidx)
+                    continue;
+                hdr[0] = work_types[i];
+                hdr[1] = work_prios[i];
+                hdr[2] = answer_ranks[i];
+                hdr[3] = target_ranks[i];
+                hdr[4] = work_lens[i];
+                hdr[5] = home_server[i];
+                hdr[6] = inside_batch_put[my_world_rank] ? 1 : 0;
+                hdr[7] = common_len;
+                hdr[8] = common_server_rank;
+                hdr[9] = common_server_commseqno;
+                hdr[10] = 0;
+                hdr[11] = 0;
+                hdr += IBUF_NUMINTS;
+                memcpy(p,work_bufs[i],work_lens[i]);
+                p += work_lens[i];
+            }
+            MPI_Irecv(replies[sidx],2+group_cnt[sidx],MPI_INT,master_server_rank+sidx,
+                      TA_ACK_AND_RC,adlb_all_comm,&reqs[2*sidx+1]);
+            MPI_Isend(msgs[sidx],group_len[sidx],MPI_BYTE,master_server_rank+sidx,
+                      FA_PUT_MANY,adlb_all_comm,&reqs[2*sidx]);
         }
-        if (info_buf[0] < 0)
-            return info_buf[0];  /* e.g. ERROR */
-        rc = MPI_Rsend(work_buf,work_len,MPI_BYTE,to_server_rank,FA_PUT_MSG,adlb_all_comm);
-        rc = MPI_Recv(info_buf,IBUF_NUMINTS,MPI_INT,to_server_rank,TA_ACK_AND_RC,
-                      adlb_all_comm,&status);
-        if (target_rank >= 0  &&  home_server_rank != to_server_rank)
+        MPI_Waitall(2*num_servers,reqs,MPI_STATUSES_IGNORE);
+        /* units keep their order within a group, so reply k is the kth unit */
+        for (sidx=0; sidx < num_servers; sidx++)
         {
-            send_buf[0] = work_type;
-            send_buf[1] = target_rank;
-            send_buf[2] = to_server_rank;
-            rc = MPI_Send(send_buf,IBUF_NUMINTS,MPI_INT,home_server_rank,
-                          FA_DID_PUT_AT_REMOTE,adlb_all_comm);
+            if (group_cnt[sidx] == 0)
+                continue;
+            if (replies[sidx][0] != SUCCESS  &&  rc == ADLB_SUCCESS)
+                rc = replies[sidx][0];    /* e.g. NO_MORE_WORK */
+            if (replies[sidx][1] >= 0)  /* rank of another server that may have data */
+                other_servers_may_have_space = 1;
+            k = 2;
+            for (i=0; i < num_units; i++)
+            {
+                if ( ! in_group[i]  ||  to_server[i] != master_server_rank + sidx)
+                    continue;
+                if (replies[sidx][k] == ADLB_PUT_REJECTED)
+                {
+                    num_rejected++;
+                    retry_server[i] = next_server_rank_for_put++;
+                    if (next_server_rank_for_put >= (master_server_rank+num_servers))
+                        next_server_rank_for_put = master_server_rank;
+                }
+                else
+                {
+                    if (replies[sidx][k] == SUCCESS)
+                    {
+                        if (target_ranks[i] >= 0  &&  home_server[i] != to_server[i])
+                        {
+                            send_buf[0] = work_types[i];
+                            send_buf[1] = target_ranks[i];
+                            send_buf[2] = to_server[i];
+                            MPI_Send(send_buf,IBUF_NUMINTS,MPI_INT,home_server[i],
+                                     FA_DID_PUT_AT_REMOTE,adlb_all_comm);
+                        }
+                        if (common_len > 0)
+                            common_refcnt++;
+                    }
+                    retry_server[i] = -1;
+                    num_pending--;
+                }
+                k++;
+            }
+            afree(msgs[sidx],group_len[sidx]);
+            afree(replies[sidx],(2+group_cnt[sidx]) * sizeof(int));
         }
-        if (common_len > 0)
-            common_refcnt++;
-        if (info_buf[0] == ADLB_NO_MORE_WORK)
-            aprintf(1,"RETURNING NO_MORE_WORK TO APP\n");
-        // else if (info_buf[0] == ADLB_DONE_BY_EXHAUSTION)
-            // aprintf(1,"RETURNING DONE_BY_EXHAUSTION TO APP\n");
-        if (info_buf[0] < 0)  /* e.g. ERROR  */
-            return info_buf[0];
-        break;
+        for (i=0; i < num_units; i++)
+            if (in_group[i])
+                to_server[i] = retry_server[i];
     }
-    // sprintf(log_buf,"Pe tr %d ty%d\n",to_server_rank,work_type);
-    // MPI_Ssend(log_buf,100,MPI_BYTE,my_server_rank,FA_LOG,adlb_all_comm);
-    return ADLB_SUCCESS;
+    if (rc == ADLB_NO_MORE_WORK)
+        aprintf(1,"RETURNING NO_MORE_WORK TO APP\n");
+    afree(to_server,num_units * sizeof(int));
+    afree(home_server,num_units * sizeof(int));
+    afree(retry_server,num_units * sizeof(int));
+    afree(in_group,num_units * sizeof(char));
+    afree(group_cnt,num_servers * sizeof(int));
+    afree(group_len,num_servers * sizeof(int));
+    afree(replies,num_servers * sizeof(int *));
+    afree(msgs,num_servers * sizeof(char *));
+    afree(reqs,2 * num_servers * sizeof(MPI_Request));
+    return rc;
 }
 
 int ADLBP_Reserve(int *req_types, int *work_type, int *work_prio, int *work_handle,
@@ -2883,44 +4314,81 @@ int ADLBP_Ireserve(int *req_types, int *work_type, int *work_prio, int *work_han
     return rc;
 }
 
+/* fills in what Reserve returns from a TA_RESERVE_RESP that grants a unit */
+static void reserve_resp_to_handle(int *info_buf, int *work_type, int *work_prio,
+                                   int *work_handle, int *work_len, int *answer_rank)
+{
+    *work_type      = info_buf[1];
+    *work_prio      = info_buf[2];
+    *work_len       = info_buf[3];
+    *answer_rank    = info_buf[4];
+    work_handle[0]  = info_buf[5];  /* seqno of wq work packet */
+    work_handle[1]  = info_buf[6];  /* server rank where data is located */
+    work_handle[2]  = info_buf[7];  /* common_len */
+    if (info_buf[7] > 0)
+        *work_len += info_buf[7];
+    work_handle[3]  = info_buf[8];  /* common_server_rank */
+    work_handle[4]  = info_buf[9];  /* common_server_commseqno */
+    aprintf(0000,"WORKHANDLE totlen %d wkseq %d srvrank %d commlen %d commsrvr %d commseq %d\n",
+            *work_len,work_handle[0],work_handle[1],work_handle[2],work_handle[3],work_handle[4]);
+}
+
 int adlbp_Reserve(int *req_types, int *work_type, int *work_prio, int *work_handle,
                   int *work_len, int *answer_rank, int hang_flag)
 {
-    int i, j, rc, reserve_buf[REQ_TYPE_VECT_SZ+1], info_buf[IBUF_NUMINTS];
+    int i, rc, num_req_types, *reserve_buf, small_buf[1+RQ_INLINE_TYPES], info_buf[IBUF_NUMINTS];
     MPI_Status status;
     MPI_Request request;
 
-    for (i=0; i < REQ_TYPE_VECT_SZ; i++)
+    /* the list ends at the first -1; a -1 first is the wild card */
+    for (num_req_types=0; req_types[num_req_types] != -1; num_req_types++)
     {
-        if (req_types[i] == -1)
-            break;    /* don't validate the rest */
-        if (req_types[i] < -1  ||  (req_types[i] > -1 && (get_type_idx(req_types[i]) < 0)))
+        if (req_types[num_req_types] < -1  ||  get_type_idx(req_types[num_req_types]) < 0)
         {
-            aprintf(1,"** invalid req_type %d to adlb reserve\n",req_types[i]);
+            aprintf(1,"** invalid req_type %d to adlb reserve\n",req_types[num_req_types]);
             ADLBP_Abort(-1);
         }
     }
-    reserve_buf[0] = hang_flag;
-    reserve_buf[1] = req_types[0];
-    for (i=1; i < REQ_TYPE_VECT_SZ; i++)  /* start at 1 */
+    /* a rejected Iput is resent only from here, so before hanging for work
+       make sure none is still looking for a server to take it */
+    if (hang_flag)
+        iput_wait_all();
+    else
+        iput_progress();
+    /* send hang_flag and only the listed types; the wild card is sent as -1 */
+    if (num_req_types == 0)
+        num_req_types = 1;
+    if (prefetch_depth > 0)
     {
-        /* if first or any subsequent is -1, set all rest to -2 (invalid) */
-        if (req_types[0] == -1  ||  req_types[i] == -1)
+        rc = prefetch_take(req_types,num_req_types,work_type,work_prio,work_handle,
+                           work_len,answer_rank);
+        if (rc != NO_CURR_WORK)
         {
-            for (j=i; j < REQ_TYPE_VECT_SZ; j++)
-                reserve_buf[j+1] = -2;
-            break;
+            if (rc == ADLB_SUCCESS)
+                prefetch_refill(req_types,num_req_types);
+            return rc;
         }
-        else
-            reserve_buf[i+1] = req_types[i];
+        /* none held of these types; before hanging for one at the server, give
+           back those held so that no unit is stranded here */
+        if (hang_flag)
+            prefetch_return_all();
     }
+    if (num_req_types <= RQ_INLINE_TYPES)
+        reserve_buf = small_buf;
+    else
+        reserve_buf = malloc((1+num_req_types) * sizeof(int));
+    reserve_buf[0] = hang_flag;
+    for (i=0; i < num_req_types; i++)
+        reserve_buf[i+1] = req_types[i];
     // sprintf(log_buf,"Rs tys %d %d %d %d 3inlist %d\n",
             // req_types[0],req_types[1],req_types[2],req_types[3],j);
     // MPI_Ssend(log_buf,100,MPI_BYTE,my_server_rank,FA_LOG,adlb_all_comm);
     rc = MPI_Irecv(info_buf,IBUF_NUMINTS,MPI_INT,my_server_rank,
                    TA_RESERVE_RESP,adlb_all_comm,&request);
-    rc = MPI_Send(reserve_buf,REQ_TYPE_VECT_SZ+1,MPI_INT,my_server_rank,
+    rc = MPI_Send(reserve_buf,1+num_req_types,MPI_INT,my_server_rank,
                   FA_RESERVE,adlb_all_comm);
+    if (reserve_buf != small_buf)
+        free(reserve_buf);
     rc = MPI_Wait(&request,&status);
     if (info_buf[0] == NO_CURR_WORK)    /* NO_CURR_WORK */
     {
@@ -2932,21 +4400,19 @@ int adlbp_Reserve(int *req_types, int *work_type, int *work_prio, int *work_hand
     }
     else
     {
-        *work_type      = info_buf[1];
-        *work_prio      = info_buf[2];
-        *work_len       = info_buf[3];
-        *answer_rank    = info_buf[4];
-        work_handle[0]  = info_buf[5];  /* seqno of wq work packet */
-        work_handle[1]  = info_buf[6];  /* server rank where data is located */
-        work_handle[2]  = info_buf[7];  /* common_len */
-        if (info_buf[7] > 0)
-            *work_len += info_buf[7];
-        work_handle[3]  = info_buf[8];  /* common_server_rank */
-        work_handle[4]  = info_buf[9];  /* common_server_commseqno */
-        aprintf(0000,"WORKHANDLE totlen %d wkseq %d srvrank %d commlen %d commsrvr %d commseq %d\n",
-                *work_len,work_handle[0],work_handle[1],work_handle[2],work_handle[3],work_handle[4]);
+        reserve_resp_to_handle(info_buf,work_type,work_prio,work_handle,work_len,answer_rank);
         rc = ADLB_SUCCESS;
     }
+    if (prefetch_depth > 0)
+    {
+        if (rc == ADLB_SUCCESS)
+            prefetch_refill(req_types,num_req_types);
+        else if (rc != ADLB_NO_CURRENT_WORK)
+        {
+            prefetch_rc = rc;
+            prefetch_return_all();    /* just frees them now */
+        }
+    }
     if (rc == ADLB_NO_MORE_WORK)
         aprintf(1,"RETURNING NO_MORE_WORK TO APP\n");
     // else if (info_buf[0] == ADLB_DONE_BY_EXHAUSTION)
@@ -2956,6 +4422,91 @@ int adlbp_Reserve(int *req_types, int *work_type, int *work_prio, int *work_hand
     return rc;
 }
 
+/* Reserve and get in one call.  The local server sends a unit of up to
+   max_len bytes (and no common part) along with its metadata; a unit held
+   elsewhere comes as a reservation and is fetched via Get_reserved.  A unit
+   that will not fit stays reserved: ADLB_WORK_TOO_BIG is returned with
+   work_len and work_handle set for a later Get_reserved. */
+int ADLBP_Get_work(int *req_types, int *work_type, int *work_prio, void *work_buf,
+                   int max_len, int *work_len, int *answer_rank, int *work_handle)
+{
+    int i, rc, num_req_types, nints, *reserve_buf, small_buf[2+RQ_INLINE_TYPES];
+    MPI_Status status;
+    MPI_Request request;
+
+    for (num_req_types=0; req_types[num_req_types] != -1; num_req_types++)
+    {
+        if (req_types[num_req_types] < -1  ||  get_type_idx(req_types[num_req_types]) < 0)
+        {
+            aprintf(1,"** invalid req_type %d to adlb get_work\n",req_types[num_req_types]);
+            ADLBP_Abort(-1);
+        }
+    }
+    if (prefetch_depth > 0)    /* units come from those prefetched */
+    {
+        rc = adlbp_Reserve(req_types,work_type,work_prio,work_handle,work_len,answer_rank,1);
+        if (rc == ADLB_SUCCESS)
+        {
+            if (*work_len <= max_len)
+                rc = adlbp_Get_reserved_timed(work_buf,work_handle,NULL);
+            else
+                rc = ADLB_WORK_TOO_BIG;
+        }
+        return rc;
+    }
+    if (num_req_types == 0)
+        num_req_types = 1;
+    if (num_req_types <= RQ_INLINE_TYPES)
+        reserve_buf = small_buf;
+    else
+        reserve_buf = malloc((2+num_req_types) * sizeof(int));
+    reserve_buf[0] = 1;    /* hang */
+    reserve_buf[1] = (max_len < GET_WORK_FUSED_MAX) ? max_len : GET_WORK_FUSED_MAX;
+    for (i=0; i < num_req_types; i++)
+        reserve_buf[i+2] = req_types[i];
+    iput_wait_all();    /* as for a hanging Reserve */
+    nints = IBUF_NUMINTS + (reserve_buf[1] + sizeof(int) - 1) / sizeof(int);
+    if (nints > get_work_msg_nints)
+    {
+        if (get_work_msg)
+            afree(get_work_msg,get_work_msg_nints * sizeof(int));
+        get_work_msg = amalloc(nints * sizeof(int));
+        get_work_msg_nints = nints;
+    }
+    rc = MPI_Irecv(get_work_msg,nints,MPI_INT,my_server_rank,
+                   TA_RESERVE_RESP,adlb_all_comm,&request);
+    rc = MPI_Send(reserve_buf,2+num_req_types,MPI_INT,my_server_rank,
+                  FA_GET_WORK,adlb_all_comm);
+    if (reserve_buf != small_buf)
+        free(reserve_buf);
+    rc = MPI_Wait(&request,&status);
+    if (get_work_msg[0] < 0)
+    {
+        rc = get_work_msg[0];   /* NO_MORE_WORK or EXHAUSTION */
+    }
+    else if (get_work_msg[0] == GOT_WORK)
+    {
+        *work_type   = get_work_msg[1];
+        *work_prio   = get_work_msg[2];
+        *work_len    = get_work_msg[3];
+        *answer_rank = get_work_msg[4];
+        memcpy(work_buf,&get_work_msg[IBUF_NUMINTS],*work_len);
+        rc = ADLB_SUCCESS;
+    }
+    else
+    {
+        reserve_resp_to_handle(get_work_msg,work_type,work_prio,work_handle,work_len,
+                               answer_rank);
+        if (*work_len <= max_len)
+            rc = adlbp_Get_reserved_timed(work_buf,work_handle,NULL);
+        else
+            rc = ADLB_WORK_TOO_BIG;
+    }
+    if (rc == ADLB_NO_MORE_WORK)
+        aprintf(1,"RETURNING NO_MORE_WORK TO APP\n");
+    return rc;
+}
+
 
 int ADLBP_Get_reserved(void *work_buf, int *work_handle)
 {
@@ -2974,6 +4525,20 @@ int ADLBP_Get_reserved_timed(void *work_buf, int *work_handle, double *queued_ti
 }
 
 int adlbp_Get_reserved_timed(void *work_buf, int *work_handle, double *queued_time)
+{
+    int rc;
+
+    if (work_handle[1] == PREFETCH_HANDLE)
+        rc = prefetch_get(work_buf,work_handle,queued_time);
+    else
+        rc = get_reserved_data(work_buf,work_handle,queued_time,0);
+    return rc;
+}
+
+/* fetches a reserved unit from its server(s); reserve_flag is RESERVE_PREFETCH
+   for a prefetched unit, which the server may have taken back (NO_CURR_WORK) */
+static int get_reserved_data(void *work_buf, int *work_handle, double *queued_time,
+                             int reserve_flag)
 {
     int rc, from_server_rank, info_buf[IBUF_NUMINTS], commlen, work_len;
     double dbls_info_buf[IBUF_NUMDBLS];
@@ -2994,6 +4559,7 @@ int adlbp_Get_reserved_timed(void *work_buf, int *work_handle, double *queued_ti
 
     /* then get the unique data part */
     info_buf[0] = work_handle[0];
+    info_buf[1] = reserve_flag;
     from_server_rank = work_handle[1];
     // sprintf(log_buf,"Gs r%d\n",from_server_rank);
     // MPI_Ssend(log_buf,100,MPI_BYTE,my_server_rank,FA_LOG,adlb_all_comm);
@@ -3015,13 +4581,242 @@ int adlbp_Get_reserved_timed(void *work_buf, int *work_handle, double *queued_ti
             *queued_time = dbls_info_buf[2];
         rc = 1;
     }
-    if (rc == ADLB_NO_MORE_WORK)
-        aprintf(1,"RETURNING NO_MORE_WORK TO APP\n");
-    // else if (info_buf[0] == ADLB_DONE_BY_EXHAUSTION)
-        // aprintf(1,"RETURNING DONE_BY_EXHAUSTION TO APP\n");
-    // sprintf(log_buf,"Ge r%d\n",from_server_rank);
-    // MPI_Ssend(log_buf,100,MPI_BYTE,my_server_rank,FA_LOG,adlb_all_comm);  /* skip rc here */
-    return rc;
+    if (rc == ADLB_NO_MORE_WORK)
+        aprintf(1,"RETURNING NO_MORE_WORK TO APP\n");
+    // else if (info_buf[0] == ADLB_DONE_BY_EXHAUSTION)
+        // aprintf(1,"RETURNING DONE_BY_EXHAUSTION TO APP\n");
+    // sprintf(log_buf,"Ge r%d\n",from_server_rank);
+    // MPI_Ssend(log_buf,100,MPI_BYTE,my_server_rank,FA_LOG,adlb_all_comm);  /* skip rc here */
+    return rc;
+}
+
+/* takes in the reply to a refill, waiting for it if wait_flag is set */
+static void prefetch_reply(prefetch_slot_t *ps, int wait_flag)
+{
+    int flag;
+    MPI_Status status;
+
+    if (wait_flag)
+        MPI_Wait(&ps->req,&status);
+    else
+    {
+        MPI_Test(&ps->req,&flag,&status);
+        if ( ! flag)
+            return;
+    }
+    if (ps->msg[0] == GOT_WORK)
+    {
+        ps->work_type   = ps->msg[1];
+        ps->work_prio   = ps->msg[2];
+        ps->work_len    = ps->msg[3];
+        ps->answer_rank = ps->msg[4];
+        ps->target_rank = ps->msg[5];
+        ps->work_buf = amalloc(ps->work_len);
+        memcpy(ps->work_buf,&ps->msg[IBUF_NUMINTS],ps->work_len);
+        ps->queued_time = 0.0;
+        ps->state = PF_FETCHED;
+        prefetch_dry = 0;
+    }
+    else if (ps->msg[0] == SUCCESS)
+    {
+        reserve_resp_to_handle(ps->msg,&ps->work_type,&ps->work_prio,ps->work_handle,
+                               &ps->work_len,&ps->answer_rank);
+        ps->state = PF_RESERVED;
+        prefetch_dry = 0;
+    }
+    else
+    {
+        if (ps->msg[0] == NO_CURR_WORK)
+            prefetch_dry = 1;
+        else
+            prefetch_rc = ps->msg[0];  /* NO_MORE_WORK */
+        ps->state = PF_FREE;
+    }
+}
+
+/* Finds the hi prio unit held of the listed types, fetching its data if it
+   is only reserved, and fills in what Reserve returns for it.  Returns
+   NO_CURR_WORK, with no refill left outstanding, if none is held. */
+static int prefetch_take(int *req_types, int num_req_types, int *work_type, int *work_prio,
+                         int *work_handle, int *work_len, int *answer_rank)
+{
+    int i, j, rc, best, num_asked, wanted;
+    prefetch_slot_t *ps;
+
+    if ( ! prefetch_slots)
+    {
+        prefetch_slots = amalloc(prefetch_depth * sizeof(prefetch_slot_t));
+        prefetch_msg_nints = IBUF_NUMINTS + (prefetch_fetch_max + sizeof(int) - 1) / sizeof(int);
+        for (i=0; i < prefetch_depth; i++)
+        {
+            prefetch_slots[i].state = PF_FREE;
+            prefetch_slots[i].msg = amalloc(prefetch_msg_nints * sizeof(int));
+            prefetch_slots[i].work_buf = NULL;
+        }
+    }
+    while (1)
+    {
+        best = -1;
+        num_asked = 0;
+        for (i=0; i < prefetch_depth; i++)
+        {
+            ps = &prefetch_slots[i];
+            if (ps->state == PF_ASKED)
+                prefetch_reply(ps,0);
+            if (ps->state == PF_ASKED)
+                num_asked++;
+            if (ps->state != PF_RESERVED  &&  ps->state != PF_FETCHED)
+                continue;
+            wanted = (req_types[0] == -1);
+            for (j=0; j < num_req_types  &&  ! wanted; j++)
+                wanted = (req_types[j] == ps->work_type);
+            if (wanted  &&  (best < 0  ||  ps->work_prio > prefetch_slots[best].work_prio))
+                best = i;
+        }
+        if (prefetch_rc)
+        {
+            prefetch_return_all();    /* just frees them now */
+            return prefetch_rc;
+        }
+        if (best < 0)
+        {
+            if (num_asked == 0)
+                return NO_CURR_WORK;
+            for (i=0; i < prefetch_depth; i++)  /* non-hanging, so answered soon */
+                if (prefetch_slots[i].state == PF_ASKED)
+                    prefetch_reply(&prefetch_slots[i],1);
+            continue;
+        }
+        ps = &prefetch_slots[best];
+        if (ps->state == PF_RESERVED)
+        {
+            ps->work_buf = amalloc(ps->work_len);
+            rc = get_reserved_data(ps->work_buf,ps->work_handle,&ps->queued_time,
+                                   RESERVE_PREFETCH);
+            if (rc < 0)
+            {
+                afree(ps->work_buf,ps->work_len);
+                ps->work_buf = NULL;
+                ps->state = PF_FREE;
+                if (rc != NO_CURR_WORK)    /* else taken back; look again */
+                    prefetch_rc = rc;
+                continue;
+            }
+        }
+        ps->state = PF_GIVEN;
+        *work_type     = ps->work_type;
+        *work_prio     = ps->work_prio;
+        *work_len      = ps->work_len;
+        *answer_rank   = ps->answer_rank;
+        work_handle[0] = best;
+        work_handle[1] = PREFETCH_HANDLE;
+        work_handle[2] = 0;    /* any common part is in the data here */
+        work_handle[3] = -1;
+        work_handle[4] = -1;
+        return ADLB_SUCCESS;
+    }
+}
+
+/* asks the app's server for units of the listed types to fill the free
+   slots; after a refill found none, only one ask is kept out */
+static void prefetch_refill(int *req_types, int num_req_types)
+{
+    int i, hdr_nints, num_asked, *reserve_buf, small_buf[2+RQ_INLINE_TYPES];
+    prefetch_slot_t *ps;
+
+    if (prefetch_rc)
+        return;
+    num_asked = 0;
+    for (i=0; i < prefetch_depth; i++)
+        if (prefetch_slots[i].state == PF_ASKED)
+            num_asked++;
+    if (prefetch_dry  &&  num_asked > 0)
+        return;
+    hdr_nints = (prefetch_fetch_max > 0) ? 2 : 1;
+    if (num_req_types <= RQ_INLINE_TYPES)
+        reserve_buf = small_buf;
+    else
+        reserve_buf = malloc((2+num_req_types) * sizeof(int));
+    reserve_buf[0] = RESERVE_PREFETCH;
+    reserve_buf[1] = prefetch_fetch_max;    /* overwritten below if not fetching */
+    for (i=0; i < num_req_types; i++)
+        reserve_buf[hdr_nints+i] = req_types[i];
+    for (i=0; i < prefetch_depth; i++)
+    {
+        ps = &prefetch_slots[i];
+        if (ps->state != PF_FREE)
+            continue;
+        MPI_Irecv(ps->msg,prefetch_msg_nints,MPI_INT,my_server_rank,
+                  TA_RESERVE_RESP,adlb_all_comm,&ps->req);
+        MPI_Send(reserve_buf,hdr_nints+num_req_types,MPI_INT,my_server_rank,
+                 (hdr_nints == 2) ? FA_GET_WORK : FA_RESERVE,adlb_all_comm);
+        ps->state = PF_ASKED;
+        if (prefetch_dry)
+            break;
+    }
+    if (reserve_buf != small_buf)
+        free(reserve_buf);
+}
+
+/* Hands back the units held but not yet given out: reserved ones are unpinned
+   at their server and fetched ones are put again.  Once there is no more work
+   they are just freed. */
+static void prefetch_return_all()
+{
+    int i, rc, info_buf[IBUF_NUMINTS];
+    prefetch_slot_t *ps;
+
+    if ( ! prefetch_slots)
+        return;
+    for (i=0; i < prefetch_depth; i++)
+    {
+        ps = &prefetch_slots[i];
+        if (ps->state == PF_ASKED)
+            prefetch_reply(ps,1);
+        if (ps->state == PF_RESERVED  &&  ! prefetch_rc)
+        {
+            info_buf[0] = my_world_rank;
+            info_buf[1] = ps->work_handle[0];  /* wqseqno */
+            info_buf[2] = -1;
+            MPI_Send(info_buf,IBUF_NUMINTS,MPI_INT,ps->work_handle[1],
+                     FA_UNRESERVE,adlb_all_comm);
+        }
+        else if (ps->state == PF_FETCHED)
+        {
+            if ( ! prefetch_rc)
+            {
+                rc = ADLBP_Put(ps->work_buf,ps->work_len,ps->target_rank,ps->answer_rank,
+                               ps->work_type,ps->work_prio);
+                if (rc != ADLB_SUCCESS)
+                    aprintf(1,"** could not put back a prefetched unit; rc %d\n",rc);
+            }
+            afree(ps->work_buf,ps->work_len);
+            ps->work_buf = NULL;
+        }
+        if (ps->state == PF_RESERVED  ||  ps->state == PF_FETCHED)
+            ps->state = PF_FREE;
+    }
+}
+
+/* Get_reserved of a prefetched unit; its data is already here */
+static int prefetch_get(void *work_buf, int *work_handle, double *queued_time)
+{
+    prefetch_slot_t *ps;
+
+    if ( ! prefetch_slots  ||  work_handle[0] < 0  ||  work_handle[0] >= prefetch_depth
+        ||  prefetch_slots[work_handle[0]].state != PF_GIVEN)
+    {
+        aprintf(1,"** invalid prefetched work handle %d\n",work_handle[0]);
+        return ADLB_ERROR;
+    }
+    ps = &prefetch_slots[work_handle[0]];
+    memcpy(work_buf,ps->work_buf,ps->work_len);
+    if (queued_time)
+        *queued_time = ps->queued_time;
+    afree(ps->work_buf,ps->work_len);
+    ps->work_buf = NULL;
+    ps->state = PF_FREE;
+    return ADLB_SUCCESS;
 }
 
 int ADLBP_Info_num_work_units(int work_type, int *max_prio, int *num_max_prio_type, int *num_type)
@@ -3071,6 +4866,8 @@ int adlbp_Probe(int dest, int tag, MPI_Comm  comm, MPI_Status *status)
 
 int ADLBP_Info_get(int key, double *val)
 {
+    int i;
+
     if (key == ADLB_INFO_MALLOC_HWM)
     {
         *val = hwm_bytes_dmalloced;
@@ -3137,6 +4934,175 @@ int ADLBP_Info_get(int key, double *val)
         *val = (double)wq->max_count;
         return ADLB_SUCCESS;
     }
+    else if (key == ADLB_INFO_PAYLOAD_FRAG)
+    {
+        *val = pmalloc_frag();
+        return ADLB_SUCCESS;
+    }
+    else if (key == ADLB_INFO_HANDLER_TIME  ||  key == ADLB_INFO_HANDLER_COUNT)
+    {
+        *val = 0.0;
+        for (i=0; i < NUM_SERVER_TAGS; i++)
+        {
+            if (key == ADLB_INFO_HANDLER_TIME)
+                *val += server_handler_time[i];
+            else
+                *val += server_handler_cnt[i];
+        }
+        return ADLB_SUCCESS;
+    }
+    else if (key >= ADLB_INFO_HANDLER_TIME_BASE
+         &&  key <  ADLB_INFO_HANDLER_TIME_BASE + NUM_SERVER_TAGS)
+    {
+        *val = server_handler_time[key-ADLB_INFO_HANDLER_TIME_BASE];
+        return ADLB_SUCCESS;
+    }
+    else if (key >= ADLB_INFO_HANDLER_COUNT_BASE
+         &&  key <  ADLB_INFO_HANDLER_COUNT_BASE + NUM_SERVER_TAGS)
+    {
+        *val = server_handler_cnt[key-ADLB_INFO_HANDLER_COUNT_BASE];
+        return ADLB_SUCCESS;
+    }
+    else if (key == ADLB_INFO_PROGRESS_MODE)
+    {
+        *val = (double) progress_mode;
+        return ADLB_SUCCESS;
+    }
+    else if (key == ADLB_INFO_PROGRESS_SPIN_PASSES)
+    {
+        *val = (double) progress_spin_passes;
+        return ADLB_SUCCESS;
+    }
+    else if (key == ADLB_INFO_PROGRESS_MAX_SLEEP)
+    {
+        *val = progress_max_sleep;
+        return ADLB_SUCCESS;
+    }
+    else if (key == ADLB_INFO_IDLE_SLEEP_TIME)
+    {
+        *val = total_idle_sleep_time;
+        return ADLB_SUCCESS;
+    }
+    else if (key >= ADLB_INFO_TIMER_INTERVAL_BASE
+         &&  key <  ADLB_INFO_TIMER_INTERVAL_BASE + ADLB_NUM_TIMERS)
+    {
+        *val = server_timers[key-ADLB_INFO_TIMER_INTERVAL_BASE].interval;
+        return ADLB_SUCCESS;
+    }
+    else if (key >= ADLB_INFO_TIMER_RUNS_BASE
+         &&  key <  ADLB_INFO_TIMER_RUNS_BASE + ADLB_NUM_TIMERS)
+    {
+        *val = server_timers[key-ADLB_INFO_TIMER_RUNS_BASE].run_cnt;
+        return ADLB_SUCCESS;
+    }
+    else if (key == ADLB_INFO_BATCH_MAX)
+    {
+        *val = (double) server_batch_max;
+        return ADLB_SUCCESS;
+    }
+    else if (key == ADLB_INFO_PUT_EAGER_MAX)
+    {
+        *val = (double) put_eager_max;
+        return ADLB_SUCCESS;
+    }
+    else if (key == ADLB_INFO_NUM_EAGER_PUTS)
+    {
+        *val = (double) num_eager_puts;
+        return ADLB_SUCCESS;
+    }
+    else if (key == ADLB_INFO_PREFETCH_DEPTH)
+    {
+        *val = (double) prefetch_depth;
+        return ADLB_SUCCESS;
+    }
+    else if (key == ADLB_INFO_PREFETCH_FETCH_MAX)
+    {
+        *val = (double) prefetch_fetch_max;
+        return ADLB_SUCCESS;
+    }
+    else if (key == ADLB_INFO_NUM_PREFETCH_STOLEN)
+    {
+        *val = (double) num_prefetched_stolen;
+        return ADLB_SUCCESS;
+    }
+    else if (key >= ADLB_INFO_MSG_CLASS_PRIO_BASE
+         &&  key <  ADLB_INFO_MSG_CLASS_PRIO_BASE + ADLB_NUM_MSG_CLASSES)
+    {
+        *val = (double) msg_class_prio[key-ADLB_INFO_MSG_CLASS_PRIO_BASE];
+        return ADLB_SUCCESS;
+    }
+    return ADLB_ERROR;
+}
+
+/* tunables; a server rank must set these before calling ADLB_Server,
+   except PUT_EAGER_MAX and the PREFETCH ones, which an app rank sets for
+   its own puts and reserves */
+int ADLBP_Info_set(int key, double val)
+{
+    if (key == ADLB_INFO_PROGRESS_MODE)
+    {
+        if (val != ADLB_PROGRESS_SPIN  &&  val != ADLB_PROGRESS_BACKOFF)
+            return ADLB_ERROR;
+        progress_mode = (int) val;
+        return ADLB_SUCCESS;
+    }
+    else if (key == ADLB_INFO_PROGRESS_SPIN_PASSES)
+    {
+        if (val < 0.0)
+            return ADLB_ERROR;
+        progress_spin_passes = (int) val;
+        return ADLB_SUCCESS;
+    }
+    else if (key == ADLB_INFO_PROGRESS_MAX_SLEEP)
+    {
+        if (val < 0.0)
+            return ADLB_ERROR;
+        progress_max_sleep = val;
+        return ADLB_SUCCESS;
+    }
+    else if (key >= ADLB_INFO_TIMER_INTERVAL_BASE
+         &&  key <  ADLB_INFO_TIMER_INTERVAL_BASE + ADLB_NUM_TIMERS)
+    {
+        if (val <= 0.0)
+            return ADLB_ERROR;
+        /* an armed timer picks up the new interval when it next runs */
+        server_timers[key-ADLB_INFO_TIMER_INTERVAL_BASE].interval = val;
+        return ADLB_SUCCESS;
+    }
+    else if (key == ADLB_INFO_BATCH_MAX)
+    {
+        if (val < 1.0  ||  val > SERVER_BATCH_CAP)
+            return ADLB_ERROR;
+        server_batch_max = (int) val;
+        return ADLB_SUCCESS;
+    }
+    else if (key >= ADLB_INFO_MSG_CLASS_PRIO_BASE
+         &&  key <  ADLB_INFO_MSG_CLASS_PRIO_BASE + ADLB_NUM_MSG_CLASSES)
+    {
+        msg_class_prio[key-ADLB_INFO_MSG_CLASS_PRIO_BASE] = (int) val;
+        return ADLB_SUCCESS;
+    }
+    else if (key == ADLB_INFO_PUT_EAGER_MAX)
+    {
+        if (val < -1.0  ||  val > PUT_EAGER_MAX_LIMIT)
+            return ADLB_ERROR;
+        put_eager_max = (int) val;    /* -1 sends every put via hdr/ack/payload */
+        return ADLB_SUCCESS;
+    }
+    else if (key == ADLB_INFO_PREFETCH_DEPTH)
+    {
+        if (val < 0.0  ||  val > PREFETCH_DEPTH_MAX  ||  prefetch_slots)
+            return ADLB_ERROR;    /* fixed once prefetching has started */
+        prefetch_depth = (int) val;
+        return ADLB_SUCCESS;
+    }
+    else if (key == ADLB_INFO_PREFETCH_FETCH_MAX)
+    {
+        if (val < 0.0  ||  val > GET_WORK_FUSED_MAX  ||  prefetch_slots)
+            return ADLB_ERROR;
+        prefetch_fetch_max = (int) val;
+        return ADLB_SUCCESS;
+    }
     return ADLB_ERROR;
 }
 
@@ -3157,6 +5123,8 @@ int ADLBP_Finalize()
     }
     else  /* app; not a server */
     {   
+        prefetch_return_all();
+        iput_wait_all();
         rc = MPI_Ssend(&dummy,0,MPI_INT,my_server_rank,FA_LOCAL_APP_DONE,adlb_all_comm);
     }   
     return ADLB_SUCCESS;
@@ -3221,10 +5189,9 @@ static void unpack_qmstat()
 
 static void log_at_debug_server()
 {
-    int rc, info_buf[IBUF_NUMINTS];
-    xq_node_t *wq_node, *iq_node;
+    int rc, info_buf[IBUF_NUMINTS], iq_slot;
+    xq_node_t *wq_node;
     wq_struct_t *ws;
-    MPI_Request *temp_req;
 
     info_buf[0] = num_events_since_logatds;
     info_buf[1] = 0;  /* initially */
@@ -3236,7 +5203,7 @@ static void log_at_debug_server()
     }
     info_buf[2] = wq->count - info_buf[1];    /* count of UN-targeted work */
     info_buf[3] = rq->count;
-    info_buf[4] = iq->count;
+    info_buf[4] = iq_count();
     info_buf[5] = num_reserves_since_logatds;
     info_buf[6] = num_reserves_immed_sat_since_logatds;
     info_buf[7] = num_reserves_not_in_stat_vec;
@@ -3251,11 +5218,9 @@ static void log_at_debug_server()
     info_buf[10] = 0;
 #   endif
 #   endif
-    temp_req = amalloc(sizeof(MPI_Request));
+    iq_slot = iq_slot_create(0,NULL);
     rc = MPI_Issend(info_buf,IBUF_NUMINTS,MPI_INT,debug_server_rank,DS_LOG,
-                    adlb_all_comm,temp_req);
-    iq_node = iq_node_create(temp_req,0,NULL);
-    iq_append(iq_node);
+                    adlb_tel_comm,iq_req(iq_slot));
 }
 
 static void print_final_stats()
@@ -3281,11 +5246,13 @@ static void print_final_stats()
                 (total_time_on_rq / num_rq_nodes_timed),hwm_bytes_dmalloced);
     else
         aprintf(1,"Average Time on RQ: 0 ;  malloc hwm: %.0f\n",hwm_bytes_dmalloced);
-    aprintf(1,"  nputmsgs %d  \n",nputmsgs);
+    aprintf(1,"  nputmsgs %d  num_eager_puts %d  num_prefetched_stolen %d\n",
+            nputmsgs,num_eager_puts,num_prefetched_stolen);
     aprintf(1,"  npushed_from_here %d  npushed_to_here %d\n",
             npushed_from_here,npushed_to_here);
     aprintf(1,"  nrfrs_sent %d  nrfrs_recvd %d \n",nrfrs_sent,nrfrs_recvd);
     aprintf(1,"  max wq count %d  \n",wq->max_count);
+    aprintf(1,"  payload arena frag %.3f  \n",pmalloc_frag());
     aprintf(1,"  num_tq_nodes fixed %d  \n",num_tq_nodes_fixed);
     if (my_world_rank == master_server_rank)
     {
@@ -3300,8 +5267,19 @@ static void print_final_stats()
     aprintf(1,"  total looptop time %f\n",total_looptop_time);
     aprintf(1,"  num_reserves %.0f  num_reserves_put_on_rq %.0f\n",
             num_reserves,num_reserves_put_on_rq);
+    aprintf(1,"  idle sleeps %d  idle sleep time %f\n",num_idle_sleeps,total_idle_sleep_time);
+    aprintf(1,"  housekeeping timers (name, interval, runs, secs):\n");
+    for (i=0; i < ADLB_NUM_TIMERS; i++)
+        aprintf(1,"    %-16s %8.3f %10.0f %10.4f\n",server_timers[i].name,
+                server_timers[i].interval,server_timers[i].run_cnt,server_timers[i].run_time);
+    aprintf(1,"  handler cost by tag (handler num, name, count, secs, usecs per msg):\n");
+    for (i=0; i < NUM_SERVER_TAGS; i++)
+        if (server_handler_cnt[i] > 0)
+            aprintf(1,"    %2d %-24s %10.0f %10.4f %8.2f\n",i,server_handler_names[i],
+                    server_handler_cnt[i],server_handler_time[i],
+                    server_handler_time[i]*1000000.0/server_handler_cnt[i]);
     /* nbytes unfreed may be slightly > 0 for ranks > 0 because of ss_end_loop_2 msg */
-    aprintf(1,"rough num bytes unfreed %.0f\n",curr_bytes_dmalloced-init_fixed_dmalloced);
+    aprintf(1,"rough num bytes unfreed %.0f\n",bytes_in_use()-init_fixed_dmalloced);
     for (i=0; i < num_app_ranks; i++)
         if (inside_batch_put[i])
             aprintf(1,"rank %06d was still inside a batch put\n",i);
@@ -3332,6 +5310,10 @@ static void print_curr_mem_and_queue_status()
     aprintf(1,"    total bytes malloced over time %.0f  MB %.0f\n",
             total_bytes_dmalloced,total_bytes_dmalloced/1000000.0);
     aprintf(1,"    malloc hwm: %.0f\n", hwm_bytes_dmalloced);
+    aprintf(1,"    payload arena bytes cached for reuse %.0f (in the above)\n",
+            curr_bytes_dmalloced-bytes_in_use());
+    aprintf(1,"    queue bookkeeping bytes %.0f  hwm %.0f (not in the above)\n",
+            curr_bytes_bkmalloced,hwm_bytes_bkmalloced);
     if (wq)
         wq_print_info();
     if (cq)
@@ -3340,8 +5322,7 @@ static void print_curr_mem_and_queue_status()
         rq_print_info(num_types);
     if (tq)
         tq_print_info();
-    if (iq)
-        iq_print_info();
+    iq_print_info();
 }
 
 static void print_proc_self_status()
@@ -3416,11 +5397,127 @@ void adlbp_dbgprintf(int flag, int linenum, char *fmt, ...)
     free(s);
 }
 
+/* Payload arena for work and common buffers.  Requests are rounded up to one
+   of PARENA_NUM_CLASSES size classes (4 per power of 2 from PARENA_MIN_BYTES)
+   and freed blocks are kept on a per-class free list for reuse, up to
+   PARENA_MAX_CACHED_FRAC of max_malloc in all.  Blocks of PARENA_MMAP_BYTES or
+   more are mmap'd and returned to the system when freed, so the big buffers
+   never fragment the malloc heap.  The class (or page-rounded) size of a block
+   is what is charged against max_malloc while it is in use and while it sits
+   on a free list, so the charge is the real footprint.  Cached blocks count
+   as free room for put admission (bytes_in_use) and are given back by
+   parena_trim whenever a new charge would cross max_malloc.
+*/
+#define PARENA_MIN_BYTES         64
+#define PARENA_MMAP_BYTES        (1024*1024)
+#define PARENA_NUM_CLASSES       57    /* 64 bytes ... PARENA_MMAP_BYTES */
+#define PARENA_MAX_CACHED_FRAC   0.05
+
+static void *parena_free_list[PARENA_NUM_CLASSES];
+static double parena_cached_bytes = 0.0;    /* on the free lists */
+static double parena_inuse_bytes = 0.0;     /* class sizes of blocks in use */
+static double parena_payload_bytes = 0.0;   /* bytes requested for blocks in use */
+
+static int parena_class_of(int nbytes, int *class_bytes)
+{
+    int b, cls, step, k;
+
+    if (nbytes <= PARENA_MIN_BYTES)
+    {
+        *class_bytes = PARENA_MIN_BYTES;
+        return 0;
+    }
+    b = PARENA_MIN_BYTES;
+    cls = 0;
+    while (2*b < nbytes)
+    {
+        b *= 2;
+        cls += 4;
+    }
+    step = b / 4;
+    k = (nbytes - b + step - 1) / step;    /* 1..4 */
+    *class_bytes = b + k * step;
+    return cls + k;
+}
+
+static int parena_class_bytes(int cls)  /* inverse of parena_class_of */
+{
+    int b;
+
+    if (cls == 0)
+        return PARENA_MIN_BYTES;
+    b = PARENA_MIN_BYTES << ((cls - 1) / 4);
+    return b + ((cls - 1) % 4 + 1) * (b / 4);
+}
+
+/* frees cached blocks, biggest first, until nbytes more fit under max_malloc */
+static void parena_trim(int nbytes)
+{
+    int cls, class_bytes;
+    void *ptr;
+
+    for (cls=PARENA_NUM_CLASSES-1; cls >= 0; cls--)
+    {
+        class_bytes = parena_class_bytes(cls);
+        while (parena_free_list[cls]  &&  (curr_bytes_dmalloced+nbytes) > max_malloc)
+        {
+            ptr = parena_free_list[cls];
+            parena_free_list[cls] = *(void **) ptr;
+            free(ptr);
+            parena_cached_bytes -= class_bytes;
+            curr_bytes_dmalloced -= class_bytes;
+        }
+    }
+}
+
+int pmalloc_footprint(int nbytes)  /* bytes charged for a payload of nbytes */
+{
+    int class_bytes;
+    long pagesize;
+
+    if (nbytes >= PARENA_MMAP_BYTES)
+    {
+        pagesize = sysconf(_SC_PAGESIZE);
+        return (int) (((nbytes + pagesize - 1) / pagesize) * pagesize);
+    }
+    parena_class_of(nbytes,&class_bytes);
+    return class_bytes;
+}
+
 void *pmalloc(int nbytes, const char *funcname, int linenum)
 {
+    int cls, class_bytes;
     void *ptr;
 
-    ptr = malloc(nbytes);
+    if (nbytes >= PARENA_MMAP_BYTES)
+    {
+        class_bytes = pmalloc_footprint(nbytes);
+        if ((curr_bytes_dmalloced+class_bytes) > max_malloc)
+            parena_trim(class_bytes);
+#ifdef MAP_ANONYMOUS
+        ptr = mmap(NULL,class_bytes,PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_ANONYMOUS,-1,0);
+        if (ptr == MAP_FAILED)
+            ptr = NULL;
+#else
+        ptr = malloc(class_bytes);
+#endif
+    }
+    else
+    {
+        cls = parena_class_of(nbytes,&class_bytes);
+        ptr = parena_free_list[cls];
+        if (ptr)
+        {
+            parena_free_list[cls] = *(void **) ptr;
+            parena_cached_bytes -= class_bytes;
+            parena_inuse_bytes += class_bytes;    /* already charged while cached */
+            parena_payload_bytes += nbytes;
+            return ptr;
+        }
+        if ((curr_bytes_dmalloced+class_bytes) > max_malloc)
+            parena_trim(class_bytes);
+        ptr = malloc(class_bytes);
+    }
     if ( ! ptr) 
     {
         aprintf(1,"** pmalloc ; returning null ; malloc failed for %d bytes in %s at line %d\n",
@@ -3428,18 +5525,67 @@ void *pmalloc(int nbytes, const char *funcname, int linenum)
         return NULL;
     }
 
-    total_bytes_dmalloced += nbytes;
-    curr_bytes_dmalloced += nbytes;
+    parena_inuse_bytes += class_bytes;
+    parena_payload_bytes += nbytes;
+    total_bytes_dmalloced += class_bytes;
+    curr_bytes_dmalloced += class_bytes;
     if (curr_bytes_dmalloced > hwm_bytes_dmalloced)
         hwm_bytes_dmalloced = curr_bytes_dmalloced;
     return ptr;
 }
 
-// int buf_for_failed_dmalloc[IBUF_NUMINTS];
-void *dmalloc(int nbytes, const char *funcname, int linenum)
+void pfree(void *ptr, int nbytes)  /* nbytes as passed to pmalloc */
 {
-    void *ptr;
+    int cls, class_bytes;
+
+    if (nbytes >= PARENA_MMAP_BYTES)
+    {
+        class_bytes = pmalloc_footprint(nbytes);
+#ifdef MAP_ANONYMOUS
+        munmap(ptr,class_bytes);
+#else
+        free(ptr);
+#endif
+    }
+    else
+    {
+        cls = parena_class_of(nbytes,&class_bytes);
+        if (parena_cached_bytes + class_bytes <= PARENA_MAX_CACHED_FRAC * max_malloc)
+        {
+            *(void **) ptr = parena_free_list[cls];
+            parena_free_list[cls] = ptr;
+            parena_cached_bytes += class_bytes;
+            parena_inuse_bytes -= class_bytes;    /* stays charged while cached */
+            parena_payload_bytes -= nbytes;
+            return;
+        }
+        free(ptr);
+    }
+    parena_inuse_bytes -= class_bytes;
+    parena_payload_bytes -= nbytes;
+    curr_bytes_dmalloced -= class_bytes;
+}
+
+static double bytes_in_use()  /* charged bytes less cached blocks ready for reuse */
+{
+    return curr_bytes_dmalloced - parena_cached_bytes;
+}
+
+static double pmalloc_frag()  /* fraction of arena memory not holding payload */
+{
+    double held;
+
+    held = parena_inuse_bytes + parena_cached_bytes;
+    if (held <= 0.0)
+        return 0.0;
+    return (held - parena_payload_bytes) / held;
+}
 
+// int buf_for_failed_dmalloc[IBUF_NUMINTS];
+void dcharge(int nbytes, const char *funcname, int linenum)
+{
+    if ((curr_bytes_dmalloced+nbytes) > max_malloc)
+        parena_trim(nbytes);
     if ((curr_bytes_dmalloced+nbytes) > max_malloc)
     {
         aprintf(1,"** dmalloc aborting; exceeding mem limit %.0f ; "
@@ -3450,6 +5596,22 @@ void *dmalloc(int nbytes, const char *funcname, int linenum)
         adlb_server_abort(-1,1);
     }
 
+    total_bytes_dmalloced += nbytes;
+    curr_bytes_dmalloced += nbytes;
+    if (curr_bytes_dmalloced > hwm_bytes_dmalloced)
+        hwm_bytes_dmalloced = curr_bytes_dmalloced;
+}
+
+void dcredit(int nbytes)
+{
+    curr_bytes_dmalloced -= nbytes;
+}
+
+void *dmalloc(int nbytes, const char *funcname, int linenum)
+{
+    void *ptr;
+
+    dcharge(nbytes,funcname,linenum);
     ptr = malloc(nbytes);
     if ( ! ptr) 
     {
@@ -3459,27 +5621,136 @@ void *dmalloc(int nbytes, const char *funcname, int linenum)
         print_curr_mem_and_queue_status();
         adlb_server_abort(-1,1);
     }
-
-    total_bytes_dmalloced += nbytes;
-    curr_bytes_dmalloced += nbytes;
-    if (curr_bytes_dmalloced > hwm_bytes_dmalloced)
-        hwm_bytes_dmalloced = curr_bytes_dmalloced;
     return ptr;
 }
 
 void dfree(void *ptr, int nbytes, const char *funcname, int linenum)
 {
     free(ptr);
-    curr_bytes_dmalloced -= nbytes;
+    dcredit(nbytes);
+}
+
+/* Queue bookkeeping (seqno index tables, entry slabs) grows in steps that put
+   admission cannot see coming, so it is malloc'd outside max_malloc and
+   counted on its own.
+*/
+void *bkmalloc(int nbytes, const char *funcname, int linenum)
+{
+    void *ptr;
+
+    ptr = malloc(nbytes);
+    if ( ! ptr) 
+    {
+        aprintf(1,"** bkmalloc aborting the pgm; failed for %d bytes in %s at line %d\n",
+                nbytes,funcname,linenum);
+        print_proc_self_status();
+        print_curr_mem_and_queue_status();
+        adlb_server_abort(-1,1);
+    }
+    curr_bytes_bkmalloced += nbytes;
+    if (curr_bytes_bkmalloced > hwm_bytes_bkmalloced)
+        hwm_bytes_bkmalloced = curr_bytes_bkmalloced;
+    return ptr;
+}
+
+void *bkmemalign(int align, int nbytes, const char *funcname, int linenum)
+{
+    void *ptr;
+
+    if (posix_memalign(&ptr,align,nbytes) != 0)
+    {
+        aprintf(1,"** bkmemalign aborting the pgm; failed for %d bytes in %s at line %d\n",
+                nbytes,funcname,linenum);
+        print_proc_self_status();
+        print_curr_mem_and_queue_status();
+        adlb_server_abort(-1,1);
+    }
+    curr_bytes_bkmalloced += nbytes;
+    if (curr_bytes_bkmalloced > hwm_bytes_bkmalloced)
+        hwm_bytes_bkmalloced = curr_bytes_bkmalloced;
+    return ptr;
+}
+
+void bkfree(void *ptr, int nbytes)
+{
+    free(ptr);
+    curr_bytes_bkmalloced -= nbytes;
+}
+
+/* type -> type_idx is a direct-mapped table over [type_tbl_min,type_tbl_min+
+   type_tbl_len) when the user types are dense enough, else an open-addressing
+   hash of size type_tbl_len (a power of 2) holding type_idx+1 (0 is empty).
+*/
+#define TYPE_TBL_MAX_DIRECT  1024
+
+static int *type_tbl = NULL, type_tbl_len = 0, type_tbl_min = 0, type_tbl_direct = 0;
+
+static int type_tbl_home(int work_type)
+{
+    return (int) (((unsigned int) work_type * 2654435761U) & (unsigned int) (type_tbl_len - 1));
+}
+
+static void build_type_idx_table()
+{
+    int i, j, min_type, max_type;
+    double span;
+
+    min_type = max_type = (num_types > 0) ? user_types[0] : 0;
+    for (i=1; i < num_types; i++)
+    {
+        if (user_types[i] < min_type)
+            min_type = user_types[i];
+        if (user_types[i] > max_type)
+            max_type = user_types[i];
+    }
+    span = (double) max_type - (double) min_type + 1.0;
+    if (span <= TYPE_TBL_MAX_DIRECT  ||  span <= 4.0 * num_types)
+    {
+        type_tbl_direct = 1;
+        type_tbl_min = min_type;
+        type_tbl_len = (int) span;
+        type_tbl = amalloc(type_tbl_len * sizeof(int));
+        for (i=0; i < type_tbl_len; i++)
+            type_tbl[i] = -1;
+        for (i=num_types-1; i >= 0; i--)    /* first occurrence wins, as in a scan */
+            type_tbl[user_types[i] - type_tbl_min] = i;
+    }
+    else
+    {
+        type_tbl_direct = 0;
+        type_tbl_len = 16;
+        while (type_tbl_len < 2 * num_types)
+            type_tbl_len *= 2;
+        type_tbl = amalloc(type_tbl_len * sizeof(int));
+        for (i=0; i < type_tbl_len; i++)
+            type_tbl[i] = 0;
+        for (i=0; i < num_types; i++)
+        {
+            j = type_tbl_home(user_types[i]);
+            while (type_tbl[j]  &&  user_types[type_tbl[j]-1] != user_types[i])
+                j = (j + 1) & (type_tbl_len - 1);
+            if ( ! type_tbl[j])
+                type_tbl[j] = i + 1;
+        }
+    }
 }
 
-static int get_type_idx(int work_type)
+int get_type_idx(int work_type)
 {
     int i;
 
-    for (i=0; i < num_types; i++)
-        if (user_types[i] == work_type)
-            return i;
+    if (type_tbl_direct)
+    {
+        i = work_type - type_tbl_min;
+        if (work_type >= type_tbl_min  &&  i < type_tbl_len  &&  type_tbl[i] >= 0)
+            return type_tbl[i];
+    }
+    else
+    {
+        for (i=type_tbl_home(work_type); type_tbl[i]; i=(i+1)&(type_tbl_len-1))
+            if (user_types[type_tbl[i]-1] == work_type)
+                return type_tbl[i] - 1;
+    }
     aprintf(1,"**** INVALID type %d *************************************\n",work_type);
     return -1;
 }
@@ -3535,37 +5806,25 @@ static int find_cand_rank_with_worktype(int for_rank, int work_type)
 
 static void check_remote_work_for_queued_apps()
 {
-    int i, j, cand_rank;
-    int *temp_buf;
-    xq_node_t *rq_node, *iq_node;
+    int i, cand_rank;
+    xq_node_t *rq_node, *next_rq_node;
     rq_struct_t *rs;
-    MPI_Request *temp_req;
 
-    for (rq_node=xq_first(rq); rq_node; rq_node=xq_next(rq,rq_node))
+    for (rq_node=xq_first(rq); rq_node; rq_node=next_rq_node)
     {
+        next_rq_node = xq_next(rq,rq_node);  /* rq_node may be given work below */
         rs = rq_node->data;
         if (rfr_to_rank[rs->world_rank] >= 0)
             continue;
-        for (i=0; i < REQ_TYPE_VECT_SZ; i++)
+        for (i=0; i < rs->num_req_types; i++)
         {
-            if (rs->req_types[i] < -1)  /* invalid type place-holder */
-                break;
             cand_rank = find_cand_rank_with_worktype(rs->world_rank,rs->req_types[i]);
             if (cand_rank >= 0)
             {
                 aprintf(0000,"CAND_SERVER_RANK %06d type %d for %06d\n",cand_rank,rs->req_types[i],rs->world_rank);
-                temp_buf    = amalloc(RFRBUF_NUMINTS * sizeof(int));
-                temp_buf[0] = rs->rqseqno;
-                temp_buf[1] = rs->world_rank;
-                for (j=0; j < REQ_TYPE_VECT_SZ; j++)
-                    temp_buf[2+j] = rs->req_types[j];
-                temp_req    = amalloc(sizeof(MPI_Request));
                 aprintf(0000,"REQING chk rqseqno %d fromrank %d\n",rs->rqseqno,cand_rank);
                 // cblog(1,rs->world_rank,"  REQING from chk %d ty %d\n",cand_rank,rs->req_types[i]);
-                MPI_Isend(temp_buf,RFRBUF_NUMINTS,MPI_INT,cand_rank,SS_RFR,
-                          adlb_all_comm,temp_req);
-                iq_node = iq_node_create(temp_req,(RFRBUF_NUMINTS * sizeof(int)),temp_buf);
-                iq_append(iq_node);
+                send_rfr(cand_rank,rs);
                 rfr_to_rank[rs->world_rank] = cand_rank;
                 rfr_out[cand_rank] = 1;
                 nrfrs_sent++;
@@ -3575,21 +5834,56 @@ static void check_remote_work_for_queued_apps()
                 break;
             }
         }
+        if (rfr_to_rank[rs->world_rank] < 0)
+            steal_prefetched_for_queued(rq_node);
     }
 }
 
-static void update_local_state()
+/* SS_RFR is the rq entry's seqno and rank followed by only the types it
+   listed, so its length varies with the request. */
+static void send_rfr(int to_rank, rq_struct_t *rs)
 {
-    int i, server_idx;
+    int i, nints, iq_slot, *temp_buf;
+
+    nints = RFR_HDR_NUMINTS + rs->num_req_types;
+    temp_buf    = amalloc(nints * sizeof(int));
+    temp_buf[0] = rs->rqseqno;
+    temp_buf[1] = rs->world_rank;
+    for (i=0; i < rs->num_req_types; i++)
+        temp_buf[RFR_HDR_NUMINTS+i] = rs->req_types[i];
+    iq_slot = iq_slot_create((nints * sizeof(int)),temp_buf);
+    MPI_Isend(temp_buf,nints,MPI_INT,to_rank,SS_RFR,adlb_bal_comm,iq_req(iq_slot));
+}
 
-    server_idx  = get_server_idx(my_world_rank);
-    qmstat_tbl[server_idx].nbytes_used = curr_bytes_dmalloced;
-    qmstat_tbl[server_idx].qlen_unpin_untarg = wq_get_num_unpinned_untargeted();
-    for (i=0; i < num_types; i++)
+/* Receives the variable-length int msg described by probe_status into a
+   buffer that is reused across calls and holds at least min_nints; it is
+   only good until the next call. */
+static int *recv_ints(MPI_Status *probe_status, int min_nints, int *nints)
+{
+    static int *buf = NULL, buf_nints = 0;
+    MPI_Status status;
+
+    MPI_Get_count(probe_status,MPI_INT,nints);
+    if (*nints > min_nints)
+        min_nints = *nints;
+    if (min_nints > buf_nints)
     {
-        /* avail -> only not pinned and not targeted */
-        qmstat_tbl[server_idx].type_hi_prio[i] = wq_get_avail_hi_prio_of_type(user_types[i]);
+        if (buf)
+            afree(buf,buf_nints * sizeof(int));
+        buf_nints = (2 * buf_nints > min_nints) ? 2 * buf_nints : min_nints;
+        buf = amalloc(buf_nints * sizeof(int));
     }
+    server_recv(buf,*nints,MPI_INT,&status);
+    return buf;
+}
+
+static void update_local_state()
+{
+    int server_idx;
+
+    /* qlen_unpin_untarg and type_hi_prio are maintained by wq (wq_summary_register) */
+    server_idx  = get_server_idx(my_world_rank);
+    qmstat_tbl[server_idx].nbytes_used = bytes_in_use();
 }
 
 static int get_server_idx(int server_rank)
@@ -9,7 +9,16 @@
 
 void *dmalloc(int,const char *,int);
 void dfree(void *,int,const char *,int);
+void dcharge(int,const char *,int);
+void dcredit(int);
+void *pmalloc(int,const char *,int);  /* payload arena; used in adlb.c and xq.c */
+void pfree(void *,int);
+int pmalloc_footprint(int);
+void *bkmalloc(int,const char *,int);  /* queue bookkeeping, outside max_malloc */
+void *bkmemalign(int,int,const char *,int);
+void bkfree(void *,int);
 int adlbp_Probe(int , int, MPI_Comm, MPI_Status *);  /* used in aldb.c and adlb_prof.c */
+int get_type_idx(int);  /* used in adlb.c and xq.c */
 
 #define aprintf(flag,...) adlbp_dbgprintf(flag,__LINE__,__VA_ARGS__)
 
@@ -17,4 +26,10 @@ int adlbp_Probe(int , int, MPI_Comm, MPI_Status *);  /* used in aldb.c and adlb_
 
 #define afree(ptr,nbytes) dfree(ptr,nbytes,__FUNCTION__,__LINE__)
 
+#define bmalloc(nbytes)   bkmalloc(nbytes,__FUNCTION__,__LINE__)
+
+#define bmemalign(align,nbytes) bkmemalign(align,nbytes,__FUNCTION__,__LINE__)
+
+#define bfree(ptr,nbytes) bkfree(ptr,nbytes)
+
 #endif
\ No newline at end of file
@@ -133,6 +133,53 @@ int ADLB_Put(void *work_buf, int work_len, int reserve_rank, int answer_rank,
     return rc;
 }
 
+int ADLB_Iput(void *work_buf, int work_len, int reserve_rank, int answer_rank,
+              int work_type, int work_prio, int *put_req)
+{
+    int rc;
+
+    rc = ADLBP_Iput(work_buf,work_len,reserve_rank,answer_rank,work_type,work_prio,put_req);
+
+    return rc;
+}
+
+int ADLB_Put_many(int num_units, void *work_bufs[], int work_lens[], int target_ranks[],
+                  int answer_ranks[], int work_types[], int work_prios[])
+{
+    int rc;
+
+#   if defined( LOG_ADLB_INTERNALS )
+    MPE_Log_event(puta,0,NULL);
+#   endif
+
+    rc = ADLBP_Put_many(num_units,work_bufs,work_lens,target_ranks,answer_ranks,
+                        work_types,work_prios);
+
+#   if defined( LOG_ADLB_INTERNALS )
+    MPE_Log_event(putb,0,NULL);
+#   endif
+
+    return rc;
+}
+
+int ADLB_Test(int put_req, int *flag)
+{
+    int rc;
+
+    rc = ADLBP_Test(put_req,flag);
+
+    return rc;
+}
+
+int ADLB_Wait(int put_req)
+{
+    int rc;
+
+    rc = ADLBP_Wait(put_req);
+
+    return rc;
+}
+
 int ADLB_Reserve(int *req_types, int *work_type, int *work_prio, int *work_handle,
                  int *work_len, int *answer_rank)
 {
@@ -182,6 +229,25 @@ int ADLB_Ireserve(int *req_types, int *work_type, int *work_prio, int *work_hand
     return rc;
 }
 
+int ADLB_Get_work(int *req_types, int *work_type, int *work_prio, void *work_buf,
+                  int max_len, int *work_len, int *answer_rank, int *work_handle)
+{
+    int rc;
+
+#   if defined( LOG_ADLB_INTERNALS )
+    MPE_Log_event(geta,0,NULL);
+#   endif
+
+    rc = ADLBP_Get_work(req_types,work_type,work_prio,work_buf,max_len,work_len,
+                        answer_rank,work_handle);
+
+#   if defined( LOG_ADLB_INTERNALS )
+    MPE_Log_event(getb,0,NULL);
+#   endif
+
+    return rc;
+}
+
 int ADLB_Get_reserved(void *work_buf, int *work_handle)
 {
     int rc;
@@ -398,6 +464,15 @@ int ADLB_Info_get(int key, double *val)
     return rc;
 }
 
+int ADLB_Info_set(int key, double val)
+{
+    int rc;
+
+    rc = ADLBP_Info_set(key,val);
+
+    return rc;
+}
+
 int ADLB_Info_num_work_units(int work_type, int *max_prio, int *num_max_prio_type, int *num_type)
 {
     int rc;
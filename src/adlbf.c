@@ -1,4 +1,5 @@
 #include <adlb/adlb.h>
+#include <stdlib.h>
 
 // Header generated by cmake containing Fortran/C mangling macros:
 #include "fortran_c_mangling.h"
@@ -25,6 +26,37 @@ void ADLB_FC_GLOBAL(adlb_put, ADBL_PUT)(void *work_buf, int *work_len, int *rese
                      *work_prio);
 }
 
+void ADLB_FC_GLOBAL(adlb_iput, ADLB_IPUT)(void *work_buf, int *work_len, int *reserve_rank,
+                                          int *answer_rank, int *work_type, int *work_prio,
+                                          int *put_req, int *ierr) {
+    *ierr = ADLB_Iput(work_buf, *work_len, *reserve_rank, *answer_rank, *work_type,
+                      *work_prio, put_req);
+}
+
+/* the units lie back to back in work_buf, work_lens(i) bytes each */
+void ADLB_FC_GLOBAL(adlb_put_many, ADLB_PUT_MANY)(int *num_units, char *work_buf,
+                                                  int *work_lens, int *target_ranks,
+                                                  int *answer_ranks, int *work_types,
+                                                  int *work_prios, int *ierr) {
+    int i;
+    void **work_bufs = malloc((*num_units > 0 ? *num_units : 1) * sizeof(void *));
+    for (i = 0; i < *num_units; i++) {
+        work_bufs[i] = work_buf;
+        work_buf += work_lens[i];
+    }
+    *ierr = ADLB_Put_many(*num_units, work_bufs, work_lens, target_ranks, answer_ranks,
+                          work_types, work_prios);
+    free(work_bufs);
+}
+
+void ADLB_FC_GLOBAL(adlb_test, ADLB_TEST)(int *put_req, int *flag, int *ierr) {
+    *ierr = ADLB_Test(*put_req, flag);
+}
+
+void ADLB_FC_GLOBAL(adlb_wait, ADLB_WAIT)(int *put_req, int *ierr) {
+    *ierr = ADLB_Wait(*put_req);
+}
+
 void ADLB_FC_GLOBAL(adlb_reserve, ADBL_RESERVE)(int *req_types, int *work_type,
                                                 int *work_prio, int *work_handle,
                                                 int *work_len, int *answer_rank,
@@ -41,6 +73,15 @@ void ADLB_FC_GLOBAL(adlb_ireserve, ADBL_IRESERVE)(int *req_types, int *work_type
                           answer_rank);
 }
 
+void ADLB_FC_GLOBAL(adlb_get_work, ADLB_GET_WORK)(int *req_types, int *work_type,
+                                                  int *work_prio, void *work_buf,
+                                                  int *max_len, int *work_len,
+                                                  int *answer_rank, int *work_handle,
+                                                  int *ierr) {
+    *ierr = ADLB_Get_work(req_types, work_type, work_prio, work_buf, *max_len, work_len,
+                          answer_rank, work_handle);
+}
+
 void ADLB_FC_GLOBAL(adlb_get_reserved, ADBL_GET_RESERVED)(void *work_buf,
                                                           int *work_handle, int *ierr) {
     *ierr = ADLB_Get_reserved(work_buf, work_handle);
@@ -85,6 +126,10 @@ void ADLB_FC_GLOBAL(adlb_info_get, ADLB_INFO_GET)(int *key, double *val, int *ie
     *ierr = ADLB_Info_get(*key, val);
 }
 
+void ADLB_FC_GLOBAL(adlb_info_set, ADLB_INFO_SET)(int *key, double *val, int *ierr) {
+    *ierr = ADLB_Info_set(*key, *val);
+}
+
 void ADLB_FC_GLOBAL(adlb_info_num_work_units,
                     ADLB_INFO_NUM_WORK_UNITS)(int *work_type, int *max_prio,
                                               int *num_max_prio_type, int *num_type,
@@ -1,4 +1,5 @@
 #include <limits.h>  /* for INT_MIN */
+#include <stdint.h>  /* for uintptr_t */
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -10,7 +11,6 @@
 
 xq_t *wq;
 xq_t *rq;
-xq_t *iq;
 xq_t *tq;
 xq_t *cq;
 
@@ -68,13 +68,18 @@ xq_node_t *xq_node_create(void *data)
     return xn;
 }
 
-void xq_delete(xq_t *xq, xq_node_t *xn)
+void xq_unlink(xq_t *xq, xq_node_t *xn)  /* remove from xq but do not free */
 {
     xn->prev->next = xn->next;
     xn->next->prev = xn->prev;
     xn->next = NULL;
     xn->prev = NULL;
     xq->count--;
+}
+
+void xq_delete(xq_t *xq, xq_node_t *xn)
+{
+    xq_unlink(xq,xn);
     afree(xn,sizeof(xq_node_t));
 }
 
@@ -109,26 +114,579 @@ xq_node_t *xq_prev(xq_t *xq, xq_node_t *xn)
         return NULL;
 }
 
+/* Open-addressing (linear probing) map from a 64-bit key to a node.  Keys must
+   be unique; deletes shift later entries back so no tombstones are needed.
+*/
+#define XQ_HASH_INIT_SIZE  256
+
+static int xq_hash_home(xq_hash_t *xh, long long key)
+{
+    unsigned long long h;
+
+    h = (unsigned long long) key * 0x9E3779B97F4A7C15ULL;
+    h ^= h >> 32;
+    return (int) (h & (unsigned long long) (xh->size - 1));
+}
+
+static void xq_hash_alloc_slots(xq_hash_t *xh, int size)
+{
+    int i;
+
+    xh->slots = bmalloc(size * sizeof(xq_hash_slot_t));
+    xh->size = size;
+    xh->count = 0;
+    for (i=0; i < size; i++)
+        xh->slots[i].xn = NULL;
+}
+
+xq_hash_t *xq_hash_create()
+{
+    xq_hash_t *xh;
+
+    xh = (xq_hash_t *) amalloc(sizeof(xq_hash_t));
+    if ( ! xh )
+        return NULL;
+    xq_hash_alloc_slots(xh,XQ_HASH_INIT_SIZE);
+    return xh;
+}
+
+void xq_hash_destroy(xq_hash_t *xh)
+{
+    bfree(xh->slots,xh->size * sizeof(xq_hash_slot_t));
+    afree(xh,sizeof(xq_hash_t));
+}
+
+void xq_hash_insert(xq_hash_t *xh, long long key, xq_node_t *xn)
+{
+    int i, old_size;
+    xq_hash_slot_t *old_slots;
+
+    if (2 * (xh->count + 1) > xh->size)    /* keep load at or below 1/2 */
+    {
+        old_slots = xh->slots;
+        old_size = xh->size;
+        xq_hash_alloc_slots(xh,2 * old_size);
+        for (i=0; i < old_size; i++)
+            if (old_slots[i].xn)
+                xq_hash_insert(xh,old_slots[i].key,old_slots[i].xn);
+        bfree(old_slots,old_size * sizeof(xq_hash_slot_t));
+    }
+    i = xq_hash_home(xh,key);
+    while (xh->slots[i].xn)
+        i = (i + 1) & (xh->size - 1);
+    xh->slots[i].key = key;
+    xh->slots[i].xn = xn;
+    xh->count++;
+}
+
+static int xq_hash_slot_of(xq_hash_t *xh, long long key)
+{
+    int i;
+
+    i = xq_hash_home(xh,key);
+    while (xh->slots[i].xn)
+    {
+        if (xh->slots[i].key == key)
+            return i;
+        i = (i + 1) & (xh->size - 1);
+    }
+    return -1;
+}
+
+xq_node_t *xq_hash_find(xq_hash_t *xh, long long key)
+{
+    int i;
+
+    i = xq_hash_slot_of(xh,key);
+    return (i >= 0) ? xh->slots[i].xn : NULL;
+}
+
+void xq_hash_remove(xq_hash_t *xh, long long key)
+{
+    int i, j, home, mask;
+
+    i = xq_hash_slot_of(xh,key);
+    if (i < 0)
+        return;
+    mask = xh->size - 1;
+    j = i;
+    while (1)    /* move back any entry whose probe sequence passes through i */
+    {
+        j = (j + 1) & mask;
+        if ( ! xh->slots[j].xn)
+            break;
+        home = xq_hash_home(xh,xh->slots[j].key);
+        if (((j - home) & mask) >= ((j - i) & mask))
+        {
+            xh->slots[i] = xh->slots[j];
+            i = j;
+        }
+    }
+    xh->slots[i].xn = NULL;
+    xh->count--;
+}
+
+/* Fixed-size element pools.  A slab is one bmemalign'd block of slab_bytes (a
+   power of 2 holding at least XQ_POOL_SLAB_ELEMS elements) aligned to its own
+   size, so the slab an element belongs to is found by masking its address.
+   Each slab keeps its own free list; slabs with a free element are on the
+   pool's partial list.  A slab with no element in use is returned as soon as
+   the pool has another one spare.  Like the hash slots above, slabs are
+   bookkeeping and are not charged against the server's memory limit.
+*/
+#define XQ_POOL_SLAB_ELEMS  128
+#define XQ_POOL_SLAB_HDR    ((int) ((sizeof(xq_pool_slab_t) + sizeof(double) - 1) \
+                                    & ~(sizeof(double) - 1)))
+
+static void xq_pool_slab_unlink(xq_pool_t *pool, xq_pool_slab_t *slab)
+{
+    if (slab->prev)
+        slab->prev->next = slab->next;
+    else
+        pool->partial = slab->next;
+    if (slab->next)
+        slab->next->prev = slab->prev;
+}
+
+static void xq_pool_slab_link(xq_pool_t *pool, xq_pool_slab_t *slab)
+{
+    slab->prev = NULL;
+    slab->next = pool->partial;
+    if (pool->partial)
+        pool->partial->prev = slab;
+    pool->partial = slab;
+}
+
+void xq_pool_init(xq_pool_t *pool, int elem_size)
+{
+    int slab_bytes;
+
+    /* keep every element aligned for doubles and big enough for the link */
+    elem_size = (elem_size + sizeof(double) - 1) & ~((int) sizeof(double) - 1);
+    if (elem_size < (int) sizeof(void *))
+        elem_size = sizeof(void *);
+    slab_bytes = 1024;
+    while (slab_bytes < XQ_POOL_SLAB_HDR + XQ_POOL_SLAB_ELEMS * elem_size)
+        slab_bytes *= 2;
+    pool->elem_size = elem_size;
+    pool->slab_bytes = slab_bytes;
+    pool->slab_elems = (slab_bytes - XQ_POOL_SLAB_HDR) / elem_size;
+    pool->partial = NULL;
+    pool->num_slabs = 0;
+    pool->num_empty = 0;
+}
+
+void *xq_pool_get(xq_pool_t *pool)
+{
+    int i;
+    char *elems;
+    void *elem;
+    xq_pool_slab_t *slab;
+
+    if ( ! pool->partial)
+    {
+        slab = bmemalign(pool->slab_bytes,pool->slab_bytes);
+        if ( ! slab )
+            return NULL;
+        elems = (char *) slab + XQ_POOL_SLAB_HDR;
+        slab->free_list = NULL;
+        for (i=pool->slab_elems-1; i >= 0; i--)
+        {
+            *(void **) (elems + i * pool->elem_size) = slab->free_list;
+            slab->free_list = elems + i * pool->elem_size;
+        }
+        slab->num_free = pool->slab_elems;
+        xq_pool_slab_link(pool,slab);
+        pool->num_slabs++;
+        pool->num_empty++;
+    }
+    slab = pool->partial;
+    elem = slab->free_list;
+    slab->free_list = *(void **) elem;
+    if (slab->num_free == pool->slab_elems)
+        pool->num_empty--;
+    slab->num_free--;
+    if (slab->num_free == 0)
+        xq_pool_slab_unlink(pool,slab);
+    return elem;
+}
+
+void xq_pool_put(xq_pool_t *pool, void *elem)
+{
+    xq_pool_slab_t *slab;
+
+    slab = (xq_pool_slab_t *) ((uintptr_t) elem & ~((uintptr_t) pool->slab_bytes - 1));
+    if (slab->num_free == 0)
+        xq_pool_slab_link(pool,slab);
+    *(void **) elem = slab->free_list;
+    slab->free_list = elem;
+    slab->num_free++;
+    if (slab->num_free == pool->slab_elems)
+    {
+        if (pool->num_empty > 0)    /* keep one spare so a get/put pair does not thrash */
+        {
+            xq_pool_slab_unlink(pool,slab);
+            bfree(slab,pool->slab_bytes);
+            pool->num_slabs--;
+        }
+        else
+            pool->num_empty++;
+    }
+}
 
 /* adlb-specific code here */
 
+/* Each queue entry is one pooled block holding its xq node and struct */
+typedef struct wq_entry_t
+{
+    xq_node_t xn;
+    wq_struct_t ws;
+} wq_entry_t;
+
+typedef struct rq_entry_t
+{
+    xq_node_t xn;
+    rq_struct_t rs;
+} rq_entry_t;
+
+typedef struct tq_entry_t
+{
+    xq_node_t xn;
+    xq_node_t rank_xn;    /* on tq_by_rank[app_rank]; data is &xn */
+    tq_struct_t ts;
+} tq_entry_t;
+
+typedef struct cq_entry_t
+{
+    xq_node_t xn;
+    cq_struct_t cs;
+} cq_entry_t;
+
+static xq_pool_t wq_pool, rq_pool, tq_pool, cq_pool, rq_link_pool, rq_mask_pool;
+
+void xq_pools_init()
+{
+    xq_pool_init(&wq_pool,sizeof(wq_entry_t));
+    xq_pool_init(&rq_pool,sizeof(rq_entry_t));
+    xq_pool_init(&tq_pool,sizeof(tq_entry_t));
+    xq_pool_init(&cq_pool,sizeof(cq_entry_t));
+    xq_pool_init(&rq_link_pool,sizeof(xq_node_t));
+}
+
+/* request type masks */
+
+static int req_mask_num_types = 0;
+static int req_mask_num_words = 0;
+
+void req_mask_init(int num_types)
+{
+    req_mask_num_types = num_types;
+    req_mask_num_words = (num_types + REQ_MASK_BITS - 1) / REQ_MASK_BITS;
+    if (req_mask_num_words < 1)
+        req_mask_num_words = 1;
+    xq_pool_init(&rq_mask_pool,req_mask_num_words * sizeof(req_mask_t));
+}
+
+int req_mask_words()
+{
+    return req_mask_num_words;
+}
+
+void req_mask_build(req_mask_t *mask, int num_req_types, int *req_types)
+{
+    int i, type_idx;
+
+    for (i=0; i < req_mask_num_words; i++)
+        mask[i] = 0;
+    for (i=0; i < num_req_types; i++)
+    {
+        if (req_types[i] == -1)  /* wild card; all types */
+        {
+            for (type_idx=0; type_idx < req_mask_num_types; type_idx++)
+                mask[type_idx/REQ_MASK_BITS] |= 1U << (type_idx%REQ_MASK_BITS);
+            return;
+        }
+    }
+    for (i=0; i < num_req_types; i++)
+    {
+        if (req_types[i] < -1)  /* invalid type */
+            continue;
+        type_idx = get_type_idx(req_types[i]);
+        if (type_idx >= 0)
+            mask[type_idx/REQ_MASK_BITS] |= 1U << (type_idx%REQ_MASK_BITS);
+    }
+}
+
 /* wq stuff */
 
 /* must match adlb */
 // #define ADLB_LOWEST_PRIO  INT_MIN
 
+/* Available (unpinned) untargeted work is also kept in one max-heap per type,
+   ordered by work_prio and then by wqseqno so that equal priorities come out
+   in the order they were put.  Each entry remembers its heap and slot so that
+   pinning or deleting it does not require a search.  Unpinned targeted work
+   is kept the same way, in per-type heaps belonging to its target rank; a
+   rank's heaps are only allocated when work is first targeted at it.  An
+   untargeted unit without a common part that an app holds only by a prefetch
+   (soft pinned) is kept in a per-type heap of its own, so that it can be
+   found for taking back as cheaply as available work.
+*/
+typedef struct wq_heap_t
+{
+    xq_node_t **nodes;
+    int count;
+    int size;
+    int type_idx;      /* -1 for the heaps of targeted work */
+} wq_heap_t;
+
+static int wq_num_types = 0;
+static wq_heap_t *wq_type_heaps = NULL;    /* one per type_idx */
+static xq_hash_t *wq_seqno_hash = NULL;    /* wqseqno -> node for all of wq */
+static int wq_num_avail_untargeted = 0;
+static int *wq_summary_hi_prio = NULL;     /* caller's per-type_idx summary; may be NULL */
+static int *wq_summary_qlen = NULL;
+static int wq_num_target_ranks = 0;
+static wq_heap_t **wq_target_heaps = NULL; /* per target rank; NULL until used */
+static wq_heap_t *wq_soft_heaps = NULL;    /* soft pinned units, one per type_idx */
+
+static int wq_heap_before(wq_struct_t *a, wq_struct_t *b)
+{
+    if (a->work_prio != b->work_prio)
+        return a->work_prio > b->work_prio;
+    return a->wqseqno < b->wqseqno;
+}
+
+static void wq_heap_place(wq_heap_t *wh, xq_node_t *xn, int pos)
+{
+    wh->nodes[pos] = xn;
+    ((wq_struct_t *) xn->data)->heap_pos = pos;
+}
+
+static void wq_heap_sift_up(wq_heap_t *wh, int pos)
+{
+    int parent;
+    xq_node_t *xn;
+
+    xn = wh->nodes[pos];
+    while (pos > 0)
+    {
+        parent = (pos - 1) / 2;
+        if ( ! wq_heap_before(xn->data,wh->nodes[parent]->data))
+            break;
+        wq_heap_place(wh,wh->nodes[parent],pos);
+        pos = parent;
+    }
+    wq_heap_place(wh,xn,pos);
+}
+
+static void wq_heap_sift_down(wq_heap_t *wh, int pos)
+{
+    int child;
+    xq_node_t *xn;
+
+    xn = wh->nodes[pos];
+    while ((child = 2*pos + 1) < wh->count)
+    {
+        if (child+1 < wh->count  &&
+            wq_heap_before(wh->nodes[child+1]->data,wh->nodes[child]->data))
+            child++;
+        if ( ! wq_heap_before(wh->nodes[child]->data,xn->data))
+            break;
+        wq_heap_place(wh,wh->nodes[child],pos);
+        pos = child;
+    }
+    wq_heap_place(wh,xn,pos);
+}
+
+/* node arrays are queue bookkeeping like the hash slots, so bmalloc'd; they
+   double when full and halve when under a quarter full */
+#define WQ_HEAP_MIN_SIZE  64
+
+static void wq_heap_resize(wq_heap_t *wh, int new_size)
+{
+    xq_node_t **new_nodes;
+
+    new_nodes = bmalloc(new_size * sizeof(xq_node_t *));
+    if (wh->count > 0)
+        memcpy(new_nodes,wh->nodes,wh->count * sizeof(xq_node_t *));
+    if (wh->nodes)
+        bfree(wh->nodes,wh->size * sizeof(xq_node_t *));
+    wh->nodes = new_nodes;
+    wh->size = new_size;
+}
+
+static void wq_heap_insert(wq_heap_t *wh, xq_node_t *xn)
+{
+    wq_struct_t *ws = (wq_struct_t *) xn->data;
+
+    if (wh->count >= wh->size)
+        wq_heap_resize(wh,(wh->size > 0) ? (2 * wh->size) : WQ_HEAP_MIN_SIZE);
+    ws->heap = wh;
+    wh->nodes[wh->count] = xn;
+    wq_heap_sift_up(wh,wh->count++);
+}
+
+static void wq_heap_remove(xq_node_t *xn)
+{
+    int pos;
+    wq_heap_t *wh;
+    wq_struct_t *ws = (wq_struct_t *) xn->data;
+
+    wh = ws->heap;
+    pos = ws->heap_pos;
+    ws->heap = NULL;
+    ws->heap_pos = -1;
+    if (--wh->count != pos)    /* else was the last slot */
+    {
+        wq_heap_place(wh,wh->nodes[wh->count],pos);
+        if (pos > 0  &&  wq_heap_before(wh->nodes[pos]->data,wh->nodes[(pos-1)/2]->data))
+            wq_heap_sift_up(wh,pos);
+        else
+            wq_heap_sift_down(wh,pos);
+    }
+    if (wh->size > WQ_HEAP_MIN_SIZE  &&  wh->count < wh->size / 4)
+        wq_heap_resize(wh,wh->size / 2);
+}
+
+static xq_node_t *wq_heap_top(wq_heap_t *wh)
+{
+    return (wh->count > 0) ? wh->nodes[0] : NULL;
+}
+
+static void wq_heaps_init(wq_heap_t *heaps, int untargeted)
+{
+    int i;
+
+    for (i=0; i < wq_num_types; i++)
+    {
+        heaps[i].nodes = NULL;
+        heaps[i].count = 0;
+        heaps[i].size  = 0;
+        heaps[i].type_idx = untargeted ? i : -1;
+    }
+}
+
+/* Keep the registered summary (hi prio of avail untargeted work per type, and
+   the number of such units) current as entries enter and leave the type heaps.
+*/
+static void wq_summary_update(wq_heap_t *wh, int delta)
+{
+    xq_node_t *top;
+
+    if (wh->type_idx < 0)
+        return;
+    wq_num_avail_untargeted += delta;
+    if (wq_summary_qlen)
+        *wq_summary_qlen = wq_num_avail_untargeted;
+    if (wq_summary_hi_prio)
+    {
+        top = wq_heap_top(wh);
+        wq_summary_hi_prio[wh->type_idx] =
+            top ? ((wq_struct_t *) top->data)->work_prio : ADLB_LOWEST_PRIO;
+    }
+}
+
+static wq_heap_t *wq_avail_heap(wq_struct_t *ws)  /* heap an entry belongs in, if any */
+{
+    int rank;
+
+    if (ws->type_idx < 0)
+        return NULL;
+    if (ws->pinned)
+    {
+        if (ws->soft_pinned  &&  ws->target_rank < 0  &&  ws->common_len == 0)
+            return &wq_soft_heaps[ws->type_idx];
+        return NULL;
+    }
+    rank = ws->target_rank;
+    if (rank < 0)
+        return &wq_type_heaps[ws->type_idx];
+    if (rank >= wq_num_target_ranks)
+        return NULL;
+    if ( ! wq_target_heaps[rank])
+    {
+        wq_target_heaps[rank] = bmalloc(wq_num_types * sizeof(wq_heap_t));
+        wq_heaps_init(wq_target_heaps[rank],0);
+    }
+    return &wq_target_heaps[rank][ws->type_idx];
+}
+
+static void wq_index_remove(xq_node_t *xn)
+{
+    wq_heap_t *wh;
+
+    wh = ((wq_struct_t *) xn->data)->heap;
+    wq_heap_remove(xn);
+    wq_summary_update(wh,-1);
+}
+
+static void wq_index_update(xq_node_t *xn)  /* call after pinned/target changes */
+{
+    wq_heap_t *wh;
+    wq_struct_t *ws = (wq_struct_t *) xn->data;
+
+    wh = wq_avail_heap(ws);
+    if (ws->heap == wh)
+        return;
+    if (ws->heap)
+        wq_index_remove(xn);
+    if (wh)
+    {
+        wq_heap_insert(wh,xn);
+        wq_summary_update(wh,1);
+    }
+}
+
+static xq_node_t *wq_heaps_find_hi_prio(wq_heap_t *heaps, req_mask_t *req_mask)
+{
+    int w, type_idx;
+    req_mask_t bits;
+    xq_node_t *xn, *bsf = NULL;
+
+    for (w=0; w < req_mask_num_words; w++)
+    {
+        for (bits=req_mask[w], type_idx=w*REQ_MASK_BITS;  bits;  bits >>= 1, type_idx++)
+        {
+            if ( ! (bits & 1))
+                continue;
+            xn = wq_heap_top(&heaps[type_idx]);
+            if (xn  &&  ( ! bsf  ||  wq_heap_before(xn->data,bsf->data)))
+                bsf = xn;
+        }
+    }
+    return bsf;
+}
+
+void wq_index_init(int num_types, int num_ranks)
+{
+    int i;
+
+    wq_num_types = num_types;
+    wq_type_heaps = amalloc(num_types * sizeof(wq_heap_t));
+    wq_heaps_init(wq_type_heaps,1);
+    wq_soft_heaps = amalloc(num_types * sizeof(wq_heap_t));
+    wq_heaps_init(wq_soft_heaps,0);
+    wq_seqno_hash = xq_hash_create();
+    wq_num_target_ranks = num_ranks;
+    wq_target_heaps = amalloc(num_ranks * sizeof(wq_heap_t *));
+    for (i=0; i < num_ranks; i++)
+        wq_target_heaps[i] = NULL;
+}
+
 xq_node_t *wq_node_create(int work_type, int work_prio, int wqseqno, int answer_rank,
                           int target_rank, int work_len, void *work_buf)
 {
     xq_node_t *xn;
     wq_struct_t *ws;
+    wq_entry_t *we;
 
-    ws = amalloc(sizeof(wq_struct_t));
-    if ( ! ws )
-        return NULL;
-    xn = xq_node_create(ws);
-    if ( ! xn )
+    we = xq_pool_get(&wq_pool);
+    if ( ! we )
         return NULL;
+    xn = &we->xn;
+    ws = &we->ws;
+    xn->data = ws;
     /****
     ws->work_buf = amalloc(work_len);
     if ( ! ws->work_buf )
@@ -145,9 +703,13 @@ xq_node_t *wq_node_create(int work_type, int work_prio, int wqseqno, int answer_
     ws->home_server_rank  = -1;  /* chgd outside if needed for target rank */
     ws->pin_rank          = -1;  /* chgd outside as nec */
     ws->pinned            = 0;
+    ws->soft_pinned       = 0;
     ws->common_len        = 0;
     ws->common_server_rank = -1;
     ws->common_server_commseqno = -1;
+    ws->type_idx          = get_type_idx(work_type);
+    ws->heap_pos          = -1;
+    ws->heap              = NULL;
     ws->time_stamp        = 0;    /* chgd outside */
     return xn;    /* really returning an xq node */
 }
@@ -155,6 +717,8 @@ xq_node_t *wq_node_create(int work_type, int work_prio, int wqseqno, int answer_
 void wq_append(xq_node_t *xn)
 {
     xq_insert_before(wq, xn, &wq->termnode);
+    xq_hash_insert(wq_seqno_hash,((wq_struct_t *) xn->data)->wqseqno,xn);
+    wq_index_update(xn);
 }
 
 void wq_delete(xq_node_t *xn)
@@ -164,103 +728,117 @@ void wq_delete(xq_node_t *xn)
     ws = (wq_struct_t *) xn->data;
     if (ws)
     {
+        xq_hash_remove(wq_seqno_hash,ws->wqseqno);
+        if (ws->heap)
+            wq_index_remove(xn);
         if ( ws->work_buf )
         {
-            afree(ws->work_buf,ws->work_len);
+            pfree(ws->work_buf,ws->work_len);
         }
-        afree(ws,sizeof(wq_struct_t));
     }
-    xq_delete(wq,xn);
+    xq_unlink(wq,xn);
+    xq_pool_put(&wq_pool,xn);    /* xn is at the start of its wq_entry_t */
 }
 
 xq_node_t *wq_find_seqno(int wqseqno)
 {
-    xq_node_t *xn;
-    wq_struct_t *ws;
+    return xq_hash_find(wq_seqno_hash,wqseqno);
+}
 
-    for (xn=xq_first(wq);  xn && xn != &(wq->termnode);  xn=xn->next)
-    {
-        ws = (wq_struct_t *) xn->data;
-        if (ws->wqseqno == wqseqno)
-            return xn;
-    }
-    return NULL;
+void wq_pin(xq_node_t *xn, int pin_rank)
+{
+    wq_struct_t *ws = (wq_struct_t *) xn->data;
+
+    ws->pin_rank = pin_rank;
+    if (ws->pin_rank >= 0)
+        ws->pinned = 1;
+    ws->soft_pinned = 0;
+    wq_index_update(xn);
 }
 
-xq_node_t *wq_find_hi_prio(int *req_types)
+void wq_soft_pin(xq_node_t *xn, int pin_rank)  /* pinned by a prefetch */
 {
-    int i, hi_prio = -999999999;
-    xq_node_t *xn, *bsf = NULL;
-    wq_struct_t *ws;
+    wq_struct_t *ws = (wq_struct_t *) xn->data;
 
-    for (xn=xq_first(wq);  xn && xn != &(wq->termnode);  xn=xn->next)
-    {
-        ws = (wq_struct_t *) xn->data;
-        if (ws->pinned)    // PTW: don't grab pinned data
-            continue;
-        if (ws->target_rank < 0)   /* if NOT targeted */
-        {
-            for (i=0; i < REQ_TYPE_VECT_SZ; i++)
-            {
-                if (req_types[i] == -1  ||  req_types[i] == ws->work_type)
-                {
-                    if (ws->work_prio > hi_prio)
-                    {
-                        hi_prio = ws->work_prio;
-                        bsf = xn;
-                    }
-                }
-            }
-        }
-    }
-    return bsf;
+    ws->pin_rank = pin_rank;
+    ws->pinned = 1;
+    ws->soft_pinned = 1;
+    wq_index_update(xn);
 }
 
-xq_node_t *wq_find_pre_targeted_hi_prio(int target_rank, int *req_types)
+void wq_unpin(xq_node_t *xn, int pin_rank)  /* pin_rank may be -1 */
 {
-    int i, hi_prio;
-    xq_node_t *xn, *bsf = NULL;
-    wq_struct_t *ws;
+    wq_struct_t *ws = (wq_struct_t *) xn->data;
 
-    hi_prio = ADLB_LOWEST_PRIO;
-    for (xn=xq_first(wq);  xn && xn != &(wq->termnode);  xn=xn->next)
-    {
-        ws = (wq_struct_t *) xn->data;
-        if (ws->pinned)    // PTW: don't grab pinned data
-            continue;
-        if (ws->target_rank == target_rank)
-        {
-            for (i=0; i < REQ_TYPE_VECT_SZ; i++)
-            {
-                if (req_types[i] == -1  ||  req_types[i] == ws->work_type)
-                {
-                    if (ws->work_prio > hi_prio)
-                    {
-                        hi_prio = ws->work_prio;
-                        bsf = xn;
-                    }
-                }
-            }
-        }
-    }
-    return bsf;
+    ws->pin_rank = pin_rank;
+    ws->pinned = 0;
+    ws->soft_pinned = 0;
+    wq_index_update(xn);
+}
+
+xq_node_t *wq_find_hi_prio(req_mask_t *req_mask)  /* only finds untargeted work */
+{
+    return wq_heaps_find_hi_prio(wq_type_heaps,req_mask);
+}
+
+xq_node_t *wq_find_pre_targeted_hi_prio(int target_rank, req_mask_t *req_mask)
+{
+    if (target_rank < 0  ||  target_rank >= wq_num_target_ranks)
+        return NULL;
+    if ( ! wq_target_heaps[target_rank])    /* nothing ever targeted here */
+        return NULL;
+    return wq_heaps_find_hi_prio(wq_target_heaps[target_rank],req_mask);
 }
 
 xq_node_t *wq_find_pinned_for_rank(int pin_rank, int wqseqno)
 {
     xq_node_t *xn;
-    wq_struct_t *ws;
 
-    for (xn=xq_first(wq);  xn && xn != &(wq->termnode);  xn=xn->next)
-    {
-        ws = (wq_struct_t *) xn->data;
-        if (ws->pin_rank == pin_rank  &&  ws->wqseqno == wqseqno)
-            break;
-    }
-    if ( ! xn  ||  xn == &(wq->termnode))
+    xn = xq_hash_find(wq_seqno_hash,wqseqno);
+    if ( ! xn  ||  ((wq_struct_t *) xn->data)->pin_rank != pin_rank)
         return NULL;
-    else
+    return xn;
+}
+
+/* best entry at or below pos not pinned by for_rank; only descends past
+   for_rank's own entries, of which there are at most its prefetch depth */
+static xq_node_t *wq_heap_find_not_rank(wq_heap_t *wh, int pos, int for_rank)
+{
+    xq_node_t *xn, *left;
+
+    if (pos >= wh->count)
+        return NULL;
+    xn = wh->nodes[pos];
+    if (((wq_struct_t *) xn->data)->pin_rank != for_rank)
         return xn;
+    left = wq_heap_find_not_rank(wh,2*pos+1,for_rank);
+    xn = wq_heap_find_not_rank(wh,2*pos+2,for_rank);
+    if ( ! xn  ||  (left  &&  wq_heap_before(left->data,xn->data)))
+        return left;
+    return xn;
+}
+
+/* hi prio untargeted unit that some rank other than for_rank holds only by a
+   prefetch.  Units with a common part are left alone: a common is served a
+   counted number of times, and the holder may already have fetched it. */
+xq_node_t *wq_find_soft_pinned(int for_rank, req_mask_t *req_mask)
+{
+    int w, type_idx;
+    req_mask_t bits;
+    xq_node_t *xn, *bsf = NULL;
+
+    for (w=0; w < req_mask_num_words; w++)
+    {
+        for (bits=req_mask[w], type_idx=w*REQ_MASK_BITS;  bits;  bits >>= 1, type_idx++)
+        {
+            if ( ! (bits & 1))
+                continue;
+            xn = wq_heap_find_not_rank(&wq_soft_heaps[type_idx],0,for_rank);
+            if (xn  &&  ( ! bsf  ||  wq_heap_before(xn->data,bsf->data)))
+                bsf = xn;
+        }
+    }
+    return bsf;
 }
 
 xq_node_t *wq_find_unpinned()
@@ -295,37 +873,36 @@ int wq_get_num_unpinned()
     return num_unpinned;
 }
 
-int wq_get_num_unpinned_untargeted()
+void wq_summary_register(int *type_hi_prio, int *qlen_unpin_untarg)
 {
-    xq_node_t *xn;
-    wq_struct_t *ws;
-    int num = 0;
+    int i;
+    xq_node_t *top;
 
-    for (xn=xq_first(wq);  xn && xn != &(wq->termnode);  xn=xn->next)
+    wq_summary_hi_prio = type_hi_prio;
+    wq_summary_qlen = qlen_unpin_untarg;
+    *wq_summary_qlen = wq_num_avail_untargeted;
+    for (i=0; i < wq_num_types; i++)
     {
-        ws = (wq_struct_t *) xn->data;
-        if ( ! ws->pinned  &&  ws->target_rank < 0)
-            num++;
+        top = wq_heap_top(&wq_type_heaps[i]);
+        wq_summary_hi_prio[i] = top ? ((wq_struct_t *) top->data)->work_prio : ADLB_LOWEST_PRIO;
     }
-    return num;
 }
 
-int wq_get_avail_hi_prio_of_type(int work_type)  /* avail -> only not pinned and not targeted */
+int wq_get_num_unpinned_untargeted()
 {
-    xq_node_t *xn;
-    wq_struct_t *ws;
-    int hi_prio;
+    return wq_num_avail_untargeted;
+}
 
-    hi_prio = ADLB_LOWEST_PRIO;
-    for (xn=xq_first(wq);  xn && xn != &(wq->termnode);  xn=xn->next)
-    {
-        ws = (wq_struct_t *) xn->data;
-        if (ws->pinned  ||  ws->target_rank >= 0)
-            continue;
-        if (ws->work_type == work_type  &&  ws->work_prio > hi_prio)
-            hi_prio = ws->work_prio;
-    }
-    return hi_prio;
+int wq_get_avail_hi_prio_of_type(int work_type)  /* avail -> only not pinned and not targeted */
+{
+    int type_idx;
+    xq_node_t *top;
+
+    type_idx = get_type_idx(work_type);
+    if (type_idx < 0)
+        return ADLB_LOWEST_PRIO;
+    top = wq_heap_top(&wq_type_heaps[type_idx]);
+    return top ? ((wq_struct_t *) top->data)->work_prio : ADLB_LOWEST_PRIO;
 }
 
 void wq_print_info()
@@ -349,21 +926,124 @@ void wq_print_info()
 
 /* rq stuff */
 
-xq_node_t *rq_node_create(int world_rank, int *req_types, int rqseqno)
+/* Besides rq itself, each waiting rank is on a FIFO list for every type it
+   asked for (or on the wildcard list), via link nodes whose data is the rq
+   node, and is found by rank in rq_by_rank.  There is at most one rq entry
+   per app rank since Reserve blocks.
+*/
+static xq_t *rq_type_lists = NULL;     /* one per type_idx */
+static xq_t rq_wild_list;
+static int rq_num_ranks = 0;
+static xq_node_t **rq_by_rank = NULL;
+static int rq_next_order = 0;
+
+void rq_index_init(int num_types, int num_ranks)
+{
+    int i;
+
+    rq_type_lists = amalloc(num_types * sizeof(xq_t));
+    for (i=0; i < num_types; i++)
+        xq_init(&rq_type_lists[i]);
+    xq_init(&rq_wild_list);
+    rq_num_ranks = num_ranks;
+    rq_by_rank = amalloc(num_ranks * sizeof(xq_node_t *));
+    for (i=0; i < num_ranks; i++)
+        rq_by_rank[i] = NULL;
+}
+
+static int rq_is_wild(rq_struct_t *rs)
+{
+    return rs->num_req_types == 1  &&  rs->req_types[0] == -1;
+}
+
+/* Steps through the lists an rq entry belongs on, in a fixed order, so that
+   rq_delete finds each link on the list rq_append put it on.  Start with
+   *pos = -1; returns NULL after the last list.
+*/
+static xq_t *rq_next_list(rq_struct_t *rs, int *pos)
+{
+    int type_idx;
+    req_mask_t bits;
+
+    if (rq_is_wild(rs))
+    {
+        if (*pos >= 0)
+            return NULL;
+        *pos = req_mask_num_types;
+        return &rq_wild_list;
+    }
+    type_idx = *pos + 1;
+    while (type_idx < req_mask_num_types)
+    {
+        bits = rs->req_mask[type_idx/REQ_MASK_BITS] >> (type_idx%REQ_MASK_BITS);
+        if ( ! bits )    /* skip the rest of this word */
+            type_idx = (type_idx/REQ_MASK_BITS + 1) * REQ_MASK_BITS;
+        else if (bits & 1)
+        {
+            *pos = type_idx;
+            return &rq_type_lists[type_idx];
+        }
+        else
+            type_idx++;
+    }
+    return NULL;
+}
+
+static int rq_wants_type(rq_struct_t *rs, int work_type)
+{
+    int type_idx;
+
+    type_idx = get_type_idx(work_type);
+    return type_idx >= 0  &&  REQ_MASK_TEST(rs->req_mask,type_idx);
+}
+
+static xq_node_t *rq_list_head(xq_t *list)  /* oldest rq node on a type list */
+{
+    xq_node_t *link;
+
+    link = xq_first(list);
+    return link ? (xq_node_t *) link->data : NULL;
+}
+
+xq_node_t *rq_node_create(int world_rank, int num_req_types, int *req_types, int rqseqno)
 {
     int i;
     rq_struct_t *rs;
     xq_node_t *xn;
+    rq_entry_t *re;
 
-    rs = amalloc(sizeof(rq_struct_t));
-    if ( ! rs )
-        return NULL;
-    xn = xq_node_create(rs);
-    if ( ! xn )
+    re = xq_pool_get(&rq_pool);
+    if ( ! re )
         return NULL;
+    xn = &re->xn;
+    rs = &re->rs;
+    xn->data = rs;
     rs->world_rank = world_rank;
-    for (i=0; i < REQ_TYPE_VECT_SZ; i++)
+    for (i=0; i < num_req_types; i++)
+        if (req_types[i] == -1)  /* wild card; all types */
+            num_req_types = 0;
+    if (num_req_types == 0)
+    {
+        rs->num_req_types = 1;
+        rs->inline_types[0] = -1;
+    }
+    else
+        rs->num_req_types = num_req_types;
+    if (rs->num_req_types <= RQ_INLINE_TYPES)
+    {
+        rs->req_types = rs->inline_types;
+        rs->links = rs->inline_links;
+    }
+    else
+    {
+        rs->req_types = bmalloc(rs->num_req_types * sizeof(int));
+        rs->links = bmalloc(rs->num_req_types * sizeof(xq_node_t *));
+    }
+    for (i=0; i < num_req_types; i++)
         rs->req_types[i] = req_types[i];
+    rs->num_links = 0;
+    rs->req_mask = xq_pool_get(&rq_mask_pool);
+    req_mask_build(rs->req_mask,rs->num_req_types,rs->req_types);
     rs->rqseqno = rqseqno;
     rs->time_stamp = 0;    /* chgd outside */
     return xn;
@@ -371,37 +1051,75 @@ xq_node_t *rq_node_create(int world_rank, int *req_types, int rqseqno)
 
 void rq_append(xq_node_t *xn)
 {
-    rq_struct_t *rs = (rq_struct_t *) xn->data;  /* useful for debug printing */
+    int pos;
+    xq_t *list;
+    xq_node_t *link;
+    rq_struct_t *rs = (rq_struct_t *) xn->data;
 
     xq_insert_before(rq, xn, &rq->termnode);
+    rs->rq_order = rq_next_order++;
+    rs->num_links = 0;    /* at most num_req_types lists */
+    for (pos=-1; (list = rq_next_list(rs,&pos)) != NULL; )
+    {
+        link = xq_pool_get(&rq_link_pool);
+        link->data = xn;
+        xq_insert_before(list,link,&list->termnode);
+        rs->links[rs->num_links++] = link;
+    }
+    if (rs->world_rank >= 0  &&  rs->world_rank < rq_num_ranks)
+        rq_by_rank[rs->world_rank] = xn;
 }
 
 void rq_delete(xq_node_t *xn)
 {
-    if (xn->data)
+    int i, pos;
+    xq_t *list;
+    rq_struct_t *rs = (rq_struct_t *) xn->data;
+
+    /* same lists, in the same order, as in rq_append */
+    for (i=0, pos=-1; i < rs->num_links  &&  (list = rq_next_list(rs,&pos)) != NULL; i++)
+    {
+        xq_unlink(list,rs->links[i]);
+        xq_pool_put(&rq_link_pool,rs->links[i]);
+    }
+    rs->num_links = 0;
+    if (rs->req_types != rs->inline_types)
     {
-        afree((rq_struct_t *)xn->data,sizeof(rq_struct_t));
+        bfree(rs->req_types,rs->num_req_types * sizeof(int));
+        bfree(rs->links,rs->num_req_types * sizeof(xq_node_t *));
     }
-    xq_delete(rq,xn);
+    if (rs->world_rank >= 0  &&  rs->world_rank < rq_num_ranks
+    &&  rq_by_rank[rs->world_rank] == xn)
+        rq_by_rank[rs->world_rank] = NULL;
+    xq_unlink(rq,xn);
+    xq_pool_put(&rq_mask_pool,rs->req_mask);
+    xq_pool_put(&rq_pool,xn);
 }
 
 xq_node_t *rq_find_rank_queued_for_type(int rank, int work_type)  /* either arg may be -1 */
 {
-    int i;
-    xq_node_t *xn;
-    rq_struct_t *rs;
+    int type_idx;
+    xq_node_t *xn, *wild_xn;
 
-    for (xn=xq_first(rq);  xn && xn != &(rq->termnode);  xn=xn->next)
+    if (rank >= 0)
     {
-        rs = (rq_struct_t *) xn->data;
-        for (i=0; i < REQ_TYPE_VECT_SZ; i++)
-        {
-            if (work_type == -1 ||  rs->req_types[i] == -1 ||  work_type == rs->req_types[i])
-                if (rank == -1  ||  rank == rs->world_rank)
-                    return xn;
-        }
+        if (rank >= rq_num_ranks)
+            return NULL;
+        xn = rq_by_rank[rank];
+        if (xn  &&  (work_type == -1  ||  rq_wants_type(xn->data,work_type)))
+            return xn;
+        return NULL;
     }
-    return NULL;
+    if (work_type == -1)
+        return xq_first(rq);
+    /* oldest of the first waiting for this type and the first wildcard */
+    type_idx = get_type_idx(work_type);
+    xn = (type_idx >= 0) ? rq_list_head(&rq_type_lists[type_idx]) : NULL;
+    wild_xn = rq_list_head(&rq_wild_list);
+    if ( ! xn  ||  (wild_xn  &&  ((rq_struct_t *) wild_xn->data)->rq_order <
+                                 ((rq_struct_t *) xn->data)->rq_order))
+        xn = wild_xn;
+    return xn;
 }
 
 xq_node_t *rq_find_seqno(int rqseqno)
@@ -430,10 +1148,8 @@ void rq_print_info(int num_types)
     {
         rs = (rq_struct_t *) xn->data;
         debug_buf[0] = '\0';
-        for (i=0; i < num_types; i++)
+        for (i=0; i < rs->num_req_types; i++)
         {
-            if (rs->req_types[i] < 0  &&  i > 0)
-                break;
             sprintf(temp_buf,"%d ",rs->req_types[i]);
             if ((strlen(debug_buf) + strlen(temp_buf)) > 4096)
                 break;
@@ -446,75 +1162,175 @@ void rq_print_info(int num_types)
 
 /* iq stuff */
 
-xq_node_t *iq_node_create(MPI_Request *mpi_req, int buf_len, void *buf)
+/* Outstanding isends are kept in a growable array of requests, with the
+   buffer each one owns in the parallel array iq_slots, so that one
+   MPI_Testsome finds all that have completed.  A completed slot is
+   filled from the end of the arrays, so slot numbers are only good from
+   iq_slot_create until the isend into iq_req(slot) is posted.  The arrays
+   grow while replies are in flight, so they are bmalloc'd bookkeeping.
+*/
+static MPI_Request *iq_reqs = NULL;
+static iq_struct_t *iq_slots = NULL;
+static int *iq_done_idx = NULL;
+static int iq_num = 0, iq_size = 0;
+
+#define  IQ_INIT_SIZE                       64
+
+static void iq_alloc(int size)
 {
-    xq_node_t *xn;
-    iq_struct_t *is;
+    int i;
+    MPI_Request *new_reqs;
+    iq_struct_t *new_slots;
 
-    is = amalloc(sizeof(iq_struct_t));
-    if ( ! is )
-        return NULL;
-    xn = xq_node_create(is);
-    if ( ! xn )
-        return NULL;
-    is->mpi_req = mpi_req;
-    is->buf_len = buf_len;
-    is->buf = buf;
-    return xn;
+    new_reqs = bmalloc(size * sizeof(MPI_Request));
+    new_slots = bmalloc(size * sizeof(iq_struct_t));
+    for (i=0; i < iq_num; i++)
+    {
+        new_reqs[i] = iq_reqs[i];
+        new_slots[i] = iq_slots[i];
+    }
+    if (iq_size > 0)
+    {
+        bfree(iq_reqs,iq_size * sizeof(MPI_Request));
+        bfree(iq_slots,iq_size * sizeof(iq_struct_t));
+        bfree(iq_done_idx,iq_size * sizeof(int));
+    }
+    iq_reqs = new_reqs;
+    iq_slots = new_slots;
+    iq_done_idx = bmalloc(size * sizeof(int));
+    iq_size = size;
+}
+
+void iq_init()
+{
+    iq_alloc(IQ_INIT_SIZE);
 }
 
-void iq_append(xq_node_t *xn)
+int iq_slot_create(int buf_len, void *buf)  /* isend into iq_req(slot) */
 {
-    xq_insert_before(iq, xn, &iq->termnode);
+    int slot;
+
+    if (iq_num == iq_size)
+        iq_alloc(2 * iq_size);
+    slot = iq_num++;
+    iq_reqs[slot] = MPI_REQUEST_NULL;
+    iq_slots[slot].buf_len = buf_len;
+    iq_slots[slot].buf_is_payload = 0;
+    iq_slots[slot].buf = buf;
+    return slot;
 }
 
-void iq_delete(xq_node_t *xn)
+void iq_set_payload(int slot)  /* buf is from pmalloc rather than amalloc */
 {
-    if (xn->data)
+    iq_slots[slot].buf_is_payload = 1;
+}
+
+MPI_Request *iq_req(int slot)
+{
+    return &iq_reqs[slot];
+}
+
+int iq_count()
+{
+    return iq_num;
+}
+
+static int iq_cmp_desc(const void *a, const void *b)
+{
+    return *(const int *) b - *(const int *) a;
+}
+
+void iq_test_completed()  /* frees the bufs of completed isends */
+{
+    int i, slot, outcount;
+
+    if (iq_num == 0)
+        return;
+    MPI_Testsome(iq_num,iq_reqs,&outcount,iq_done_idx,MPI_STATUSES_IGNORE);
+    if (outcount == MPI_UNDEFINED  ||  outcount == 0)
+        return;
+    /* highest first, so the slot moved down from the end is never a completed one */
+    qsort(iq_done_idx,outcount,sizeof(int),iq_cmp_desc);
+    for (i=0; i < outcount; i++)
     {
-        if ( ((iq_struct_t *)xn->data)->buf )
+        slot = iq_done_idx[i];
+        if (iq_slots[slot].buf_is_payload)
+            pfree(iq_slots[slot].buf,iq_slots[slot].buf_len);
+        else if (iq_slots[slot].buf)
+            afree(iq_slots[slot].buf,iq_slots[slot].buf_len);
+        iq_num--;
+        if (slot != iq_num)
         {
-            afree( ((iq_struct_t *)xn->data)->buf, ((iq_struct_t *)xn->data)->buf_len );
+            iq_reqs[slot] = iq_reqs[iq_num];
+            iq_slots[slot] = iq_slots[iq_num];
         }
-        if ( ((iq_struct_t *)xn->data)->mpi_req )
-        {
-            afree( ((iq_struct_t *)xn->data)->mpi_req, sizeof(MPI_Request) );
-        }
-        afree((iq_struct_t *)xn->data,sizeof(iq_struct_t));
     }
-    xq_delete(iq,xn);
 }
 
 void iq_print_info()
 {
-    int iq_nbytes;
-    xq_node_t *xn;
-    iq_struct_t *is;
+    int i, iq_nbytes;
+
+    if (iq_size == 0)    /* not a server */
+        return;
+    iq_nbytes = iq_size * (sizeof(MPI_Request) + sizeof(iq_struct_t) + sizeof(int));
+    for (i=0; i < iq_num; i++)
+        iq_nbytes += iq_slots[i].buf_len;
+    aprintf(1,"iq has %d entries;  size in bytes %d\n",iq_num,iq_nbytes);
+}
+
+
+/* tq stuff */  /* targeted work queue */
+
+/* tq entries are unique by (app_rank,work_type,remote_server_rank) and are
+   found by that triple in tq_hash.  Each is also on a FIFO list for its
+   app_rank so the oldest for a rank (and type) is found without a scan of tq.
+*/
+static xq_hash_t *tq_hash = NULL;
+static xq_t *tq_by_rank = NULL;    /* one per rank */
+static int tq_num_ranks = 0, tq_num_types = 0;
 
-    iq_nbytes = 0;
-    for (xn=xq_first(iq);  xn && xn != &(iq->termnode);  xn=xn->next)
+void tq_index_init(int num_types, int num_ranks)
+{
+    int i;
+
+    /* the triple is packed into one long long key below */
+    if ((double) num_ranks * num_ranks * (num_types+1) >= 4.0e18)
     {
-        is = xn->data;
-        iq_nbytes += is->buf_len;
-        iq_nbytes += sizeof(MPI_Request);
+        aprintf(1,"** tq_index_init: %d ranks and %d types are too many to index\n",
+                num_ranks,num_types);
+        ADLBP_Abort(-1);
     }
-    aprintf(1,"iq has %d entries;  size in bytes %d\n",iq->count,iq_nbytes);
+    tq_hash = xq_hash_create();
+    tq_by_rank = amalloc(num_ranks * sizeof(xq_t));
+    for (i=0; i < num_ranks; i++)
+        xq_init(&tq_by_rank[i]);
+    tq_num_ranks = num_ranks;
+    tq_num_types = num_types;
 }
 
+static long long tq_key(int app_rank, int work_type, int remote_server_rank)
+{
+    int type_idx;
 
-/* tq stuff */  /* targeted work queue */
+    type_idx = get_type_idx(work_type);    /* -1 for an unknown type */
+    return ((long long) app_rank * tq_num_ranks + remote_server_rank) * (tq_num_types+1)
+           + (type_idx + 1);
+}
 
 xq_node_t *tq_node_create(int app_rank, int work_type, int remote_server_rank, int num_stored)
 {
     xq_node_t *xn;
     tq_struct_t *ts;
+    tq_entry_t *te;
 
-    ts = amalloc(sizeof(tq_struct_t));
-    if ( ! ts )
-        return NULL;
-    xn = xq_node_create(ts);
-    if ( ! xn )
+    te = xq_pool_get(&tq_pool);
+    if ( ! te )
         return NULL;
+    xn = &te->xn;
+    ts = &te->ts;
+    xn->data = ts;
+    te->rank_xn.data = xn;
     ts->app_rank = app_rank;
     ts->work_type = work_type;
     ts->remote_server_rank = remote_server_rank;
@@ -524,50 +1340,46 @@ xq_node_t *tq_node_create(int app_rank, int work_type, int remote_server_rank, i
 
 void tq_append(xq_node_t *xn)
 {
+    tq_struct_t *ts = (tq_struct_t *) xn->data;
+    tq_entry_t *te = (tq_entry_t *) xn;    /* xn is at the start of its tq_entry_t */
+
     xq_insert_before(tq, xn, &tq->termnode);
+    xq_hash_insert(tq_hash,tq_key(ts->app_rank,ts->work_type,ts->remote_server_rank),xn);
+    xq_insert_before(&tq_by_rank[ts->app_rank],&te->rank_xn,&tq_by_rank[ts->app_rank].termnode);
 }
 
 void tq_delete(xq_node_t *xn)
 {
-    if (xn->data)
-    {
-        afree((tq_struct_t *)xn->data,sizeof(tq_struct_t));
-    }
-    xq_delete(tq,xn);
+    tq_struct_t *ts = (tq_struct_t *) xn->data;
+    tq_entry_t *te = (tq_entry_t *) xn;
+
+    xq_hash_remove(tq_hash,tq_key(ts->app_rank,ts->work_type,ts->remote_server_rank));
+    xq_unlink(&tq_by_rank[ts->app_rank],&te->rank_xn);
+    xq_unlink(tq,xn);
+    xq_pool_put(&tq_pool,xn);
 }
 
 xq_node_t *tq_find_first_rt(int for_rank,int work_type)
 {
-    xq_node_t *xn;
+    xq_node_t *rank_xn, *xn;
     tq_struct_t *ts;
 
-    for (xn=xq_first(tq);  xn && xn != &(tq->termnode);  xn=xn->next)
+    if (for_rank < 0  ||  for_rank >= tq_num_ranks)
+        return NULL;
+    for (rank_xn=xq_first(&tq_by_rank[for_rank]);  rank_xn;
+         rank_xn=xq_next(&tq_by_rank[for_rank],rank_xn))
     {
+        xn = (xq_node_t *) rank_xn->data;
         ts = (tq_struct_t *) xn->data;
-        if (for_rank == ts->app_rank)
-        {
-            if (work_type == -1  ||  work_type == ts->work_type)
-                return xn;
-        }
+        if (work_type == -1  ||  work_type == ts->work_type)
+            return xn;
     }
     return NULL;
 }
 
 xq_node_t *tq_find_rtr(int for_rank,int work_type,int remote_server_rank)
 {
-    xq_node_t *xn;
-    tq_struct_t *ts;
-
-    for (xn=xq_first(tq);  xn && xn != &(tq->termnode);  xn=xn->next)
-    {
-        ts = (tq_struct_t *) xn->data;
-        if (ts->app_rank == for_rank  &&  ts->work_type == work_type  &&
-            ts->remote_server_rank == remote_server_rank)
-        {
-            return xn;
-        }
-    }
-    return NULL;
+    return xq_hash_find(tq_hash,tq_key(for_rank,work_type,remote_server_rank));
 }
 
 void tq_print_info()
@@ -586,17 +1398,25 @@ void tq_print_info()
 
 /* cq stuff */  /* common data chunks */
 
+static xq_hash_t *cq_seqno_hash = NULL;    /* cqseqno -> node for all of cq */
+
+void cq_index_init()
+{
+    cq_seqno_hash = xq_hash_create();
+}
+
 xq_node_t *cq_node_create(int commlen, void *commbuf, int seqno)
 {
     xq_node_t *xn;
     cq_struct_t *cs;
+    cq_entry_t *ce;
 
-    cs = amalloc(sizeof(cq_struct_t));
-    if ( ! cs )
-        return NULL;
-    xn = xq_node_create(cs);
-    if ( ! xn )
+    ce = xq_pool_get(&cq_pool);
+    if ( ! ce )
         return NULL;
+    xn = &ce->xn;
+    cs = &ce->cs;
+    xn->data = cs;
     cs->commlen = commlen;
     cs->buf     = commbuf;
     cs->cqseqno = seqno;
@@ -610,28 +1430,21 @@ void cq_delete(xq_node_t *xn)
     cq_struct_t *cs;
 
     cs = (cq_struct_t *) xn->data;
-    afree(cs->buf,cs->commlen);
-    afree(cs,sizeof(cq_struct_t));
-    xq_delete(cq,xn);
+    xq_hash_remove(cq_seqno_hash,cs->cqseqno);
+    pfree(cs->buf,cs->commlen);
+    xq_unlink(cq,xn);
+    xq_pool_put(&cq_pool,xn);
 }
 
 void cq_append(xq_node_t *xn)
 {
     xq_insert_before(cq, xn, &cq->termnode);
+    xq_hash_insert(cq_seqno_hash,((cq_struct_t *) xn->data)->cqseqno,xn);
 }
 
 xq_node_t *cq_find_seqno(int cqseqno)
 {
-    xq_node_t *xn;
-    cq_struct_t *cs;
-
-    for (xn=xq_first(cq);  xn && xn != &(cq->termnode);  xn=xn->next)
-    {
-        cs = (cq_struct_t *) xn->data;
-        if (cs->cqseqno == cqseqno)
-            return xn;
-    }
-    return NULL;
+    return xq_hash_find(cq_seqno_hash,cqseqno);
 }
 
 void cq_print_info()
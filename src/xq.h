@@ -19,12 +19,43 @@ typedef struct xq_t
     int max_count;
 } xq_t;
 
+typedef struct xq_hash_slot_t
+{
+    long long key;
+    xq_node_t *xn;    /* NULL if slot is empty */
+} xq_hash_slot_t;
+
+typedef struct xq_hash_t
+{
+    xq_hash_slot_t *slots;
+    int size;         /* always a power of 2 */
+    int count;
+} xq_hash_t;
+
+typedef struct xq_pool_slab_t
+{
+    struct xq_pool_slab_t *next, *prev;    /* on the pool's partial list */
+    void *free_list;
+    int num_free;
+} xq_pool_slab_t;
+
+typedef struct xq_pool_t
+{
+    int elem_size;
+    int slab_bytes;   /* a power of 2; each slab is aligned to it */
+    int slab_elems;
+    xq_pool_slab_t *partial;    /* slabs with at least one free element */
+    int num_slabs;
+    int num_empty;    /* slabs with no element in use */
+} xq_pool_t;
+
 xq_t *xq_create(void);
 void xq_destroy(xq_t *xq);
 xq_t *xq_init(xq_t *xq);
 void xq_insert_after(xq_t *xq, xq_node_t *n, xq_node_t *after);
 void xq_insert_before(xq_t *xq, xq_node_t *n, xq_node_t *before);
 xq_node_t *xq_node_create(void *data);
+void xq_unlink(xq_t *xq, xq_node_t *xn);
 void xq_delete(xq_t *xq, xq_node_t *xn);
 void xq_append(xq_t *xq, xq_node_t *xn);
 void xq_prepend(xq_t *xq, xq_node_t *xn);
@@ -32,9 +63,27 @@ xq_node_t *xq_first(xq_t *xq);
 xq_node_t *xq_next(xq_t *xq, xq_node_t *xn);
 xq_node_t *xq_prev(xq_t *xq, xq_node_t *xn);
 
+xq_hash_t *xq_hash_create(void);
+void xq_hash_destroy(xq_hash_t *xh);
+void xq_hash_insert(xq_hash_t *xh, long long key, xq_node_t *xn);
+void xq_hash_remove(xq_hash_t *xh, long long key);
+xq_node_t *xq_hash_find(xq_hash_t *xh, long long key);
+
+void xq_pool_init(xq_pool_t *pool, int elem_size);
+void *xq_pool_get(xq_pool_t *pool);
+void xq_pool_put(xq_pool_t *pool, void *elem);
+
 /* adlb-specific code here */
 
-#define  REQ_TYPE_VECT_SZ                    16
+/* an rq entry holds this many req_types and list links without a separate block */
+#define  RQ_INLINE_TYPES                     4
+
+/* the types a reserve asks for, as a bitset over type_idx; wildcard sets all */
+typedef unsigned int req_mask_t;
+#define  REQ_MASK_BITS                       (8 * (int) sizeof(req_mask_t))
+#define  REQ_MASK_TEST(mask,idx)  (((mask)[(idx)/REQ_MASK_BITS] >> ((idx)%REQ_MASK_BITS)) & 1)
+
+struct wq_heap_t;    /* priority index of available wq entries; private to xq.c */
 
 typedef struct wq_struct_t
 {
@@ -43,6 +92,7 @@ typedef struct wq_struct_t
     int home_server_rank;
     int pin_rank;
     int pinned;
+    int soft_pinned;       /* pinned by a prefetch; may be taken back */
     int work_type;
     int work_prio;
     int work_len;
@@ -51,6 +101,9 @@ typedef struct wq_struct_t
     int common_len;
     int common_server_rank;
     int common_server_commseqno;
+    int type_idx;          /* index of work_type in user_types */
+    int heap_pos;          /* slot in heap below; -1 if not in one */
+    struct wq_heap_t *heap;  /* heap holding this entry while avail; else NULL */
     void *work_buf;
     double time_stamp;
 } wq_struct_t;
@@ -60,14 +113,21 @@ typedef struct rq_struct_t
     double time_stamp;
     int world_rank;
     int rqseqno;
-    int req_types[REQ_TYPE_VECT_SZ];
+    int num_req_types;     /* entries in req_types; a wildcard is the single type -1 */
+    int *req_types;        /* inline_types unless more than RQ_INLINE_TYPES */
+    req_mask_t *req_mask;  /* req_types as a bitset */
+    int rq_order;          /* position in rq; lower is older */
+    int num_links;         /* entries used in links below */
+    xq_node_t **links;     /* nodes on the per-type/wildcard lists; inline_links or amalloc'd */
+    int inline_types[RQ_INLINE_TYPES];
+    xq_node_t *inline_links[RQ_INLINE_TYPES];
 } rq_struct_t;
 
-typedef struct iq_struct_t
+typedef struct iq_struct_t    /* the buf owned by an outstanding isend */
 {
     int buf_len;
+    int buf_is_payload;    /* buf is from pmalloc rather than amalloc */
     void *buf;
-    MPI_Request *mpi_req;
 } iq_struct_t;
 
 typedef struct tq_struct_t
@@ -90,36 +150,52 @@ typedef struct cq_struct_t
 
 extern xq_t *wq;
 extern xq_t *rq;
-extern xq_t *iq;
 extern xq_t *tq;
 extern xq_t *cq;
 
+void xq_pools_init(void);
+
+void req_mask_init(int num_types);
+int req_mask_words(void);
+void req_mask_build(req_mask_t *mask, int num_req_types, int *req_types);
+
+void wq_index_init(int num_types, int num_ranks);
 xq_node_t *wq_node_create(int work_type, int work_prio, int wqseqno, int answer_rank,
                           int target_rank, int work_len, void *work_buf);
 void wq_append(xq_node_t *xn);
 void wq_delete(xq_node_t *xn);
+void wq_pin(xq_node_t *xn, int pin_rank);
+void wq_soft_pin(xq_node_t *xn, int pin_rank);
+void wq_unpin(xq_node_t *xn, int pin_rank);
 xq_node_t *wq_find_seqno(int wqseqno);
-xq_node_t *wq_find_hi_prio(int *req_types);
-xq_node_t *wq_find_pre_targeted_hi_prio(int target_rank, int *req_types);
+xq_node_t *wq_find_hi_prio(req_mask_t *req_mask);
+xq_node_t *wq_find_pre_targeted_hi_prio(int target_rank, req_mask_t *req_mask);
 xq_node_t *wq_find_pinned_for_rank(int target_rank, int wqseqno);
+xq_node_t *wq_find_soft_pinned(int for_rank, req_mask_t *req_mask);
 xq_node_t *wq_find_unpinned(void);
 int wq_get_num_unpinned(void);
+void wq_summary_register(int *type_hi_prio, int *qlen_unpin_untarg);
 int wq_get_num_unpinned_untargeted(void);
 int wq_get_avail_hi_prio_of_type(int work_type);
 void wq_print_info(void);
 
-xq_node_t *rq_node_create(int world_rank, int *req_types, int rqseqno);
+void rq_index_init(int num_types, int num_ranks);
+xq_node_t *rq_node_create(int world_rank, int num_req_types, int *req_types, int rqseqno);
 void rq_append(xq_node_t *xn);
 void rq_delete(xq_node_t *xn);
 xq_node_t *rq_find_rank_queued_for_type(int rank, int work_type);
 xq_node_t *rq_find_seqno(int rqseqno);
 void rq_print_info(int num_types);
 
-xq_node_t *iq_node_create(MPI_Request *mpi_req, int buf_len, void *buf);
-void iq_append(xq_node_t *xn);
-void iq_delete(xq_node_t *xn);
+void iq_init(void);
+int iq_slot_create(int buf_len, void *buf);
+void iq_set_payload(int slot);
+MPI_Request *iq_req(int slot);
+int iq_count(void);
+void iq_test_completed(void);
 void iq_print_info(void);
 
+void tq_index_init(int num_types, int num_ranks);
 xq_node_t *tq_node_create(int app_rank, int work_type, int remote_server_rank, int num_stored);
 void tq_append(xq_node_t *xn);
 void tq_delete(xq_node_t *xn);
@@ -127,6 +203,7 @@ xq_node_t *tq_find_first_rt(int for_rank,int work_type);
 xq_node_t *tq_find_rtr(int for_rank,int work_type,int remote_server_rank);
 void tq_print_info(void);
 
+void cq_index_init(void);
 xq_node_t *cq_node_create(int commlen, void *common_data, int seqno);
 void cq_append(xq_node_t *xn);
 void cq_delete(xq_node_t *xn);